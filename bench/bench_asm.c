@@ -0,0 +1,138 @@
+/** ========================================================================= *
+ *
+ * @file bench_asm.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Assembler benchmark
+ *
+ * Generates source of BLOCKS labeled blocks (7 instructions each, with
+ * forward & backward jumps) and assembles it. Prints time & count of
+ * buffer reallocations, next to the count, growing code by 32 words,
+ * labels & relocations by 8 entries and line table by 64 bytes would take.
+ * Then assembles it with svm_asm_parallel on each count of JOBS (1, 2, 4
+ * and count of online CPUs by default), and prints time & speedup against
+ * svm_asm (parallel result is checked to be identical)
+ *
+ * Usage: svm_bench_asm [BLOCKS [JOBS...]]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm/svm_asm.h"
+#include "svm/svm_util.h"
+#include "svm_bench.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Defines ================================================================== */
+#ifndef SVM_BENCH_ASM_BLOCKS
+#define SVM_BENCH_ASM_BLOCKS 200000
+#endif
+
+/**
+ * Upper bound of generated source size per block
+ */
+#define SVM_BENCH_ASM_BLOCK_SIZE 128
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static uint32_t svm_bench_steps(uint32_t size, uint32_t step) {
+  return (size + step - 1) / step;
+}
+
+/**
+ * Generates source of blocks, returns its size
+ */
+static size_t svm_bench_generate(char * source, uint32_t blocks) {
+  size_t size = 0;
+
+  for (uint32_t i = 0; i < blocks; ++i) {
+    uint32_t target = i + 1 + i % 7 < blocks ? i + 1 + i % 7 : i / 2;
+
+    size += sprintf(
+        source + size,
+        "B%u\nmov r0 %u\nadd r0 r1\nclf\ncmp r0 %u\njmp.lt B%u\nsys 1\nshl r1 1\n",
+        i, i, i % 100, target
+    );
+  }
+
+  size += sprintf(source + size, "end\n");
+
+  return size;
+}
+
+/* Shared functions ========================================================= */
+int main(int argc, char ** argv) {
+  uint32_t blocks = argc > 1 ? strtoul(argv[1], NULL, 10) : SVM_BENCH_ASM_BLOCKS;
+  char * source = malloc((size_t) blocks * SVM_BENCH_ASM_BLOCK_SIZE + 16);
+
+  if (!source) {
+    printf("Failed to allocate source\n");
+    return 1;
+  }
+
+  size_t size = svm_bench_generate(source, blocks);
+
+  svm_asm_t ctx;
+  svm_asm_init(&ctx);
+
+  double start = svm_bench_time_ms();
+  svm_asm_error_t res = svm_asm(&ctx, source, size);
+  double elapsed = svm_bench_time_ms() - start;
+
+  if (res != SVM_ASM_OK) {
+    printf("Failed to assemble (%d)\n", res);
+    svm_asm_free(&ctx);
+    free(source);
+    return 1;
+  }
+
+  uint32_t fixed = svm_bench_steps(ctx.code.size, 32)
+                 + svm_bench_steps(ctx.labels.size, 8)
+                 + svm_bench_steps(ctx.relocs.size, 8)
+                 + svm_bench_steps(ctx.lines.size, 64);
+
+  printf(
+      "%zu bytes, %d words, %u labels, %u relocations, %u bytes of line table\n"
+      "assembled in %.1f ms\n"
+      "reallocs: %u (fixed steps would take %u)\n",
+      size, ctx.code.size, ctx.labels.size, ctx.relocs.size, ctx.lines.size,
+      elapsed,
+      ctx.reallocs, fixed
+  );
+
+  uint32_t defaults[] = {1, 2, 4, sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1};
+  uint32_t runs = argc > 2 ? (uint32_t) argc - 2 : sizeof(defaults) / sizeof(defaults[0]);
+  int ret = 0;
+
+  for (uint32_t i = 0; i < runs; ++i) {
+    uint32_t jobs = argc > 2 ? strtoul(argv[i + 2], NULL, 10) : defaults[i];
+    svm_asm_t parallel;
+
+    svm_asm_init(&parallel);
+
+    start = svm_bench_time_ms();
+    res = svm_asm_parallel(&parallel, source, size, jobs);
+    double time = svm_bench_time_ms() - start;
+
+    bool same = res == SVM_ASM_OK && parallel.code.size == ctx.code.size
+        && !memcmp(parallel.code.buffer, ctx.code.buffer, ctx.code.size * sizeof(ctx.code.buffer[0]));
+
+    printf("jobs %2u: %.1f ms (x%.2f)%s\n", jobs, time, elapsed / time, same ? "" : " - result differs!");
+
+    ret |= !same;
+
+    svm_asm_free(&parallel);
+  }
+
+  svm_asm_free(&ctx);
+  free(source);
+
+  return ret;
+}
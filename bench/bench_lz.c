@@ -0,0 +1,187 @@
+/** ========================================================================= *
+ *
+ * @file bench_lz.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * LZ codec benchmark
+ *
+ * Assembles source FILE (or generated source of BLOCKS blocks, mixing
+ * arithmetic, compares, jumps, calls & pushes with varying operands), then
+ * compresses & decompresses the code with svm_lz, repeating each for at
+ * least SVM_BENCH_LZ_TIME_MS. Prints ratio and MB/s of uncompressed code
+ * for both directions, next to memcpy of the same buffer, and checks that
+ * the code round trips
+ *
+ * Usage: svm_bench_lz [BLOCKS | FILE]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm/svm_asm.h"
+#include "svm/svm_lz.h"
+#include "svm/svm_util.h"
+#include "svm_bench.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines ================================================================== */
+#ifndef SVM_BENCH_LZ_BLOCKS
+#define SVM_BENCH_LZ_BLOCKS 200000
+#endif
+
+#ifndef SVM_BENCH_LZ_TIME_MS
+#define SVM_BENCH_LZ_TIME_MS 500
+#endif
+
+/**
+ * Upper bound of generated source size per block
+ */
+#define SVM_BENCH_LZ_BLOCK_SIZE 160
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/**
+ * Codec operation, timed by svm_bench_rate
+ */
+typedef bool (*svm_bench_op_t)(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity, uint32_t * result);
+
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+/**
+ * Generates source of blocks, returns its size
+ */
+static size_t svm_bench_generate(char * source, uint32_t blocks) {
+  static const char * ops[] = {"add", "sub", "mul", "and", "or", "xor"};
+  size_t size = 0;
+
+  for (uint32_t i = 0; i < blocks; ++i) {
+    size += sprintf(
+        source + size,
+        "B%u\nmov r%u %u\n%s r%u r%u\nclf\ncmp r%u %u\njmp.%s B%u\npush r%u r%u\ninv B%u\npop r%u r%u\n",
+        i, i % 6, i * 7 % 1000, ops[i % 6], i % 5, (i + 1) % 6, i % 4, i % 100,
+        i % 3 ? "lt" : "ge", i + 1 < blocks ? i + 1 : 0, i % 3, i % 3 + 2, i / 2, i % 3, i % 3 + 2
+    );
+  }
+
+  size += sprintf(source + size, "end\n");
+
+  return size;
+}
+
+static bool svm_bench_compress(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity, uint32_t * result) {
+  *result = svm_lz_compress(src, size, dst, capacity);
+  return *result != 0;
+}
+
+static bool svm_bench_decompress(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity, uint32_t * result) {
+  *result = capacity;
+  return svm_lz_decompress(src, size, dst, capacity);
+}
+
+static bool svm_bench_memcpy(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity, uint32_t * result) {
+  memcpy(dst, src, size);
+  *result = size;
+  return capacity >= size;
+}
+
+/**
+ * Repeats op for at least SVM_BENCH_LZ_TIME_MS, returns MB/s of bytes
+ * (or 0, if op failed)
+ */
+static double svm_bench_rate(
+    svm_bench_op_t op, uint32_t bytes,
+    const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity, uint32_t * result
+) {
+  uint32_t runs = 0;
+  double start = svm_bench_time_ms();
+  double elapsed;
+
+  do {
+    if (!op(src, size, dst, capacity, result)) {
+      return 0;
+    }
+    runs++;
+  } while ((elapsed = svm_bench_time_ms() - start) < SVM_BENCH_LZ_TIME_MS);
+
+  return (double) bytes * runs / elapsed / 1000.0;
+}
+
+/* Shared functions ========================================================= */
+int main(int argc, char ** argv) {
+  char * end = NULL;
+  uint32_t blocks = argc > 1 ? strtoul(argv[1], &end, 10) : SVM_BENCH_LZ_BLOCKS;
+  bool file = argc > 1 && (end == argv[1] || *end);
+
+  svm_asm_t ctx;
+  svm_asm_error_t res;
+
+  if (file) {
+    size_t size;
+    const char * source = svm_asm_map_file(argv[1], &size);
+
+    if (!source) {
+      printf("Failed to open %s\n", argv[1]);
+      return 1;
+    }
+
+    svm_asm_init(&ctx);
+    res = svm_asm(&ctx, source, size);
+    svm_asm_unmap_file(source, size);
+  } else {
+    char * source = malloc((size_t) blocks * SVM_BENCH_LZ_BLOCK_SIZE + 16);
+
+    if (!source) {
+      printf("Failed to allocate source\n");
+      return 1;
+    }
+
+    svm_asm_init(&ctx);
+    res = svm_asm(&ctx, source, svm_bench_generate(source, blocks));
+    free(source);
+  }
+
+  if (res != SVM_ASM_OK) {
+    printf("Failed to assemble (%d)\n", res);
+    svm_asm_free(&ctx);
+    return 1;
+  }
+
+  const uint8_t * code = (const uint8_t *) ctx.code.buffer;
+  uint32_t size = ctx.code.size * sizeof(ctx.code.buffer[0]);
+  uint32_t capacity = SVM_LZ_BOUND(size);
+  uint8_t * compressed = malloc(capacity);
+  uint8_t * decompressed = malloc(size);
+  uint32_t compressed_size = 0, result = 0;
+
+  if (!compressed || !decompressed) {
+    printf("Failed to allocate buffers\n");
+    return 1;
+  }
+
+  double copy = svm_bench_rate(svm_bench_memcpy, size, code, size, decompressed, size, &result);
+  double compress = svm_bench_rate(svm_bench_compress, size, code, size, compressed, capacity, &compressed_size);
+
+  memset(decompressed, 0, size);
+
+  double decompress = svm_bench_rate(svm_bench_decompress, size, compressed, compressed_size, decompressed, size, &result);
+  bool same = compress && decompress && !memcmp(code, decompressed, size);
+
+  printf(
+      "%u bytes of code -> %u compressed (%.1f%%)\n"
+      "compress:   %8.1f MB/s\n"
+      "decompress: %8.1f MB/s\n"
+      "memcpy:     %8.1f MB/s\n%s",
+      size, compressed_size, size ? 100.0 * compressed_size / size : 0.0,
+      compress, decompress, copy,
+      same ? "" : "round trip failed!\n"
+  );
+
+  free(compressed);
+  free(decompressed);
+  svm_asm_free(&ctx);
+
+  return !same;
+}
@@ -0,0 +1,131 @@
+/** ========================================================================= *
+ *
+ * @file bench_opt.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Strength reduction benchmark
+ *
+ * Runs ITERATIONS of a loop with mul by 8, div by 4 (of a non-negative
+ * value) & add of a zeroed register, unoptimized and at -O1 & -O2. Prints
+ * count of rewritten instructions, cycles & time of each run, and checks,
+ * that the result is the same
+ *
+ * Usage: svm_bench_opt [ITERATIONS]
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm/svm.h"
+#include "svm/svm_asm.h"
+#include "svm/svm_opt.h"
+#include "svm_bench.h"
+#include <stdlib.h>
+
+/* Defines ================================================================== */
+#ifndef SVM_BENCH_OPT_ITERATIONS
+#define SVM_BENCH_OPT_ITERATIONS 3000000
+#endif
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static const char * svm_bench_source =
+    "mov r0 0\n"
+    "mov r3 0\n"
+    "loop\n"
+    "mov r1 r0\n"
+    "and r1 1023\n"
+    "mul r1 8\n"
+    "mov r2 r0\n"
+    "and r2 4080\n"
+    "div r2 4\n"
+    "add r3 r1\n"
+    "add r3 r2\n"
+    "xor r4 r4\n"
+    "add r3 r4\n"
+    "add r0 1\n"
+    "clf\n"
+    "cmp r0 %u\n"
+    "jmp lt loop\n"
+    "sys 1\n"
+    "end\n";
+
+/* Private functions ======================================================== */
+/* Shared functions ========================================================= */
+void svm_sys_handler(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num) {
+  (void) syscall_num;
+
+  *(int32_t *) ctx = (*registers)[R3];
+}
+
+int main(int argc, char ** argv) {
+  uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : SVM_BENCH_OPT_ITERATIONS;
+  char source[512];
+  int32_t expected = 0;
+  int ret = 0;
+
+  int size = snprintf(source, sizeof(source), svm_bench_source, iterations);
+
+  for (uint8_t level = 0; level <= 2; ++level) {
+    svm_opt_config_t config = {.level = level, .inline_size = SVM_OPT_INLINE_SIZE};
+    svm_opt_stats_t stats = {0};
+    svm_asm_t ctx;
+
+    svm_asm_init(&ctx);
+
+    svm_asm_error_t res = svm_asm(&ctx, source, size);
+
+    if (res == SVM_ASM_OK && level) {
+      res = svm_opt_run(&ctx, &config, &stats);
+    }
+
+    if (res != SVM_ASM_OK) {
+      printf("-O%u: failed to assemble (%d)\n", level, res);
+      svm_asm_free(&ctx);
+      return 1;
+    }
+
+    svm_code_t code = {
+      .buffer = ctx.code.buffer,
+      .size = ctx.code.size,
+      .meta.call_stack_size = ctx.meta.call_stack_size,
+      .meta.stack_size = ctx.meta.stack_size,
+    };
+
+    svm_t vm;
+    int32_t result = 0;
+    uint64_t cycles = 0;
+    svm_error_t err = SVM_OK;
+
+    svm_init(&vm, &result);
+    svm_load(&vm, &code);
+
+    double start = svm_bench_time_ms();
+
+    while (vm.flags.running && (err = svm_cycle(&vm)) == SVM_OK) {
+      cycles++;
+    }
+
+    double elapsed = svm_bench_time_ms() - start;
+
+    if (!level) {
+      expected = result;
+    }
+
+    printf(
+        "-O%u: %u rewritten, %lu cycles, %.1f ms%s\n",
+        level, stats.reduce, (unsigned long) cycles, elapsed,
+        err != SVM_OK || result != expected ? " - result differs!" : ""
+    );
+
+    ret |= err != SVM_OK || result != expected;
+
+    svm_deinit(&vm);
+    svm_asm_free(&ctx);
+  }
+
+  return ret;
+}
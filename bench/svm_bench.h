@@ -0,0 +1,43 @@
+/** ========================================================================= *
+ *
+ * @file svm_bench.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Helpers, shared by benchmark programs
+ *
+ * Benchmarks are standalone programs, that print their measurements. They
+ * aren't run by ctest, as timings depend on the host
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Returns monotonic time in milliseconds
+ */
+static inline double svm_bench_time_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+#ifdef __cplusplus
+}
+#endif
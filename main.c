@@ -8,8 +8,14 @@
 
 /* Includes ================================================================= */
 #include "svm/svm_asm.h"
+#include "svm/svm_cache.h"
+#include "svm/svm_obj.h"
+#include "svm/svm_opt.h"
+#include "svm/svm_profile.h"
 #include "svm/svm_util.h"
+#include <pthread.h>
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -22,6 +28,8 @@
 #define SVM_ASM_DEVICES                 4
 #define SVM_ASM_USE_COLOR               1
 
+#define SVM_ASM_OBJECT_EXTENSION        ".svmo"
+
 #define SVM_ASM_CHAR_BLOCK              "█"
 #define SVM_ASM_COLOR_1                 "\e[0;37m"
 #define SVM_ASM_COLOR_0                 "\e[0;30m"
@@ -35,11 +43,30 @@ typedef enum {
   SVM_CMD_HELP,
   SVM_CMD_ASM,
   SVM_CMD_RUN,
+  SVM_CMD_PACK,
+  SVM_CMD_UNPACK,
 } svm_cmd_t;
 
 /* Types ==================================================================== */
 typedef uint8_t screen_t[8][8 * SVM_ASM_DEVICES];
 
+/**
+ * User context of VM, passed to syscall handler
+ */
+typedef struct {
+  screen_t screen;
+  svm_t * vm;                       /** VM, syscalls are made in (to put tasks to sleep) */
+} svm_port_t;
+
+typedef struct {
+  const char ** files;
+  uint32_t count;
+  uint32_t next;                    /** Index of the next file to pack, claimed atomically */
+  uint32_t failed;                  /** Count of files, that failed to pack */
+  const svm_opt_config_t * config;
+  const char * cache;               /** Cache directory (may be NULL) */
+} svm_batch_t;
+
 /* Variables ================================================================ */
 /* Private functions ======================================================== */
 static void screen_init(screen_t * screen) {
@@ -94,25 +121,295 @@ static svm_cmd_t svm_asm_parse_cmd(const char * cmd) {
     return SVM_CMD_ASM;
   } else if (!strcmp(cmd, "run")) {
     return SVM_CMD_RUN;
+  } else if (!strcmp(cmd, "pack")) {
+    return SVM_CMD_PACK;
+  } else if (!strcmp(cmd, "unpack")) {
+    return SVM_CMD_UNPACK;
   } else {
     return SVM_CMD_UNKNOWN;
   }
 }
 
+static svm_asm_error_t svm_asm_optimize(svm_asm_t * ctx, const svm_opt_config_t * config) {
+  if (!config->level && !config->profile) {
+    return SVM_ASM_OK;
+  }
+
+  svm_opt_stats_t stats;
+  svm_asm_error_t res = svm_opt_run(ctx, config, &stats);
+
+  if (res != SVM_ASM_OK) {
+    printf("Optimization failed (%d)\n", res);
+    return res;
+  }
+
+  printf(
+      "Optimized: %u -> %u instructions, %u -> %u words\n"
+      "  inline: %u calls inlined (%+d words), 2 cycles saved per executed call\n"
+      "  reduce: %u rewritten\n"
+      "  constprop: %u changed\n"
+      "  thread: %u jumps changed\n"
+      "  licm: %u hoisted out of loops\n"
+      "  dce: %u removed (%u bytes), %u labels pruned\n"
+      "  saves: %u push/pop pairs narrowed or removed\n"
+      "  peephole: %u removed\n"
+      "  layout: %u jumps removed or inverted\n",
+      stats.instructions_before, stats.instructions_after,
+      stats.words_before, stats.words_after,
+      stats.inlined, stats.inline_words,
+      stats.reduce,
+      stats.constprop,
+      stats.thread,
+      stats.licm,
+      stats.dce, stats.dce_words * (uint32_t) sizeof(int32_t), stats.labels_pruned,
+      stats.saves,
+      stats.peephole,
+      stats.layout
+  );
+
+  return SVM_ASM_OK;
+}
+
+static svm_asm_error_t svm_asm_file_cached(
+    svm_asm_t * ctx,
+    const char * filename,
+    const svm_opt_config_t * config,
+    const char * cache
+) {
+  // Layout by profile depends on the profile contents, and stdin can't be hashed ahead
+  if (!cache || config->profile || !strcmp(filename, "-")) {
+    SVM_ASM_ERROR_CHECK_RETURN(svm_asm_file(ctx, filename));
+    return svm_asm_optimize(ctx, config);
+  }
+
+  size_t size;
+  const char * source = svm_asm_map_file(filename, &size);
+
+  if (!source) {
+    printf("Failed to open %s\n", filename);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  // Key is computed from the same source, that is assembled on miss
+  uint32_t options[2] = {config->level, config->inline_size};
+  uint64_t key;
+
+  svm_cache_key(source, size, options, sizeof(options), &key);
+
+  if (svm_cache_load(ctx, cache, key, filename)) {
+    svm_asm_unmap_file(source, size);
+    return SVM_ASM_OK;
+  }
+
+  svm_asm_error_t res = svm_asm_source(ctx, filename, source, size);
+
+  svm_asm_unmap_file(source, size);
+
+  SVM_ASM_ERROR_CHECK_RETURN(res);
+  SVM_ASM_ERROR_CHECK_RETURN(svm_asm_optimize(ctx, config));
+
+  // Failing to fill the cache doesn't fail the build
+  svm_cache_store(ctx, cache, key);
+
+  return SVM_ASM_OK;
+}
+
+static int svm_pack_file(const char * filename, const svm_opt_config_t * config, const char * cache) {
+  if (svm_obj_check_file(filename)) {
+    printf("%s is already an object\n", filename);
+    return SVM_ERR_BAD_OBJECT;
+  }
+
+  // Object is written next to the source, with extension replaced
+  const char * name = strrchr(filename, '/');
+  name = name ? name + 1 : filename;
+
+  const char * ext = strrchr(name, '.');
+  size_t length = ext && ext != name ? (size_t) (ext - filename) : strlen(filename);
+
+  char * out = svm_malloc(length + sizeof(SVM_ASM_OBJECT_EXTENSION));
+  SVM_ASSERT_RETURN(out, SVM_ERR_BAD_ALLOC);
+
+  memcpy(out, filename, length);
+  strcpy(out + length, SVM_ASM_OBJECT_EXTENSION);
+
+  svm_asm_t ctx = {0};
+  svm_asm_error_t res = svm_asm_file_cached(&ctx, filename, config, cache);
+
+  if (res) {
+    printf("Failed to assemble %s (%d)\n", filename, res);
+    svm_asm_free(&ctx);
+    svm_free(out);
+    return res;
+  }
+
+  svm_code_t code = {
+    .buffer = ctx.code.buffer,
+    .size = ctx.code.size,
+    .meta.call_stack_size = ctx.meta.call_stack_size,
+    .meta.stack_size = ctx.meta.stack_size,
+  };
+
+  int ret = svm_obj_save_file(&code, &ctx.lines, SVM_OBJ_COMPRESSION_LZ, out);
+
+  svm_asm_free(&ctx);
+  svm_free(out);
+
+  return ret;
+}
+
+static void * svm_batch_worker(void * arg) {
+  svm_batch_t * batch = arg;
+  uint32_t i;
+
+  while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count) {
+    if (svm_pack_file(batch->files[i], batch->config, batch->cache) != SVM_OK) {
+      __atomic_fetch_add(&batch->failed, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  return NULL;
+}
+
+static int svm_batch(svm_batch_t * batch, uint32_t jobs) {
+  if (!jobs) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = cpus > 0 ? cpus : 1;
+  }
+
+  if (jobs > batch->count) {
+    jobs = batch->count;
+  }
+
+  pthread_t threads[jobs];
+  uint32_t started = 0;
+
+  // Calling thread is a worker too, if thread can't be started, the rest pick up its files
+  while (started + 1 < jobs && !pthread_create(&threads[started], NULL, svm_batch_worker, batch)) {
+    started++;
+  }
+
+  svm_batch_worker(batch);
+
+  for (uint32_t i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  if (batch->failed) {
+    printf("Failed to pack %u of %u files\n", batch->failed, batch->count);
+    return SVM_ERR;
+  }
+
+  return SVM_OK;
+}
+
+static void svm_report_error(svm_error_t err, uint32_t pc, const svm_lines_t * lines, const char * object) {
+  svm_lines_t object_lines;
+  uint32_t line;
+
+  printf("Error %d at 0x%04x", err, pc);
+
+  // Line table is only read from object, when there is an error to report
+  if (!lines && object && svm_obj_load_lines_file(object, &object_lines) == SVM_OK) {
+    lines = &object_lines;
+  }
+
+  if (lines && svm_lines_lookup(lines, pc, &line)) {
+    printf(" (%s:%u)", lines->file ? lines->file : "?", line);
+  }
+
+  printf("\n");
+
+  if (lines == &object_lines) {
+    svm_lines_free(&object_lines);
+  }
+}
+
+static int svm_run(svm_code_t * code, const svm_lines_t * lines, const char * object, const char * profile) {
+  SVM_ASSERT_RETURN(code, SVM_ERR_NULL);
+
+  svm_t vm;
+  svm_port_t port = {.vm = &vm};
+  screen_init(&port.screen);
+
+  svm_init(&vm, &port);
+
+  uint32_t * counts = NULL;
+
+  if (profile) {
+#if USE_SVM_PROFILE
+    counts = svm_malloc((code->size + 1) * sizeof(uint32_t));
+    SVM_ASSERT_RETURN(counts, SVM_ERR_BAD_ALLOC);
+    memset(counts, 0, (code->size + 1) * sizeof(uint32_t));
+    vm.profile = counts;
+#else
+    printf("Profiling is disabled (USE_SVM_PROFILE)\n");
+#endif
+  }
+
+  svm_load(&vm, code);
+
+  printf("Execution:\n");
+
+  int ret = SVM_OK;
+  uint32_t cycles = 0;
+  while (vm.flags.running) {
+    if (SVM_ASM_MAX_CYCLES != 0 && cycles >= SVM_ASM_MAX_CYCLES) {
+      printf("Max cycles reached (%d)\n", SVM_ASM_MAX_CYCLES);
+      ret = SVM_ERR;
+      break;
+    }
+    // Every task is asleep - cycle waits for the first one and executes nothing
+    bool idle = !vm.task.current;
+    uint32_t pc = idle ? 0 : vm.task.current->pc;
+    svm_error_t err = svm_cycle(&vm);
+    if (err != SVM_OK) {
+      svm_report_error(err, pc, lines, object);
+      ret = err;
+      break;
+    }
+    if (!idle) {
+      cycles++;
+    }
+  }
+
+  if (ret == SVM_OK) {
+    printf("Execution ended. Took %d cycles\n", cycles);
+  }
+
+  // Profile is written even if execution failed
+  if (counts) {
+    svm_profile_t result;
+
+    if (svm_profile_init(&result, code, counts) == SVM_ASM_OK) {
+      svm_profile_save_file(&result, profile);
+      svm_profile_free(&result);
+    }
+
+    svm_free(counts);
+  }
+
+  svm_deinit(&vm);
+
+  return ret;
+}
+
 /* Shared functions ========================================================= */
-void svm_port_sys(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num) {
-  printf("sys %d\n", syscall_num);
+void svm_sys_handler(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num) {
+  svm_port_t * port = ctx;
+
   switch (syscall_num) {
     case 1:
-      usleep((*registers)[R0] * 1000);
+      // Only the calling task sleeps, others keep running
+      svm_task_sleep(port->vm, port->vm->task.current, (*registers)[R0] > 0 ? (*registers)[R0] : 0);
       break;
 
     case 2:
-      screen_set((screen_t *) ctx, (*registers)[R0], (*registers)[R1], (*registers)[R2]);
+      screen_set(&port->screen, (*registers)[R0], (*registers)[R1], (*registers)[R2]);
       break;
 
     case 3:
-      screen_out((screen_t *) ctx);
+      screen_out(&port->screen);
       break;
 
     default:
@@ -123,74 +420,187 @@ void svm_port_sys(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num)
 
 int main(int argc, char ** argv) {
   svm_cmd_t cmd = SVM_CMD_HELP;
-
-  if (argc == 3) {
+  svm_opt_config_t opt_config = {.inline_size = SVM_OPT_INLINE_SIZE};
+  svm_profile_t profile;
+  const char * profile_file = NULL;
+  const char * cache_dir = NULL;
+  const char * files[argc];
+  uint32_t file_count = 0;
+  uint32_t jobs = 0;
+  bool batch = false;
+
+  if (argc >= 3) {
     cmd = svm_asm_parse_cmd(argv[1]);
   }
 
+  for (int i = 2; i < argc && cmd != SVM_CMD_HELP; ++i) {
+    if (!strncmp(argv[i], "-O", 2) && argv[i][2] >= '0' && argv[i][2] <= '9' && !argv[i][3]) {
+      opt_config.level = argv[i][2] - '0';
+    } else if (!strncmp(argv[i], "--profile=", 10) && argv[i][10]) {
+      profile_file = argv[i] + 10;
+    } else if (!strncmp(argv[i], "--inline=", 9) && argv[i][9]) {
+      opt_config.inline_size = strtoul(argv[i] + 9, NULL, 10);
+    } else if (!strncmp(argv[i], "--cache=", 8) && argv[i][8]) {
+      cache_dir = argv[i] + 8;
+    } else if (!strncmp(argv[i], "--jobs=", 7) && argv[i][7]) {
+      jobs = strtoul(argv[i] + 7, NULL, 10);
+      batch = true;
+    } else if (argv[i][0] == '-' && argv[i][1]) {
+      printf("Unknown option %s!\n", argv[i]);
+      cmd = SVM_CMD_HELP;
+    } else {
+      files[file_count++] = argv[i];
+    }
+  }
+
+  if (batch && cmd != SVM_CMD_PACK) {
+    printf("--jobs is only supported by pack\n");
+    cmd = SVM_CMD_HELP;
+  } else if (batch ? !file_count : file_count != ((cmd == SVM_CMD_PACK || cmd == SVM_CMD_UNPACK) ? 2 : 1)) {
+    cmd = SVM_CMD_HELP;
+  }
+
+  // run collects profile, everything else uses it
+  if (profile_file && cmd != SVM_CMD_RUN && cmd != SVM_CMD_HELP) {
+    svm_asm_error_t res = svm_profile_load_file(&profile, profile_file);
+
+    if (res != SVM_ASM_OK) {
+      printf("Failed to load profile %s (%d)\n", profile_file, res);
+      return res;
+    }
+
+    opt_config.profile = &profile;
+  }
+
   switch (cmd) {
     case SVM_CMD_HELP:
       printf(
           "SVM - Small Virtual Machine\n"
-          "Usage: %s [help|asm|run] FILE\n"
-          "  help - Prints this message\n"
-          "  asm  - Assembles provided file\n"
-          "         and outputs hex to stdout\n"
-          "  run  - Assembles and runs file\n"
-          "", argv[0]
+          "Usage: %s [help|asm|run|pack|unpack] [OPTIONS] FILE [OUT]\n"
+          "       %s pack --jobs=N [OPTIONS] FILE...\n"
+          "  help   - Prints this message\n"
+          "  asm    - Assembles provided file (- for stdin)\n"
+          "           and outputs hex to stdout\n"
+          "  run    - Assembles and runs file\n"
+          "           (or runs object file)\n"
+          "  pack   - Assembles (or loads object) FILE\n"
+          "           and writes compressed object to OUT\n"
+          "           (with --jobs, packs every source FILE\n"
+          "           into FILE" SVM_ASM_OBJECT_EXTENSION ", on N threads, 0 - one per CPU)\n"
+          "  unpack - Loads object FILE and writes\n"
+          "           uncompressed object to OUT\n"
+          "Options:\n"
+          "  -O0    - Disable optimizer (default)\n"
+          "  -O1    - Peephole optimizations, strength reduction\n"
+          "  -O2    - Inlining, constant propagation, jump\n"
+          "           threading, unreachable code removal,\n"
+          "           push/pop narrowing around calls & -O1\n"
+          "  --inline=N\n"
+          "         - Max instruction count of subroutine,\n"
+          "           inlined at -O2 (0 disables, default %d)\n"
+          "  --profile=FILE\n"
+          "         - run: write block execution counts to FILE\n"
+          "           asm/pack: lay out blocks by counts from FILE\n"
+          "           (collected with the same -O level)\n"
+          "  --cache=DIR\n"
+          "         - Reuse objects of unchanged sources from DIR\n"
+          "           (not used with --profile or stdin)\n"
+          "", argv[0], argv[0], SVM_OPT_INLINE_SIZE
       );
       return 1;
 
-    case SVM_CMD_ASM:
-    case SVM_CMD_RUN: {
+    case SVM_CMD_ASM: {
       svm_asm_t ctx;
-      svm_asm_error_t res = svm_asm_file(&ctx, argv[2]);
+      svm_asm_error_t res = svm_asm_file_cached(&ctx, files[0], &opt_config, cache_dir);
 
       if (res) {
         return res;
       }
 
-      if (cmd == SVM_CMD_ASM) {
-        printf("Bytecode:\n");
-        for (uint32_t i = 0; i < ctx.code.size; ++i) {
-          printf("0x%08x, ", ctx.code.buffer[i]);
-          if (i && (i+1) % SVM_ASM_HEX_PRINT_WORDS_IN_LINE == 0) {
-            printf("\n");
-          }
+      printf("Bytecode:\n");
+      for (uint32_t i = 0; i < ctx.code.size; ++i) {
+        printf("0x%08x, ", ctx.code.buffer[i]);
+        if (i && (i+1) % SVM_ASM_HEX_PRINT_WORDS_IN_LINE == 0) {
+          printf("\n");
         }
-        printf("\n");
+      }
+      printf("\n");
+
+      svm_asm_free(&ctx);
+
+      break;
+    }
+
+    case SVM_CMD_PACK:
+      if (batch) {
+        svm_batch_t state = {
+          .files = files,
+          .count = file_count,
+          .config = &opt_config,
+          .cache = cache_dir,
+        };
+
+        return svm_batch(&state, jobs);
+      }
+      // fallthrough
+
+    case SVM_CMD_RUN:
+    case SVM_CMD_UNPACK: {
+      svm_asm_t ctx = {0};
+      svm_code_t code = {0};
+      bool object = svm_obj_check_file(files[0]);
+
+      if (object) {
+        svm_error_t err = svm_obj_load_file(&code, files[0]);
+
+        if (err != SVM_OK) {
+          printf("Failed to load object %s (%d)\n", files[0], err);
+          return err;
+        }
+      } else if (cmd == SVM_CMD_UNPACK) {
+        printf("%s is not an object\n", files[0]);
+        return SVM_ERR_BAD_OBJECT;
+      } else {
+        svm_asm_error_t res = svm_asm_file_cached(&ctx, files[0], &opt_config, cache_dir);
+
+        if (res) {
+          return res;
+        }
+
+        code.buffer = ctx.code.buffer;
+        code.size = ctx.code.size;
+        code.meta.call_stack_size = ctx.meta.call_stack_size;
+        code.meta.stack_size = ctx.meta.stack_size;
+      }
+
+      int ret = 0;
+
+      if (cmd == SVM_CMD_RUN) {
+        ret = svm_run(&code, object ? NULL : &ctx.lines, object ? files[0] : NULL, profile_file);
       } else {
-        screen_t screen;
-        screen_init(&screen);
-
-        svm_t vm;
-        svm_init(&vm, &screen);
-        svm_code_t code = {ctx.code.buffer, ctx.code.size};
-        svm_load(&vm, &code);
-
-        printf("Execution:\n");
-
-        uint32_t cycles = 0;
-        while (vm.flags.running) {
-          if (SVM_ASM_MAX_CYCLES != 0 && cycles >= SVM_ASM_MAX_CYCLES) {
-            printf("Max cycles reached (%d)\n", SVM_ASM_MAX_CYCLES);
-            return SVM_ERR;
-          }
-          svm_error_t err = svm_cycle(&vm);
-          if (err != SVM_OK) {
-            return err;
-          }
-          cycles++;
+        svm_obj_compression_t compression = cmd == SVM_CMD_PACK ? SVM_OBJ_COMPRESSION_LZ : SVM_OBJ_COMPRESSION_NONE;
+        svm_lines_t object_lines;
+        svm_lines_t * lines = &ctx.lines;
+
+        // Keep line table, if object had one
+        if (object) {
+          lines = svm_obj_load_lines_file(files[0], &object_lines) == SVM_OK ? &object_lines : NULL;
         }
 
-        printf("Execution ended. Took %d cycles\n", cycles);
+        ret = svm_obj_save_file(&code, lines, compression, files[1]);
 
-        svm_deinit(&vm);
+        if (object && lines) {
+          svm_lines_free(lines);
+        }
       }
 
-      svm_asm_free(&ctx);
+      if (object) {
+        svm_obj_free(&code);
+      } else {
+        svm_asm_free(&ctx);
+      }
 
-      break;
+      return ret;
     }
 
     default:
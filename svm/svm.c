@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* Defines ================================================================== */
 /* Macros =================================================================== */
@@ -33,6 +34,9 @@ static int32_t svm_get_arg_value(svm_t * vm, svm_arg_type_t type) {
     return reg < R_MAX ? vm->task.current->registers[reg] : 0;
   } else if (type == ARG_IMM) {
     return vm->code->buffer[vm->task.current->pc++];
+  } else if (type == ARG_REL) {
+    uint32_t location = vm->task.current->pc++;
+    return location + vm->code->buffer[location];
   } else {
     // TODO: Signal error
     return 0;
@@ -121,6 +125,122 @@ static int svm_set_flag_by_ext(svm_t * vm, svm_ext_t ext, bool value) {
   return 0;
 }
 
+/**
+ * Appends task to the tail of run queue of its priority
+ */
+static void svm_task_link(svm_t * vm, svm_task_t * task) {
+  svm_task_queue_t * queue = &vm->task.queue[task->priority];
+
+  if (queue->head) {
+    task->prev = queue->tail;
+    task->next = queue->head;
+    queue->tail->next = task;
+    queue->head->prev = task;
+  } else {
+    task->prev = task;
+    task->next = task;
+    queue->head = task;
+    vm->task.ready |= 1u << task->priority;
+  }
+
+  queue->tail = task;
+  queue->count++;
+}
+
+/**
+ * Removes task from run queue of its priority
+ */
+static void svm_task_unlink(svm_t * vm, svm_task_t * task) {
+  svm_task_queue_t * queue = &vm->task.queue[task->priority];
+
+  if (task->next == task) {
+    queue->head = NULL;
+    queue->tail = NULL;
+    vm->task.ready &= ~(1u << task->priority);
+  } else {
+    task->prev->next = task->next;
+    task->next->prev = task->prev;
+
+    if (queue->head == task) {
+      queue->head = task->next;
+    }
+
+    if (queue->tail == task) {
+      queue->tail = task->prev;
+    }
+  }
+
+  task->next = NULL;
+  task->prev = NULL;
+  queue->count--;
+}
+
+/**
+ * Finds task with the earliest deadline in run queue, starting from head
+ * (tasks without deadline are the latest)
+ */
+static svm_task_t * svm_task_earliest(const svm_task_queue_t * queue) {
+  svm_task_t * earliest = queue->head;
+  svm_task_t * task = queue->head->next;
+
+  while (task != queue->head) {
+    if (task->deadline && (!earliest->deadline || task->deadline < earliest->deadline)) {
+      earliest = task;
+    }
+    task = task->next;
+  }
+
+  return earliest;
+}
+
+/**
+ * Returns tasks, that woke up, to the tails of their run queues
+ */
+static void svm_task_wake(svm_t * vm) {
+  if (!vm->timer.count) {
+    return;
+  }
+
+  svm_timer_advance(&vm->timer, svm_time_handler(vm->ctx));
+
+  svm_task_t * task;
+
+  while ((task = svm_timer_pop(&vm->timer))) {
+    task->ready = vm->cycles;
+    svm_task_link(vm, task);
+  }
+}
+
+/**
+ * Makes the next task of the highest priority non-empty run queue current
+ */
+static void svm_task_dispatch(svm_t * vm) {
+  svm_task_wake(vm);
+
+  if (vm->task.current) {
+    vm->task.current->ready = vm->cycles;
+  }
+
+  vm->task.slice = 0;
+
+  if (!vm->task.ready) {
+    vm->task.current = NULL;
+    return;
+  }
+
+  svm_task_queue_t * queue = &vm->task.queue[__builtin_ctz(vm->task.ready)];
+  svm_task_t * task = vm->flags.edf ? svm_task_earliest(queue) : queue->head;
+
+  // Rotate ring, so the task runs again after every other task of its queue
+  queue->head = task->next;
+  queue->tail = task;
+
+  task->stats.waited += vm->cycles - task->ready;
+  task->stats.dispatches++;
+
+  vm->task.current = task;
+}
+
 /* Shared functions ========================================================= */
 svm_instruction_t svm_pack_instruction(
     svm_opcode_t op,
@@ -147,6 +267,7 @@ svm_error_t svm_init(svm_t * vm, void * ctx) {
   memset(vm, 0, sizeof(*vm));
 
   vm->ctx = ctx;
+  vm->task.quantum = SVM_TASK_QUANTUM;
 
   return SVM_OK;
 }
@@ -163,7 +284,7 @@ svm_error_t svm_load(svm_t * vm, svm_code_t * code) {
   vm->code = code;
 
   int32_t registers[R_MAX] = {0};
-  SVM_ERROR_CHECK_RETURN(svm_task_create(vm, 0, &registers));
+  SVM_ERROR_CHECK_RETURN(svm_task_create(vm, 0, &registers, NULL));
 
   vm->flags.running = true;
 
@@ -174,7 +295,21 @@ svm_error_t svm_load(svm_t * vm, svm_code_t * code) {
 svm_error_t svm_unload(svm_t * vm) {
   SVM_ASSERT_RETURN(vm, SVM_ERR_NULL);
 
-  // TODO: release all allocated resources
+  // Nothing to dispatch, after tasks are gone
+  vm->task.current = NULL;
+
+  while (vm->task.ready) {
+    SVM_ERROR_CHECK_RETURN(svm_task_remove(vm, vm->task.queue[__builtin_ctz(vm->task.ready)].head));
+  }
+
+  svm_task_t * sleeping;
+
+  while ((sleeping = svm_timer_any(&vm->timer))) {
+    SVM_ERROR_CHECK_RETURN(svm_task_remove(vm, sleeping));
+  }
+
+  vm->flags.running = false;
+  vm->code = NULL;
 
   return SVM_OK;
 }
@@ -186,11 +321,39 @@ svm_error_t svm_cycle(svm_t * vm) {
     return SVM_ERR_NOT_RUNNING;
   }
 
+  // Every task is asleep - host waits for the first one to wake up
+  if (!vm->task.current) {
+    if (!vm->timer.count) {
+      vm->flags.running = false;
+      return SVM_ERR_NOT_RUNNING;
+    }
+
+    uint64_t now = svm_time_handler(vm->ctx);
+    uint64_t next = svm_timer_next(&vm->timer);
+
+    if (next > now) {
+      svm_idle_handler(vm->ctx, next - now < UINT32_MAX ? next - now : UINT32_MAX);
+    }
+
+    svm_task_dispatch(vm);
+
+    return SVM_OK;
+  }
+
   if (vm->task.current->pc >= vm->code->size) {
     vm->flags.running = false;
     return SVM_ERR_CODE_OVERFLOW;
   }
 
+  vm->cycles++;
+  vm->task.current->stats.cycles++;
+
+#if USE_SVM_PROFILE
+  if (vm->profile) {
+    vm->profile[vm->task.current->pc]++;
+  }
+#endif
+
   svm_instruction_t * instruction = (svm_instruction_t *) &vm->code->buffer[vm->task.current->pc++];
 
 #if USE_SVM_DEBUG_CYCLE
@@ -200,7 +363,7 @@ svm_error_t svm_cycle(svm_t * vm) {
       svm_opcode2str(instruction->op),
       svm_ext2str(instruction->ext, true),
       svm_get_arg_str(vm->code->buffer, vm->task.current->pc, instruction->arg1, false),
-      svm_get_arg_str(vm->code->buffer, vm->task.current->pc, instruction->arg2, instruction->arg1 == ARG_IMM)
+      svm_get_arg_str(vm->code->buffer, vm->task.current->pc, instruction->arg2, svm_arg_has_value(instruction->arg1))
   );
 #endif
 
@@ -210,8 +373,14 @@ svm_error_t svm_cycle(svm_t * vm) {
     }
 
     case OP_END: {
-      vm->flags.running = false;
-      break;
+      // Removal dispatches the next task
+      SVM_ERROR_CHECK_RETURN(svm_task_remove(vm, vm->task.current));
+
+      // Block belonged to the finished task
+      vm->flags.task_switch_block = false;
+      vm->flags.running = vm->task.count > 0;
+
+      return SVM_OK;
     }
 
     case OP_MOV: {
@@ -290,7 +459,7 @@ svm_error_t svm_cycle(svm_t * vm) {
 
         register_t reg = svm_arg_to_reg(instruction->arg1);
 
-        vm->task.current->registers[reg] = vm->task.current->stack.buffer[vm->task.current->sp--];
+        vm->task.current->registers[reg] = vm->task.current->stack.buffer[--vm->task.current->sp];
         break;
       }
 
@@ -531,7 +700,14 @@ svm_error_t svm_cycle(svm_t * vm) {
     }
 
     case OP_SYS: {
+      svm_task_t * task = vm->task.current;
+
       svm_sys_handler(vm->ctx, &vm->task.current->registers, svm_get_arg_value(vm, instruction->arg1));
+
+      // Handler put the task to sleep, the next one is already dispatched
+      if (vm->task.current != task) {
+        return SVM_OK;
+      }
       break;
     }
 
@@ -564,6 +740,10 @@ svm_error_t svm_cycle(svm_t * vm) {
   printf("\n     |\n");
 #endif
 
+  if (vm->task.quantum && ++vm->task.slice >= vm->task.quantum && !vm->flags.task_switch_block) {
+    return svm_task_switch(vm);
+  }
+
   return SVM_OK;
 }
 
@@ -576,10 +756,10 @@ svm_error_t svm_task_init(svm_t * vm, svm_task_t * task, uint32_t pc, int32_t (*
   memcpy(task->registers, registers, sizeof(*registers));
 
   task->call_stack.size = vm->code->meta.call_stack_size ? vm->code->meta.call_stack_size : SVM_CALL_STACK_INIT_SIZE;
-  SVM_REALLOC_CHECK(task->call_stack.buffer, task->call_stack.size);
+  SVM_REALLOC_CHECK(task->call_stack.buffer, task->call_stack.size * sizeof(task->call_stack.buffer[0]));
 
   task->stack.size = vm->code->meta.stack_size ? vm->code->meta.stack_size : SVM_STACK_INIT_SIZE;
-  SVM_REALLOC_CHECK(task->stack.buffer, task->stack.size);
+  SVM_REALLOC_CHECK(task->stack.buffer, task->stack.size * sizeof(task->stack.buffer[0]));
 
   return SVM_OK;
 }
@@ -598,25 +778,28 @@ svm_error_t svm_task_deinit(svm_task_t * task) {
   return SVM_OK;
 }
 
-svm_error_t svm_task_create(svm_t * vm, uint32_t pc, int32_t (*registers)[R_MAX]) {
+svm_error_t svm_task_create(svm_t * vm, uint32_t pc, int32_t (*registers)[R_MAX], svm_task_t ** task) {
   SVM_ASSERT_RETURN(vm && registers, SVM_ERR_NULL);
 
-  svm_task_t * task = svm_malloc(sizeof(svm_task_t));
+  svm_task_t * created = svm_malloc(sizeof(svm_task_t));
 
-  SVM_ASSERT_RETURN(task, SVM_ERR_BAD_ALLOC);
+  SVM_ASSERT_RETURN(created, SVM_ERR_BAD_ALLOC);
 
-  SVM_ERROR_CHECK_RETURN(svm_task_init(vm, task, pc, registers));
+  svm_error_t err = svm_task_init(vm, created, pc, registers);
 
-  if (vm->task.head) {
-    svm_task_t * tmp = vm->task.head;
+  if (err != SVM_OK) {
+    svm_free(created);
+    return err;
+  }
 
-    while (tmp->next) {
-      tmp = tmp->next;
-    }
+  created->priority = SVM_TASK_PRIORITY_DEFAULT;
+  created->ready = vm->cycles;
 
-    tmp->next = task;
-  } else {
-    vm->task.head = task;
+  svm_task_link(vm, created);
+  vm->task.count++;
+
+  if (task) {
+    *task = created;
   }
 
   return SVM_OK;
@@ -625,24 +808,27 @@ svm_error_t svm_task_create(svm_t * vm, uint32_t pc, int32_t (*registers)[R_MAX]
 svm_error_t svm_task_remove(svm_t * vm, svm_task_t * task) {
   SVM_ASSERT_RETURN(vm && task, SVM_ERR_NULL);
 
-  if (vm->task.head == task) {
-    vm->task.head = vm->task.head->next;
-  } else {
-    svm_task_t * tmp = vm->task.head->next;
+  // Tasks in run queue are always linked both ways
+  SVM_ASSERT_RETURN(vm->task.count && task->next && task->prev, SVM_ERR_TASK_NOT_FOUND);
 
-    while (tmp) {
-      if (task->next == task) {
-        break;
-      }
-      tmp = tmp->next;
-    }
+  if (task->slot) {
+    svm_timer_cancel(&vm->timer, task);
+  } else {
+    svm_task_unlink(vm, task);
+  }
 
-    SVM_ASSERT_RETURN(tmp, SVM_ERR_TASK_NOT_FOUND);
+  vm->task.count--;
 
-    tmp->next = task->next;
+  if (vm->task.current == task) {
+    vm->task.current = NULL;
+    svm_task_dispatch(vm);
   }
 
-  return svm_task_deinit(task);
+  svm_error_t err = svm_task_deinit(task);
+
+  svm_free(task);
+
+  return err;
 }
 
 svm_error_t svm_task_switch(svm_t * vm) {
@@ -650,20 +836,80 @@ svm_error_t svm_task_switch(svm_t * vm) {
 
   SVM_ASSERT_RETURN(!vm->flags.task_switch_block, SVM_ERR_TASK_SWITCH_BLOCKED);
 
-  if (!vm->task.current) {
-    vm->task.current = vm->task.head;
-    return SVM_OK;
+  svm_task_dispatch(vm);
+
+  return SVM_OK;
+}
+
+svm_error_t svm_task_sleep(svm_t * vm, svm_task_t * task, uint32_t ms) {
+  SVM_ASSERT_RETURN(vm && task, SVM_ERR_NULL);
+  SVM_ASSERT_RETURN(task->next && task->prev, SVM_ERR_TASK_NOT_FOUND);
+
+  if (task->slot) {
+    svm_timer_cancel(&vm->timer, task);
+  } else {
+    svm_task_unlink(vm, task);
   }
 
-  vm->task.current = vm->task.current->next;
+  uint64_t now = svm_time_handler(vm->ctx);
 
-  if (!vm->task.current) {
-    vm->task.current = vm->task.head;
+  // Wheel time has to be current, as task is filed relative to it
+  svm_timer_advance(&vm->timer, now);
+
+  task->wake = now + ms;
+  svm_timer_add(&vm->timer, task);
+
+  if (vm->task.current == task) {
+    // Block belonged to the sleeping task
+    vm->flags.task_switch_block = false;
+    vm->task.current = NULL;
+    svm_task_dispatch(vm);
+  }
+
+  return SVM_OK;
+}
+
+svm_error_t svm_task_priority(svm_t * vm, svm_task_t * task, uint32_t priority) {
+  SVM_ASSERT_RETURN(vm && task, SVM_ERR_NULL);
+  SVM_ASSERT_RETURN(task->next && task->prev, SVM_ERR_TASK_NOT_FOUND);
+  SVM_ASSERT_RETURN(priority < SVM_TASK_PRIORITIES, SVM_ERR_BAD_PRIORITY);
+
+  // Sleeping task joins run queue of its priority, once it wakes up
+  if (task->slot) {
+    task->priority = priority;
+  } else if (task->priority != priority) {
+    svm_task_unlink(vm, task);
+    task->priority = priority;
+    svm_task_link(vm, task);
   }
 
   return SVM_OK;
 }
 
+svm_error_t svm_task_deadline(svm_t * vm, svm_task_t * task, uint32_t cycles) {
+  SVM_ASSERT_RETURN(vm && task, SVM_ERR_NULL);
+
+  task->deadline = cycles ? vm->cycles + cycles : 0;
+
+  return SVM_OK;
+}
+
+svm_error_t svm_task_edf(svm_t * vm, bool edf) {
+  SVM_ASSERT_RETURN(vm, SVM_ERR_NULL);
+
+  vm->flags.edf = edf;
+
+  return SVM_OK;
+}
+
+svm_error_t svm_task_quantum(svm_t * vm, uint32_t quantum) {
+  SVM_ASSERT_RETURN(vm, SVM_ERR_NULL);
+
+  vm->task.quantum = quantum;
+
+  return SVM_OK;
+}
+
 svm_error_t svm_task_block(svm_t * vm, bool block) {
   SVM_ASSERT_RETURN(vm, SVM_ERR_NULL);
 
@@ -685,14 +931,14 @@ void svm_disassemble(int32_t * buffer, uint32_t size) {
         svm_opcode2str(instruction->op),
         svm_ext2str(instruction->ext, true),
         svm_get_arg_str(buffer, index, instruction->arg1, false),
-        svm_get_arg_str(buffer, index, instruction->arg2, instruction->arg1 == ARG_IMM)
+        svm_get_arg_str(buffer, index, instruction->arg2, svm_arg_has_value(instruction->arg1))
     );
 
-    if (instruction->arg1 == ARG_IMM) {
+    if (svm_arg_has_value(instruction->arg1)) {
       index++;
     }
 
-    if (instruction->arg2 == ARG_IMM) {
+    if (svm_arg_has_value(instruction->arg2)) {
       index++;
     }
   }
@@ -712,4 +958,25 @@ __WEAK void * svm_realloc(void * buffer, size_t size) {
 
 __WEAK void svm_sys_handler(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num) {
   // Does nothing
+  (void) ctx;
+  (void) registers;
+  (void) syscall_num;
+}
+
+__WEAK uint64_t svm_time_handler(void * ctx) {
+  (void) ctx;
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+__WEAK void svm_idle_handler(void * ctx, uint32_t ms) {
+  (void) ctx;
+
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000l};
+
+  nanosleep(&ts, NULL);
 }
\ No newline at end of file
@@ -16,6 +16,7 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include "svm_timer.h"
 
 /* Defines ================================================================== */
 /**
@@ -59,6 +60,35 @@ extern "C" {
 #define SVM_MAX_TASKS 4
 #endif
 
+/**
+ * Provides definition for default count of cycles, task runs before being
+ * preempted (0 - tasks are switched only explicitly)
+ */
+#ifndef SVM_TASK_QUANTUM
+#define SVM_TASK_QUANTUM 64
+#endif
+
+/**
+ * Provides definition for count of task priority levels (at most 32)
+ */
+#ifndef SVM_TASK_PRIORITIES
+#define SVM_TASK_PRIORITIES 4
+#endif
+
+/**
+ * Provides definition for priority of created tasks (0 - highest)
+ */
+#ifndef SVM_TASK_PRIORITY_DEFAULT
+#define SVM_TASK_PRIORITY_DEFAULT (SVM_TASK_PRIORITIES / 2)
+#endif
+
+/**
+ * Enables per instruction execution counters (see svm_t profile)
+ */
+#ifndef USE_SVM_PROFILE
+#define USE_SVM_PROFILE 1
+#endif
+
 /* Macros =================================================================== */
 /* Enums ==================================================================== */
 /**
@@ -161,6 +191,7 @@ typedef enum {
   ARG_R14,
   ARG_R15,
   ARG_IMM,      /** Immediate value is present in next i32 */
+  ARG_REL,      /** Offset from location of next i32, which contains it */
 
   ARG_MAX       /** Special marker to get count of args */
 } svm_arg_type_t;
@@ -185,6 +216,9 @@ typedef enum {
   SVM_ERR_TASK_NOT_FOUND,       /** Requested task not found */
   SVM_ERR_TASK_SWITCH_BLOCKED,  /** Task switching requested, but it's blocked externally */
   SVM_ERR_UNKNOWN_INSTRUCTION,  /** Unknown instruction */
+  SVM_ERR_BAD_OBJECT,           /** Malformed or unsupported object */
+  SVM_ERR_IO,                   /** File read/write failed */
+  SVM_ERR_BAD_PRIORITY,         /** Task priority out of range */
 } svm_error_t;
 
 /* Types ==================================================================== */
@@ -226,7 +260,20 @@ typedef struct {
  * Single task (thread) execution context
  */
 typedef struct svm_task_t {
-  struct svm_task_t * next;     /** Next task (NULL if last) */
+  struct svm_task_t * next;     /** Next task in run queue (head, if last) */
+  struct svm_task_t * prev;     /** Previous task in run queue (tail, if first) */
+
+  uint32_t priority;            /** Priority level, run queue of task (0 - highest) */
+  uint64_t deadline;            /** VM cycle, task should be done by (0 - none), used in EDF mode */
+  uint64_t ready;               /** VM cycle, task became ready to run at */
+  uint64_t wake;                /** Time (ms), sleeping task wakes up at */
+  struct svm_task_t ** slot;    /** Timer wheel slot of sleeping task (NULL if task is ready) */
+
+  struct {
+    uint64_t cycles;            /** Cycles, task executed */
+    uint64_t waited;            /** Cycles, task was ready, but other tasks ran */
+    uint32_t dispatches;        /** Times, task was switched to */
+  } stats;
 
   struct __PACKED {
     bool eq       : 1;          /** Equality flag */
@@ -248,6 +295,17 @@ typedef struct svm_task_t {
   svm_i32_buffer_t call_stack;  /** Call Stack */
 } svm_task_t;
 
+/**
+ * Run queue of single priority level
+ *
+ * Tasks form a ring, linked both ways. Head is the next task to run
+ */
+typedef struct {
+  svm_task_t * head;
+  svm_task_t * tail;
+  uint32_t count;
+} svm_task_queue_t;
+
 /**
  * SVM Runtime Context
  */
@@ -255,15 +313,28 @@ typedef struct {
   struct __PACKED {
     bool running           : 1; /** Is VM running flag */
     bool task_switch_block : 1; /** Block task switching */
+    bool edf               : 1; /** Earliest deadline first within priority level */
   } flags;
 
   struct {
     svm_task_t * current;
-    svm_task_t * head;
+    svm_task_queue_t queue[SVM_TASK_PRIORITIES]; /** Run queue of each priority level */
+    uint32_t ready;             /** Bit of each non-empty run queue */
+    uint32_t count;             /** Count of tasks (ready & sleeping) */
+    uint32_t quantum;           /** Cycles per time slice (0 - no preemption) */
+    uint32_t slice;             /** Cycles, current task ran in its slice */
   } task;
 
+  uint64_t cycles;              /** Count of cycles, VM ran (clock of deadlines & task stats) */
+
+  svm_timer_t timer;            /** Sleeping tasks */
+
   svm_code_t * code;            /** Executable code context */
 
+#if USE_SVM_PROFILE
+  uint32_t * profile;           /** Execution count of each instruction, code->size long (may be NULL) */
+#endif
+
   void * ctx;                   /** User context for svm_sys_port */
 } svm_t;
 
@@ -304,16 +375,23 @@ svm_error_t svm_load(svm_t * vm, svm_code_t * code);
 /**
  * Unload instructions & tasks from VM
  *
+ * Removes every task and stops the VM
+ *
  * @param vm SVM Context
  *
  * @retval SVM_OK If operation completed successfully
- * TODO: describe retvals
+ * @retval SVM_ERR_NULL If pointer to vm is NULL
  */
 svm_error_t svm_unload(svm_t * vm);
 
 /**
  * Run VM for 1 cycle
  *
+ * Once current task used up its quantum, VM switches to the next task
+ * (unless task switching is blocked). Task, that executed END is removed,
+ * VM stops after the last one. If every task is asleep, host waits for
+ * the first one to wake up (svm_idle_handler) instead
+ *
  * @param vm SVM Context
  *
  * @retval SVM_OK If operation completed successfully
@@ -350,27 +428,121 @@ svm_error_t svm_task_deinit(svm_task_t * task);
 /**
  * Create task in VM context
  *
+ * Task gets SVM_TASK_PRIORITY_DEFAULT and is appended to the tail of its
+ * run queue in O(1)
+ *
  * @param vm SVM instance
  * @param pc PC where task should start it's execution
  * @param registers Registers state that task is expecting at start
+ * @param task Will contain created task (may be NULL)
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm or registers is NULL
+ * @retval SVM_ERR_BAD_ALLOC If allocation failed
  */
-svm_error_t svm_task_create(svm_t * vm, uint32_t pc, int32_t (*registers)[R_MAX]);
+svm_error_t svm_task_create(svm_t * vm, uint32_t pc, int32_t (*registers)[R_MAX], svm_task_t ** task);
 
 /**
  * Remove task from VM context
  *
+ * Task is unlinked from run queue in O(1) and released. If task is the
+ * current one, the next task is dispatched right away
+ *
  * @param vm SVM instance
- * @param task Task instance to be removed
+ * @param task Task instance to be removed (created by svm_task_create)
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm or task is NULL
+ * @retval SVM_ERR_TASK_NOT_FOUND If task isn't in run queue
  */
 svm_error_t svm_task_remove(svm_t * vm, svm_task_t * task);
 
 /**
  * Perform task switch
  *
+ * Dispatches head of the highest priority non-empty run queue (task with
+ * the earliest deadline in EDF mode), so a task of higher priority, than
+ * the current one runs at most one quantum after becoming ready. Lower
+ * priorities run only, while higher ones are empty
+ *
  * @param vm SVM instance
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm is NULL
+ * @retval SVM_ERR_TASK_SWITCH_BLOCKED If task switching is blocked
  */
 svm_error_t svm_task_switch(svm_t * vm);
 
+/**
+ * Set count of cycles, task runs before being preempted
+ *
+ * @param vm SVM instance
+ * @param quantum Cycles per time slice (0 disables preemption)
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm is NULL
+ */
+svm_error_t svm_task_quantum(svm_t * vm, uint32_t quantum);
+
+/**
+ * Put task to sleep
+ *
+ * Task leaves run queue for the timer wheel and other tasks keep running.
+ * Woken up tasks are returned to the tail of their run queues at the next
+ * task switch. Sleeping current task dispatches the next one right away
+ * (releasing task switching block, it held)
+ *
+ * @param vm SVM instance
+ * @param task Task instance (ready or sleeping)
+ * @param ms Time to sleep in milliseconds (0 just yields)
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm or task is NULL
+ * @retval SVM_ERR_TASK_NOT_FOUND If task isn't in the VM
+ */
+svm_error_t svm_task_sleep(svm_t * vm, svm_task_t * task, uint32_t ms);
+
+/**
+ * Move task to run queue of other priority level
+ *
+ * @param vm SVM instance
+ * @param task Task instance
+ * @param priority Priority level (0 - highest)
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm or task is NULL
+ * @retval SVM_ERR_TASK_NOT_FOUND If task isn't in run queue
+ * @retval SVM_ERR_BAD_PRIORITY If priority is not below SVM_TASK_PRIORITIES
+ */
+svm_error_t svm_task_priority(svm_t * vm, svm_task_t * task, uint32_t priority);
+
+/**
+ * Set deadline of task
+ *
+ * @param vm SVM instance
+ * @param task Task instance
+ * @param cycles Count of cycles from now, task should be done in (0 - no deadline)
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm or task is NULL
+ */
+svm_error_t svm_task_deadline(svm_t * vm, svm_task_t * task, uint32_t cycles);
+
+/**
+ * Enable/Disable earliest deadline first dispatch
+ *
+ * In EDF mode task with the earliest deadline in the highest priority
+ * non-empty run queue is dispatched (O(n) in length of that queue).
+ * Tasks without deadline go after ones with it, in round robin order
+ *
+ * @param vm SVM instance
+ * @param edf EDF mode state
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to vm is NULL
+ */
+svm_error_t svm_task_edf(svm_t * vm, bool edf);
+
 /**
  * Block/Unblock task switching
  *
@@ -452,6 +624,27 @@ void * svm_realloc(void * buffer, size_t size);
  */
 void svm_sys_handler(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num);
 
+/**
+ * Port for monotonic time, sleeping tasks are woken up by
+ *
+ * @note Uses CLOCK_MONOTONIC by default
+ *
+ * @param ctx User context
+ *
+ * @returns Time in milliseconds
+ */
+uint64_t svm_time_handler(void * ctx);
+
+/**
+ * Port for idling host, while every task is asleep
+ *
+ * @note Calls nanosleep by default
+ *
+ * @param ctx User context
+ * @param ms Time in milliseconds until the next timer event
+ */
+void svm_idle_handler(void * ctx, uint32_t ms);
+
 #ifdef __cplusplus
 }
 #endif
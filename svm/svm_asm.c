@@ -13,8 +13,56 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#if USE_SVM_ASM_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if USE_SVM_ASM_PARALLEL
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 /* Defines ================================================================== */
+/**
+ * Max nesting of parentheses & unary operators in expression
+ */
+#define SVM_ASM_EXPR_MAX_DEPTH 64
+
 /* Macros =================================================================== */
+/**
+ * Encodes link of fixup chain, stored in code word of unresolved reference
+ *
+ * Word holds location of the previous unresolved reference to the same
+ * label (-1 for none) and whether this one is relative
+ */
+#define SVM_ASM_FIXUP_LINK(next, relative) \
+  ((int32_t) (((uint32_t) ((next) + 1) << 1) | ((relative) ? 1u : 0u)))
+
+/**
+ * Location of the previous reference in fixup chain (-1 for none)
+ */
+#define SVM_ASM_FIXUP_NEXT(word) ((int32_t) ((uint32_t) (word) >> 1) - 1)
+
+/**
+ * Checks if reference in fixup chain is relative
+ */
+#define SVM_ASM_FIXUP_RELATIVE(word) (((uint32_t) (word) & 1u) != 0)
+
+/**
+ * Makes sure buffer of context fits count items, growing it geometrically
+ */
+#define SVM_ASM_RESERVE(ctx, array, count)                                            \
+  do {                                                                                \
+    if ((uint32_t) (count) > (array).capacity) {                                      \
+      (array).capacity = svm_grow_capacity((array).capacity, (count));                \
+      SVM_REALLOC_CHECK((array).buffer, (array).capacity * sizeof((array).buffer[0])); \
+      (ctx)->reallocs++;                                                              \
+    }                                                                                 \
+  } while (0)
+
 /* Exposed macros =========================================================== */
 /* Enums ==================================================================== */
 typedef enum {
@@ -22,9 +70,85 @@ typedef enum {
   SVM_ASM_ARGC_ALL,
   SVM_ASM_ARGC_REG_ONLY,
   SVM_ASM_ARGC_IMM_ONLY,
+  SVM_ASM_ARGC_REG_OPTIONAL,
 } svm_asm_arg_constraint_t;
 
+typedef enum {
+  SVM_ASM_DIRECTIVE_NONE = 0,
+  SVM_ASM_DIRECTIVE_CONST,    /** .const NAME EXPR */
+  SVM_ASM_DIRECTIVE_WORD,     /** .word EXPR... */
+  SVM_ASM_DIRECTIVE_DATA,     /** .data COUNT [EXPR] */
+} svm_asm_directive_t;
+
 /* Types ==================================================================== */
+/**
+ * Token - slice of source
+ */
+typedef struct {
+  const char * str;   /** Start of token in source (NULL if there was none) */
+  uint32_t length;
+  uint32_t line;      /** Line, token starts at */
+} svm_asm_token_t;
+
+/**
+ * Tokenizer state, can be copied to roll back
+ */
+typedef struct {
+  const char * pos;
+  const char * end;
+  uint32_t line;
+  bool final;         /** End of buffer is end of source, otherwise more may follow */
+  bool starved;       /** Reached end of non-final buffer, token may be incomplete */
+} svm_asm_lexer_t;
+
+#if USE_SVM_ASM_PARALLEL
+/**
+ * Part of source, assembled by a separate thread
+ */
+typedef struct {
+  svm_asm_t ctx;        /** Code, lines & references of the part (relative to its start) */
+  const char * begin;   /** Start of part (start of line) */
+  const char * limit;   /** Start of the next part, statements starting there belong to it */
+  const char * end;     /** End of source */
+  const char * first;   /** First token of the part */
+  const char * stop;    /** First token, that wasn't assembled */
+  uint32_t lines;       /** Count of lines between begin & limit */
+  svm_asm_error_t res;
+  pthread_t thread;
+  bool started;         /** Part is assembled by its own thread */
+} svm_asm_part_t;
+#endif
+
+/**
+ * Value of expression - constant part, and label, whose location is added to it
+ */
+typedef struct {
+  int32_t value;
+  const char * label; /** Label name in source (NULL if there is none) */
+  uint32_t length;
+  uint32_t hash;      /** Hash of label name */
+} svm_asm_value_t;
+
+/**
+ * Expression parser state
+ */
+typedef struct {
+  const svm_asm_t * ctx;
+  const char * pos;
+  const char * end;
+  uint32_t depth;     /** Current nesting */
+  const char * error; /** Why expression couldn't be evaluated (NULL if it could) */
+} svm_asm_expr_t;
+
+/**
+ * Undefined label, as reported
+ */
+typedef struct {
+  const char * name;
+  int32_t first;      /** Location of the first reference */
+  uint32_t count;     /** Count of references */
+} svm_asm_undefined_t;
+
 typedef struct {
   uint8_t arg_count;
   svm_asm_arg_constraint_t arg1_restrict;
@@ -36,6 +160,8 @@ svm_asm_opcode_meta_t opcode_meta[] = {
     [OP_NOP] = {0, SVM_ASM_ARGC_NONE, SVM_ASM_ARGC_NONE},
     [OP_END] = {0, SVM_ASM_ARGC_NONE, SVM_ASM_ARGC_NONE},
     [OP_MOV] = {2, SVM_ASM_ARGC_ALL,  SVM_ASM_ARGC_ALL},
+    [OP_PUSH] = {2, SVM_ASM_ARGC_ALL, SVM_ASM_ARGC_REG_OPTIONAL},
+    [OP_POP] = {2, SVM_ASM_ARGC_REG_ONLY, SVM_ASM_ARGC_REG_OPTIONAL},
     [OP_ADD] = {2, SVM_ASM_ARGC_ALL,  SVM_ASM_ARGC_ALL},
     [OP_SUB] = {2, SVM_ASM_ARGC_ALL,  SVM_ASM_ARGC_ALL},
     [OP_MUL] = {2, SVM_ASM_ARGC_ALL,  SVM_ASM_ARGC_ALL},
@@ -60,6 +186,7 @@ static const char * svm_asm_constraint2errstr(svm_asm_arg_constraint_t constrain
     case SVM_ASM_ARGC_ALL:      return "can be anything, but not empty";
     case SVM_ASM_ARGC_REG_ONLY: return "can only be a register";
     case SVM_ASM_ARGC_IMM_ONLY: return "can only be immediate";
+    case SVM_ASM_ARGC_REG_OPTIONAL: return "can only be a register, or empty";
     default:
       return "<INVALID CONSTRAINT>";
   }
@@ -75,6 +202,8 @@ static bool svm_asm_check_constraint(svm_asm_arg_constraint_t constraint, svm_ar
     return true;
   } else if (arg != ARG_NONE && constraint == SVM_ASM_ARGC_ALL) {
     return true;
+  } else if (((arg >= ARG_R0 && arg <= ARG_R15) || arg == ARG_NONE) && constraint == SVM_ASM_ARGC_REG_OPTIONAL) {
+    return true;
   } else {
     return false;
   }
@@ -83,290 +212,1170 @@ static bool svm_asm_check_constraint(svm_asm_arg_constraint_t constraint, svm_ar
 static void svm_asm_push_i32(svm_asm_t * ctx, int32_t i32) {
   SVM_ASSERT_RETURN(ctx);
 
-  if (ctx->code.size + 1 >= ctx->code.capacity) {
-    ctx->code.capacity += 32;
-    SVM_REALLOC_CHECK(ctx->code.buffer, ctx->code.capacity * sizeof(typeof(ctx->code.buffer[0])));
-  }
+  SVM_ASM_RESERVE(ctx, ctx->code, ctx->code.size + 1);
   ctx->code.buffer[ctx->code.size++] = i32;
 }
 
-static void svm_asm_add_label(svm_asm_t * ctx, const char * name, int32_t location) {
-  SVM_ASSERT_RETURN(ctx && name);
+static uint32_t svm_asm_hash(const char * name, uint32_t length) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
 
-  if (ctx->labels.size + 1 >= ctx->labels.capacity) {
-    ctx->labels.capacity += 8;
-    SVM_REALLOC_CHECK(ctx->labels.buffer, ctx->labels.capacity * sizeof(ctx->labels.buffer[0]));
+  for (uint32_t i = 0; i < length; ++i) {
+    hash = (hash ^ (uint8_t) name[i]) * 16777619u;
   }
-  strcpy(ctx->labels.buffer[ctx->labels.size].name, name);
-  ctx->labels.buffer[ctx->labels.size].location = location;
-  ctx->labels.size++;
+
+  return hash;
 }
 
-static int32_t svm_asm_find_label(svm_asm_t * ctx, const char * name) {
-  SVM_ASSERT_RETURN(ctx && name, -1);
+/**
+ * Allocates memory from arena of context
+ *
+ * @note Memory is released all at once by svm_asm_free
+ */
+static void * svm_asm_arena_alloc(svm_asm_t * ctx, uint32_t size, uint32_t align) {
+  uint32_t offset = ctx->arena ? (ctx->arena->size + align - 1) & ~(align - 1) : 0;
+
+  if (!ctx->arena || offset + size > ctx->arena->capacity) {
+    // Blocks double, so their count stays logarithmic
+    uint32_t capacity = ctx->arena ? ctx->arena->capacity * 2 : SVM_ASM_ARENA_BLOCK_SIZE;
+
+    if (capacity < size) {
+      capacity = size;
+    }
+
+    svm_asm_arena_block_t * block = svm_malloc(sizeof(svm_asm_arena_block_t) + capacity);
 
-  for (uint32_t i = 0; i < ctx->labels.size; ++i) {
-    if (!strcmp(name, ctx->labels.buffer[i].name)) {
-      return ctx->labels.buffer[i].location;
+    if (!block) {
+      printf("FATAL: Allocation failed (%s:%d)", __FUNCTION__, __LINE__);
+      abort();
     }
+
+    block->next = ctx->arena;
+    block->capacity = capacity;
+    block->size = 0;
+    ctx->arena = block;
+    offset = 0;
   }
-  return -1;
+
+  ctx->arena->size = offset + size;
+
+  return &ctx->arena->buffer[offset];
+}
+
+static const char * svm_asm_names_store(svm_asm_t * ctx, const char * name, uint32_t length) {
+  char * stored = svm_asm_arena_alloc(ctx, length + 1, 1);
+
+  memcpy(stored, name, length);
+  stored[length] = '\0';
+
+  return stored;
 }
 
-static void svm_asm_add_patch_label(svm_asm_t * ctx, const char * name, int32_t location) {
-  SVM_ASSERT_RETURN(ctx && name);
+/**
+ * Finds slot of name in symbol table (empty slot, if name isn't there)
+ */
+static svm_asm_symbol_t * svm_asm_symbol_slot(const svm_asm_t * ctx, const char * name, uint32_t length, uint32_t hash) {
+  uint32_t mask = ctx->symbols.capacity - 1;
+
+  for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+    svm_asm_symbol_t * slot = &ctx->symbols.buffer[i];
 
-  if (ctx->patches.size + 1 >= ctx->patches.capacity) {
-    ctx->patches.capacity += 8;
-    SVM_REALLOC_CHECK(ctx->patches.buffer, ctx->patches.capacity);
+    if (!slot->name || (slot->hash == hash && !strncmp(slot->name, name, length) && !slot->name[length])) {
+      return slot;
+    }
   }
-  strcpy(ctx->patches.buffer[ctx->patches.size].name, name);
-  ctx->patches.buffer[ctx->patches.size].location = location;
-  ctx->patches.size++;
 }
 
-static svm_asm_error_t svm_asm_patch_labels(svm_asm_t * ctx) {
-  SVM_ASSERT_RETURN(ctx, SVM_ASM_ERR_NULL);
+/**
+ * Doubles symbol table
+ */
+static void svm_asm_symbols_grow(svm_asm_t * ctx) {
+  svm_asm_symbol_t * old = ctx->symbols.buffer;
+  uint32_t old_capacity = ctx->symbols.capacity;
+
+  ctx->symbols.capacity = old_capacity ? old_capacity * 2 : SVM_ASM_SYMBOLS_INITIAL;
+  ctx->symbols.buffer = svm_malloc(ctx->symbols.capacity * sizeof(svm_asm_symbol_t));
+
+  if (!ctx->symbols.buffer) {
+    printf("FATAL: Allocation failed (%s:%d)", __FUNCTION__, __LINE__);
+    abort();
+  }
+
+  memset(ctx->symbols.buffer, 0, ctx->symbols.capacity * sizeof(svm_asm_symbol_t));
 
-  for (int32_t i = 0; i < ctx->patches.size; ++i) {
-    printf("try patch %s at 0x%x\n",
-           ctx->patches.buffer[i].name, ctx->patches.buffer[i].location);
-    int32_t value = svm_asm_find_label(ctx, ctx->patches.buffer[i].name);
-    if (value == -1) {
-      printf(
-          "Undefined label '%s' referenced at 0x%x\n",
-          ctx->patches.buffer[i].name,
-          ctx->patches.buffer[i].location
-      );
-      return SVM_ASM_ERR_UNDEFINED_LABEL;
+  for (uint32_t i = 0; i < old_capacity; ++i) {
+    if (old[i].name) {
+      *svm_asm_symbol_slot(ctx, old[i].name, strlen(old[i].name), old[i].hash) = old[i];
     }
-    printf("patch %s at 0x%x with 0x%x\n",
-           ctx->patches.buffer[i].name, ctx->patches.buffer[i].location, value);
-    ctx->code.buffer[ctx->patches.buffer[i].location] = value;
   }
 
-  return SVM_ASM_OK;
+  if (old) {
+    svm_free(old);
+  }
 }
 
-static char * svm_asm_next_token(char ** source, char * source_end) {
-  SVM_ASSERT_RETURN(source && *source && source_end, NULL);
-
-  if (*source >= source_end) {
-    return NULL;
+/**
+ * Looks symbol up by precomputed hash, adding it (with interned name) if
+ * it wasn't there
+ *
+ * @note Pointer is valid until the next call
+ */
+static svm_asm_symbol_t * svm_asm_intern_hashed(svm_asm_t * ctx, const char * name, uint32_t length, uint32_t hash) {
+  // Keep load factor under 3/4
+  if ((ctx->symbols.size + 1) * 4 > ctx->symbols.capacity * 3) {
+    svm_asm_symbols_grow(ctx);
   }
 
-  while (**source == ' ' || **source == '\n') {
-    (*source)++;
+  svm_asm_symbol_t * symbol = svm_asm_symbol_slot(ctx, name, length, hash);
+
+  if (!symbol->name) {
+    symbol->name = svm_asm_names_store(ctx, name, length);
+    symbol->hash = hash;
+    symbol->location = -1;
+    symbol->fixups = -1;
+    ctx->symbols.size++;
   }
 
-  if (**source == '#') {
-    while (**source != '\n' || **source != '\0') {
-      (*source)++;
+  return symbol;
+}
+
+/**
+ * Looks symbol up, adding it (with interned name) if it wasn't there
+ *
+ * @note Pointer is valid until the next call
+ */
+static svm_asm_symbol_t * svm_asm_intern(svm_asm_t * ctx, const char * name, uint32_t length) {
+  return svm_asm_intern_hashed(ctx, name, length, svm_asm_hash(name, length));
+}
+
+/**
+ * Returns addend of reference at location (0 if it has none)
+ */
+static int32_t svm_asm_addend(const svm_asm_t * ctx, uint32_t location) {
+  uint32_t lo = 0, hi = ctx->addends.size;
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (ctx->addends.buffer[mid].location < location) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
   }
 
-  char * token = *source;
+  return lo < ctx->addends.size && ctx->addends.buffer[lo].location == location ? ctx->addends.buffer[lo].addend : 0;
+}
+
+/**
+ * Patches all references, made before symbol was defined
+ */
+static void svm_asm_resolve_fixups(svm_asm_t * ctx, svm_asm_symbol_t * symbol) {
+  for (int32_t location = symbol->fixups; location != -1; ) {
+    int32_t link = ctx->code.buffer[location];
+    int32_t target = symbol->location + svm_asm_addend(ctx, location);
 
-  while (**source != ' ' && **source != '\n' && **source != '.' && **source != '\0') {
-    (*source)++;
+    ctx->code.buffer[location] = SVM_ASM_FIXUP_RELATIVE(link) ? target - location : target;
+    location = SVM_ASM_FIXUP_NEXT(link);
   }
 
-  **source = '\0';
-  (*source)++;
+  symbol->fixups = -1;
+}
 
-#if USE_SVM_ASM_PRINT_TOKENS
-  printf("token '%s'\n", token);
-#endif
+static svm_asm_error_t svm_asm_add_label(svm_asm_t * ctx, const char * name, uint32_t length, int32_t location) {
+  SVM_ASSERT_RETURN(ctx && name, SVM_ASM_ERR_NULL);
+
+  SVM_ASM_RESERVE(ctx, ctx->labels, ctx->labels.size + 1);
+
+  svm_asm_symbol_t * symbol = svm_asm_intern(ctx, name, length);
+
+  if (symbol->constant) {
+    printf("Label '%s' is already defined as constant\n", symbol->name);
+    return SVM_ASM_ERR_BAD_DIRECTIVE;
+  }
+
+  // First definition wins (references in parts are resolved on merge)
+  if (symbol->location == -1) {
+    symbol->location = location;
+
+    if (!ctx->part) {
+      svm_asm_resolve_fixups(ctx, symbol);
+    }
+  }
+
+  ctx->labels.buffer[ctx->labels.size].name = symbol->name;
+  ctx->labels.buffer[ctx->labels.size].location = location;
+  ctx->labels.size++;
 
-  return token;
+  return SVM_ASM_OK;
 }
 
-static void svm_asm_rollback_token(char * token, char ** source) {
-  SVM_ASSERT_RETURN(token && source && *source);
+static void svm_asm_add_reloc(svm_asm_t * ctx, uint32_t location) {
+  SVM_ASSERT_RETURN(ctx);
 
-  (*source)[-1] = ' ';
-  *source = token;
+  SVM_ASM_RESERVE(ctx, ctx->relocs, ctx->relocs.size + 1);
+  ctx->relocs.buffer[ctx->relocs.size++] = location;
+}
 
-#if USE_SVM_ASM_PRINT_TOKENS
-  printf("token rollback\n");
-#endif
+static void svm_asm_push_label_ref(svm_asm_t * ctx, const svm_asm_value_t * ref, bool relative) {
+  SVM_ASSERT_RETURN(ctx && ref);
+
+  int32_t location = ctx->code.size;
+
+  svm_asm_add_reloc(ctx, location);
+
+  svm_asm_symbol_t * symbol = svm_asm_intern_hashed(ctx, ref->label, ref->length, ref->hash);
+  int32_t value = symbol->location;
+
+  if (value == -1 || ctx->part) {
+    // Reference becomes the head of label's fixup chain, offset is kept aside
+    value = SVM_ASM_FIXUP_LINK(symbol->fixups, relative);
+    symbol->fixups = location;
+
+    if (ref->value) {
+      SVM_ASM_RESERVE(ctx, ctx->addends, ctx->addends.size + 1);
+      ctx->addends.buffer[ctx->addends.size].location = location;
+      ctx->addends.buffer[ctx->addends.size].addend = ref->value;
+      ctx->addends.size++;
+    }
+  } else {
+    value += ref->value;
+
+    if (relative) {
+      value -= location;
+    }
+  }
+
+  svm_asm_push_i32(ctx, value);
 }
 
-/* Shared functions ========================================================= */
-svm_asm_error_t svm_asm_init(svm_asm_t * ctx) {
+/**
+ * Emits value of expression (as label reference, if it has label)
+ */
+static void svm_asm_push_value(svm_asm_t * ctx, const svm_asm_value_t * value, bool relative) {
+  if (value->label) {
+    svm_asm_push_label_ref(ctx, value, relative);
+  } else {
+    svm_asm_push_i32(ctx, value->value);
+  }
+}
+
+static int svm_asm_undefined_compare(const void * a, const void * b) {
+  int32_t lhs = ((const svm_asm_undefined_t *) a)->first;
+  int32_t rhs = ((const svm_asm_undefined_t *) b)->first;
+
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/**
+ * Reports labels, that were referenced, but never defined, in order of
+ * their first reference
+ */
+static svm_asm_error_t svm_asm_check_undefined(svm_asm_t * ctx) {
   SVM_ASSERT_RETURN(ctx, SVM_ASM_ERR_NULL);
 
-  memset(ctx, 0, sizeof(*ctx));
+  uint32_t size = 0;
 
-  ctx->code.capacity = 32;
-  ctx->code.buffer = svm_malloc(ctx->code.capacity * sizeof(typeof(ctx->code.buffer[0])));
+  for (uint32_t i = 0; i < ctx->symbols.capacity; ++i) {
+    size += ctx->symbols.buffer[i].name && ctx->symbols.buffer[i].fixups != -1;
+  }
 
-  if (!ctx->code.buffer) {
-    printf("Failed to allocate buffer for bytecode\n");
-    return SVM_ASM_ERR_BAD_ALLOC;
+  if (!size) {
+    return SVM_ASM_OK;
   }
 
-  ctx->labels.capacity = 8;
-  ctx->labels.buffer = svm_malloc(ctx->labels.capacity);
+  svm_asm_undefined_t * undefined = svm_asm_arena_alloc(ctx, size * sizeof(svm_asm_undefined_t), _Alignof(svm_asm_undefined_t));
 
-  if (!ctx->labels.buffer) {
-    printf("Failed to allocate buffer for labels\n");
-    return SVM_ASM_ERR_BAD_ALLOC;
+  size = 0;
+
+  for (uint32_t i = 0; i < ctx->symbols.capacity; ++i) {
+    const svm_asm_symbol_t * symbol = &ctx->symbols.buffer[i];
+
+    if (!symbol->name || symbol->fixups == -1) {
+      continue;
+    }
+
+    // Chain goes from the last reference to the first one
+    svm_asm_undefined_t * entry = &undefined[size++];
+
+    entry->name = symbol->name;
+    entry->first = symbol->fixups;
+    entry->count = 1;
+
+    for (int32_t next; (next = SVM_ASM_FIXUP_NEXT(ctx->code.buffer[entry->first])) != -1; entry->first = next) {
+      entry->count++;
+    }
   }
 
-  return SVM_ASM_OK;
+  qsort(undefined, size, sizeof(undefined[0]), svm_asm_undefined_compare);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    printf("Undefined label '%s' referenced at 0x%x (%u reference%s)\n", undefined[i].name, undefined[i].first, undefined[i].count, undefined[i].count > 1 ? "s" : "");
+  }
+
+  return SVM_ASM_ERR_UNDEFINED_LABEL;
 }
 
-svm_asm_error_t svm_asm_free(svm_asm_t * ctx) {
-  if (ctx->code.buffer) {
-    svm_free(ctx->code.buffer);
+static bool svm_asm_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * Reads next token, skipping whitespace & comments. Source isn't modified
+ *
+ * Token ends at whitespace, comment or '.', that separates extension
+ * (jmp.eq), the dot itself is skipped
+ *
+ * If buffer isn't final, token touching its end may continue in the next
+ * chunk, so it isn't returned and lexer is marked as starved
+ *
+ * @retval true if token was read
+ */
+static bool svm_asm_next_token(svm_asm_lexer_t * lexer, svm_asm_token_t * token) {
+  SVM_ASSERT_RETURN(lexer && token, false);
+
+  token->str = NULL;
+  token->length = 0;
+
+  for (;;) {
+    while (lexer->pos < lexer->end && svm_asm_is_space(*lexer->pos)) {
+      lexer->line += *lexer->pos == '\n';
+      lexer->pos++;
+    }
+
+    if (lexer->pos >= lexer->end || *lexer->pos != '#') {
+      break;
+    }
+
+    while (lexer->pos < lexer->end && *lexer->pos != '\n') {
+      lexer->pos++;
+    }
   }
 
-  if (ctx->labels.buffer) {
-    svm_free(ctx->labels.buffer);
+  if (lexer->pos >= lexer->end) {
+    lexer->starved = !lexer->final;
+    return false;
   }
 
-  if (ctx->patches.buffer) {
-    svm_free(ctx->patches.buffer);
+  const char * start = lexer->pos++;
+
+  while (lexer->pos < lexer->end && !svm_asm_is_space(*lexer->pos) && *lexer->pos != '#' && *lexer->pos != '.') {
+    lexer->pos++;
   }
 
-  return SVM_ASM_OK;
+  if (lexer->pos >= lexer->end && !lexer->final) {
+    lexer->starved = true;
+    return false;
+  }
+
+  token->str = start;
+  token->length = lexer->pos - start;
+  token->line = lexer->line;
+
+  if (lexer->pos < lexer->end && *lexer->pos == '.') {
+    lexer->pos++;
+  }
+
+#if USE_SVM_ASM_PRINT_TOKENS
+  printf("token '%.*s'\n", token->length, token->str);
+#endif
+
+  return true;
 }
 
-svm_asm_error_t svm_asm(svm_asm_t * ctx, char * source) {
-  size_t source_size = strlen(source);
-  char * source_end = source + source_size;
+static bool svm_asm_is_operator(char c) {
+  switch (c) {
+    case '+': case '-': case '*': case '/': case '%':
+    case '&': case '|': case '^': case '~':
+    case '<': case '>': case '(': case ')':
+      return true;
 
-  while (*source) {
-    if (*source == '#') {
-      while (*source != '\n' && *source != '\0') {
-        source++;
+    default:
+      return false;
+  }
+}
 
-        if (source >= source_end) {
-          // TODO: Is this semantically correct error to return?
-          return SVM_ASM_ERR_EXPECTED_TOKEN;
-        }
-      }
-    }
-    
-    svm_opcode_t op;
-    svm_ext_t ext;
-    svm_arg_type_t arg1 = ARG_NONE, arg2 = ARG_NONE;
-    char * op_str, * ext_str, * arg1_str, * arg2_str;
+/**
+ * Records the first error of expression
+ *
+ * @retval false Always, so it can be returned right away
+ */
+static bool svm_asm_expr_fail(svm_asm_expr_t * expr, const char * error) {
+  if (!expr->error) {
+    expr->error = error;
+  }
+
+  return false;
+}
+
+/**
+ * Returns precedence of binary operator at parser position (0 if there is none)
+ */
+static uint32_t svm_asm_expr_precedence(const svm_asm_expr_t * expr, uint32_t * length) {
+  if (expr->pos >= expr->end) {
+    return 0;
+  }
 
-    SVM_ASSERT_RETURN(op_str = svm_asm_next_token(&source, source_end), SVM_ASM_OK);
+  *length = 1;
 
-    op = svm_str2opcode(op_str);
+  switch (*expr->pos) {
+    case '|': return 1;
+    case '^': return 2;
+    case '&': return 3;
 
-    if (op == OP_MAX) {
-      svm_asm_add_label(ctx, op_str, ctx->code.size);
-      continue;
+    case '<':
+    case '>':
+      *length = 2;
+      return expr->pos + 1 < expr->end && expr->pos[1] == expr->pos[0] ? 4 : 0;
+
+    case '+':
+    case '-': return 5;
+
+    case '*':
+    case '/':
+    case '%': return 6;
+
+    default:  return 0;
+  }
+}
+
+/**
+ * Applies binary operator, label may only be offset
+ */
+static bool svm_asm_expr_apply(svm_asm_expr_t * expr, char op, svm_asm_value_t * lhs, const svm_asm_value_t * rhs) {
+  uint32_t a = lhs->value, b = rhs->value;
+
+  if (op == '+') {
+    SVM_ASSERT_RETURN(!lhs->label || !rhs->label, svm_asm_expr_fail(expr, "only one label may be used"));
+
+    if (rhs->label) {
+      lhs->label = rhs->label;
+      lhs->length = rhs->length;
+      lhs->hash = rhs->hash;
     }
 
-    ext_str = svm_asm_next_token(&source, source_end);
-    ext = svm_str2ext(ext_str);
+    lhs->value = (int32_t) (a + b);
+    return true;
+  }
 
-    // TODO: Document
-    if (ext != EXT_NONE) {
-      if (opcode_meta[op].arg_count > 0) {
-        SVM_ASSERT_RETURN(arg1_str = svm_asm_next_token(&source, source_end), SVM_ASM_ERR_EXPECTED_TOKEN);
-      }
-    } else {
-      if (opcode_meta[op].arg_count == 0) {
-        svm_asm_rollback_token(ext_str, &source);
+  if (op == '-') {
+    SVM_ASSERT_RETURN(!rhs->label, svm_asm_expr_fail(expr, "label can't be subtracted"));
+
+    lhs->value = (int32_t) (a - b);
+    return true;
+  }
+
+  SVM_ASSERT_RETURN(!lhs->label && !rhs->label, svm_asm_expr_fail(expr, "label can only be offset with + or -"));
+
+  switch (op) {
+    case '*':
+      lhs->value = (int32_t) (a * b);
+      break;
+
+    case '/':
+    case '%':
+      SVM_ASSERT_RETURN(rhs->value, svm_asm_expr_fail(expr, "division by zero"));
+
+      if (lhs->value == INT32_MIN && rhs->value == -1) {
+        lhs->value = op == '/' ? INT32_MIN : 0;
       } else {
-        arg1_str = ext_str;
+        lhs->value = op == '/' ? lhs->value / rhs->value : lhs->value % rhs->value;
       }
-    }
+      break;
+
+    case '<':
+    case '>':
+      SVM_ASSERT_RETURN(rhs->value >= 0 && rhs->value <= 31, svm_asm_expr_fail(expr, "shift out of range"));
+
+      lhs->value = op == '<' ? (int32_t) (a << b) : lhs->value >> rhs->value;
+      break;
+
+    case '&':
+      lhs->value &= rhs->value;
+      break;
+
+    case '|':
+      lhs->value |= rhs->value;
+      break;
+
+    case '^':
+      lhs->value ^= rhs->value;
+      break;
+
+    default:
+      return svm_asm_expr_fail(expr, "unknown operator");
+  }
+
+  return true;
+}
+
+static bool svm_asm_expr_binary(svm_asm_expr_t * expr, uint32_t precedence, svm_asm_value_t * lhs);
+
+/**
+ * Parses number, name, parenthesized expression or unary operator
+ *
+ * Name of constant gives its value, any other name is a label
+ */
+static bool svm_asm_expr_primary(svm_asm_expr_t * expr, svm_asm_value_t * result) {
+  memset(result, 0, sizeof(*result));
+
+  SVM_ASSERT_RETURN(expr->pos < expr->end, svm_asm_expr_fail(expr, "operand expected"));
+  SVM_ASSERT_RETURN(expr->depth < SVM_ASM_EXPR_MAX_DEPTH, svm_asm_expr_fail(expr, "nested too deep"));
+
+  char c = *expr->pos;
+
+  if (c == '(' || c == '-' || c == '~' || c == '+') {
+    bool valid;
 
-    if (opcode_meta[op].arg_count > 0) {
-      arg1 = svm_str2arg(arg1_str);
-      if (!svm_asm_check_constraint(opcode_meta[op].arg1_restrict, arg1)) {
-        printf("First argument to %s %s\n", op_str, svm_asm_constraint2errstr(opcode_meta[op].arg1_restrict));
-        return SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED;
+    expr->pos++;
+    expr->depth++;
+
+    if (c == '(') {
+      valid = svm_asm_expr_primary(expr, result) && svm_asm_expr_binary(expr, 1, result);
+
+      if (valid && (expr->pos >= expr->end || *expr->pos != ')')) {
+        valid = svm_asm_expr_fail(expr, "')' expected");
       }
-    }
 
-    if (opcode_meta[op].arg_count > 1) {
-      SVM_ASSERT_RETURN(arg2_str = svm_asm_next_token(&source, source_end), SVM_ASM_ERR_EXPECTED_TOKEN);
-      arg2 = svm_str2arg(arg2_str);
-      if (!svm_asm_check_constraint(opcode_meta[op].arg2_restrict, arg2)) {
-        printf("Second argument to %s %s\n", op_str, svm_asm_constraint2errstr(opcode_meta[op].arg2_restrict));
-        return SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED;
+      if (valid) {
+        expr->pos++;
+      }
+    } else {
+      valid = svm_asm_expr_primary(expr, result);
+
+      if (valid && c != '+') {
+        SVM_ASSERT_RETURN(!result->label, svm_asm_expr_fail(expr, "label can only be offset with + or -"));
+        result->value = c == '-' ? (int32_t) -(uint32_t) result->value : ~result->value;
       }
     }
 
-    ext  = ext  == EXT_MAX ? EXT_NONE : ext;
-    arg1 = arg1 == ARG_MAX ? ARG_NONE : arg1;
-    arg2 = arg2 == ARG_MAX ? ARG_NONE : arg2;
+    expr->depth--;
 
-    svm_asm_push_i32(ctx, svm_instruction_to_int32(svm_pack_instruction(op, ext, arg1, arg2)));
+    return valid;
+  }
 
-    if (arg1 == ARG_IMM) {
-      int32_t value;
-      if (!svm_to_int32(arg1_str, &value)) {
-        value = svm_asm_find_label(ctx, arg1_str);
-        if (value == -1) {
-          svm_asm_add_patch_label(ctx, arg1_str, ctx->code.size);
-        }
-      }
-      svm_asm_push_i32(ctx, value);
+  const char * start = expr->pos;
+
+  while (expr->pos < expr->end && !svm_asm_is_operator(*expr->pos)) {
+    expr->pos++;
+  }
+
+  uint32_t length = expr->pos - start;
+
+  SVM_ASSERT_RETURN(length, svm_asm_expr_fail(expr, "operand expected"));
+
+  if (svm_strn_to_int32(start, length, &result->value)) {
+    return true;
+  }
+
+  SVM_ASSERT_RETURN(svm_strn2arg(start, length) == ARG_IMM, svm_asm_expr_fail(expr, "registers can't be used"));
+
+  uint32_t hash = svm_asm_hash(start, length);
+  // Most sources define no constants, so names skip the lookup
+  const svm_asm_symbol_t * symbol = expr->ctx->constants
+      ? svm_asm_symbol_slot(expr->ctx, start, length, hash)
+      : NULL;
+
+  if (symbol && symbol->name && symbol->constant) {
+    result->value = symbol->location;
+  } else {
+    result->label = start;
+    result->length = length;
+    result->hash = hash;
+  }
+
+  return true;
+}
+
+/**
+ * Applies binary operators of at least given precedence to lhs, left to right
+ */
+static bool svm_asm_expr_binary(svm_asm_expr_t * expr, uint32_t precedence, svm_asm_value_t * lhs) {
+  uint32_t length, current, next;
+
+  while ((current = svm_asm_expr_precedence(expr, &length)) >= precedence) {
+    char op = *expr->pos;
+    svm_asm_value_t rhs;
+
+    expr->pos += length;
+
+    SVM_ASSERT_RETURN(svm_asm_expr_primary(expr, &rhs), false);
+
+    // Operators, that bind tighter, apply to rhs first
+    while ((next = svm_asm_expr_precedence(expr, &length)) > current) {
+      SVM_ASSERT_RETURN(svm_asm_expr_binary(expr, next, &rhs), false);
     }
 
-    if (arg2 == ARG_IMM) {
-      int32_t value;
-      if (!svm_to_int32(arg2_str, &value)) {
-        value = svm_asm_find_label(ctx, arg2_str);
-        if (value == -1) {
-          svm_asm_add_patch_label(ctx, arg2_str, ctx->code.size);
-        }
-      }
-      svm_asm_push_i32(ctx, value);
+    SVM_ASSERT_RETURN(svm_asm_expr_apply(expr, op, lhs, &rhs), false);
+  }
+
+  return true;
+}
+
+/**
+ * Evaluates expression token, prints error (unless assembling a part)
+ */
+static svm_asm_error_t svm_asm_eval(const svm_asm_t * ctx, const svm_asm_token_t * token, svm_asm_value_t * result) {
+  svm_asm_expr_t expr = {.ctx = ctx, .pos = token->str, .end = token->str + token->length};
+
+  bool valid = svm_asm_expr_primary(&expr, result) && svm_asm_expr_binary(&expr, 1, result);
+
+  if (valid && expr.pos < expr.end) {
+    valid = svm_asm_expr_fail(&expr, "unexpected character");
+  }
+
+  if (!valid) {
+    if (!ctx->part) {
+      printf("Bad expression '%.*s' (line %u): %s\n", token->length, token->str, token->line, expr.error);
     }
+    return SVM_ASM_ERR_BAD_EXPRESSION;
   }
 
   return SVM_ASM_OK;
 }
 
-svm_asm_error_t svm_asm_file(svm_asm_t * ctx, const char * filename) {
-  SVM_ASSERT_RETURN(ctx && filename, SVM_ASM_ERR_NULL);
+/**
+ * Reserves code & line table for size bytes of source, so they don't
+ * have to grow while assembling
+ */
+static void svm_asm_presize(svm_asm_t * ctx, size_t size) {
+  size_t words = size / SVM_ASM_SOURCE_BYTES_PER_WORD;
 
-  FILE * file = fopen(filename, "r");
+  if (words > UINT32_MAX / sizeof(ctx->code.buffer[0])) {
+    return;
+  }
 
-  if (!file) {
-    printf("Failed to open %s\n", filename);
-    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  SVM_ASM_RESERVE(ctx, ctx->code, ctx->code.size + words);
+
+  // Usually ~1 byte of line table per instruction
+  svm_lines_reserve(&ctx->lines, ctx->lines.size + words);
+}
+
+static svm_asm_directive_t svm_asm_strn2directive(const char * str, uint32_t length) {
+  if (length == 6 && !memcmp(str, ".const", 6)) {
+    return SVM_ASM_DIRECTIVE_CONST;
+  } else if (length == 5 && !memcmp(str, ".word", 5)) {
+    return SVM_ASM_DIRECTIVE_WORD;
+  } else if (length == 5 && !memcmp(str, ".data", 5)) {
+    return SVM_ASM_DIRECTIVE_DATA;
+  } else {
+    return SVM_ASM_DIRECTIVE_NONE;
   }
+}
 
-  fseek(file, 0, SEEK_END);
-  uint32_t fsize = ftell(file);
-  fseek(file, 0, SEEK_SET);
+/**
+ * Defines constant (.const NAME EXPR)
+ */
+static svm_asm_error_t svm_asm_define_const(svm_asm_t * ctx, const svm_asm_token_t * name, const svm_asm_token_t * value_tok) {
+  // Parts can't see constants of each other, so those are left to a single pass
+  SVM_ASSERT_RETURN(!ctx->part, SVM_ASM_ERR_BAD_DIRECTIVE);
 
-  char * source = svm_malloc(fsize + 1);
-  fread(source, fsize, 1, file);
-  fclose(file);
+  bool plain = svm_strn2arg(name->str, name->length) == ARG_IMM && svm_strn2opcode(name->str, name->length) == OP_MAX;
+  int32_t number;
 
-  source[fsize] = 0;
+  for (uint32_t i = 0; plain && i < name->length; ++i) {
+    plain = !svm_asm_is_operator(name->str[i]);
+  }
 
-  svm_asm_init(ctx);
-  svm_asm_error_t res = svm_asm(ctx, source);
+  if (!plain || svm_strn_to_int32(name->str, name->length, &number)) {
+    printf("Bad constant name '%.*s' (line %u)\n", name->length, name->str, name->line);
+    return SVM_ASM_ERR_BAD_DIRECTIVE;
+  }
 
-  free(source);
+  svm_asm_value_t value;
+  SVM_ASM_ERROR_CHECK_RETURN(svm_asm_eval(ctx, value_tok, &value));
 
-  if (res != SVM_ASM_OK) {
-    return res;
+  if (value.label) {
+    printf("Constant '%.*s' can't depend on label '%.*s'\n", name->length, name->str, value.length, value.label);
+    return SVM_ASM_ERR_BAD_EXPRESSION;
   }
 
-  res = svm_asm_patch_labels(ctx);
+  svm_asm_symbol_t * symbol = svm_asm_intern(ctx, name->str, name->length);
 
-  if (res != SVM_ASM_OK) {
-    return res;
+  if (symbol->constant || symbol->location != -1 || symbol->fixups != -1) {
+    printf("'%s' is already defined or used as label (line %u)\n", symbol->name, name->line);
+    return SVM_ASM_ERR_BAD_DIRECTIVE;
   }
 
-#if USE_SVM_ASM_PRINT_DISASM
-  printf("Disassembly:\n");
-  svm_disassemble(ctx->code.buffer, ctx->code.size);
-#endif
+  symbol->constant = true;
+  ctx->constants++;
+  symbol->location = value.value;
+
+  return SVM_ASM_OK;
+}
+
+/**
+ * Assembles directive
+ *
+ * @note Same as with statements, nothing is emitted, if lexer got starved
+ *
+ * @param ctx Context
+ * @param lexer Tokenizer, positioned after op_tok
+ * @param op_tok Directive token
+ * @param directive Directive
+ */
+static svm_asm_error_t svm_asm_directive(
+    svm_asm_t * ctx,
+    svm_asm_lexer_t * lexer,
+    const svm_asm_token_t * op_tok,
+    svm_asm_directive_t directive
+) {
+  svm_asm_token_t first, token;
+  svm_asm_value_t value = {0};
+
+  if (!svm_asm_next_token(lexer, &first)) {
+    return lexer->starved ? SVM_ASM_OK : SVM_ASM_ERR_EXPECTED_TOKEN;
+  }
+
+  // Data starts on the line of directive
+  if (directive != SVM_ASM_DIRECTIVE_CONST && first.line != op_tok->line) {
+    return SVM_ASM_ERR_EXPECTED_TOKEN;
+  }
+
+  switch (directive) {
+    case SVM_ASM_DIRECTIVE_CONST:
+      if (!svm_asm_next_token(lexer, &token)) {
+        return lexer->starved ? SVM_ASM_OK : SVM_ASM_ERR_EXPECTED_TOKEN;
+      }
+
+      return svm_asm_define_const(ctx, &first, &token);
+
+    case SVM_ASM_DIRECTIVE_WORD: {
+      // Values run till the end of line, all of them have to be available
+      svm_asm_lexer_t values = *lexer;
+      svm_asm_lexer_t end = *lexer;
+      uint32_t count = 1;
+
+      while (svm_asm_next_token(&values, &token) && token.line == op_tok->line) {
+        end = values;
+        count++;
+      }
+
+      if (values.starved) {
+        lexer->starved = true;
+        return SVM_ASM_OK;
+      }
+
+      svm_lines_add(&ctx->lines, ctx->code.size, op_tok->line);
+      SVM_ASM_RESERVE(ctx, ctx->code, ctx->code.size + count);
+
+      for (token = first; ; ) {
+        SVM_ASM_ERROR_CHECK_RETURN(svm_asm_eval(ctx, &token, &value));
+        svm_asm_push_value(ctx, &value, false);
+        ctx->data++;
+
+        if (lexer->pos == end.pos) {
+          break;
+        }
+
+        svm_asm_next_token(lexer, &token);
+      }
+
+      return SVM_ASM_OK;
+    }
+
+    case SVM_ASM_DIRECTIVE_DATA: {
+      // Fill value is optional, and only taken from the same line
+      svm_asm_lexer_t before_value = *lexer;
+      bool present = svm_asm_next_token(lexer, &token);
+
+      if (lexer->starved) {
+        return SVM_ASM_OK;
+      }
+
+      if (!present || token.line != first.line) {
+        *lexer = before_value;
+        present = false;
+      }
+
+      svm_asm_value_t count;
+      SVM_ASM_ERROR_CHECK_RETURN(svm_asm_eval(ctx, &first, &count));
+
+      if (count.label || count.value < 0 || count.value > INT32_MAX - ctx->code.size) {
+        if (!ctx->part) {
+          printf("Bad .data size '%.*s' (line %u)\n", first.length, first.str, first.line);
+        }
+        return SVM_ASM_ERR_BAD_DIRECTIVE;
+      }
+
+      if (present) {
+        SVM_ASM_ERROR_CHECK_RETURN(svm_asm_eval(ctx, &token, &value));
+      }
+
+      if (!count.value) {
+        return SVM_ASM_OK;
+      }
+
+      svm_lines_add(&ctx->lines, ctx->code.size, op_tok->line);
+      SVM_ASM_RESERVE(ctx, ctx->code, ctx->code.size + count.value);
+
+      for (int32_t i = 0; i < count.value; ++i) {
+        svm_asm_push_value(ctx, &value, false);
+      }
+
+      ctx->data += count.value;
+
+      return SVM_ASM_OK;
+    }
+
+    default:
+      return SVM_ASM_ERR_BAD_DIRECTIVE;
+  }
+}
+
+/**
+ * Assembles single statement (label, directive or instruction)
+ *
+ * @note If lexer got starved, nothing is emitted and statement has to be
+ *       parsed again, once more input is available
+ *
+ * @param ctx Context
+ * @param lexer Tokenizer, positioned after op_tok
+ * @param op_tok First token of statement
+ */
+static svm_asm_error_t svm_asm_statement(svm_asm_t * ctx, svm_asm_lexer_t * lexer, const svm_asm_token_t * op_tok) {
+  svm_opcode_t op = svm_strn2opcode(op_tok->str, op_tok->length);
+  svm_ext_t ext = EXT_NONE;
+  svm_arg_type_t arg1 = ARG_NONE, arg2 = ARG_NONE;
+  svm_asm_token_t arg1_tok = {0}, arg2_tok = {0};
+
+  if (op == OP_MAX) {
+    svm_asm_directive_t directive = op_tok->str[0] == '.'
+        ? svm_asm_strn2directive(op_tok->str, op_tok->length)
+        : SVM_ASM_DIRECTIVE_NONE;
+
+    if (directive != SVM_ASM_DIRECTIVE_NONE) {
+      return svm_asm_directive(ctx, lexer, op_tok, directive);
+    }
+
+    return svm_asm_add_label(ctx, op_tok->str, op_tok->length, ctx->code.size);
+  }
+
+  // Extension is optional, without it the token is the first argument
+  // (or the next statement)
+  svm_asm_lexer_t before_ext = *lexer;
+  svm_asm_token_t ext_tok;
+
+  if (svm_asm_next_token(lexer, &ext_tok)) {
+    ext = svm_strn2ext(ext_tok.str, ext_tok.length);
+  } else if (lexer->starved) {
+    return SVM_ASM_OK;
+  }
+
+  if (ext != EXT_NONE) {
+    if (opcode_meta[op].arg_count > 0 && !svm_asm_next_token(lexer, &arg1_tok)) {
+      return lexer->starved ? SVM_ASM_OK : SVM_ASM_ERR_EXPECTED_TOKEN;
+    }
+  } else if (opcode_meta[op].arg_count == 0) {
+    *lexer = before_ext;
+  } else {
+    SVM_ASSERT_RETURN(ext_tok.str, SVM_ASM_ERR_EXPECTED_TOKEN);
+    arg1_tok = ext_tok;
+  }
+
+  if (opcode_meta[op].arg_count > 0) {
+    arg1 = svm_strn2arg(arg1_tok.str, arg1_tok.length);
+    if (!svm_asm_check_constraint(opcode_meta[op].arg1_restrict, arg1)) {
+      // Part of source is assembled again on failure, error is reported then
+      if (!ctx->part) {
+        printf("First argument to %.*s %s\n", op_tok->length, op_tok->str, svm_asm_constraint2errstr(opcode_meta[op].arg1_restrict));
+      }
+      return SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED;
+    }
+  }
+
+  if (opcode_meta[op].arg_count > 1) {
+    svm_asm_lexer_t before_arg2 = *lexer;
+    bool present = svm_asm_next_token(lexer, &arg2_tok);
+
+    if (lexer->starved) {
+      return SVM_ASM_OK;
+    }
+
+    arg2 = present ? svm_strn2arg(arg2_tok.str, arg2_tok.length) : ARG_NONE;
+
+    // Optional register argument - anything else belongs to the next statement
+    if (opcode_meta[op].arg2_restrict == SVM_ASM_ARGC_REG_OPTIONAL && !(arg2 >= ARG_R0 && arg2 <= ARG_R15)) {
+      *lexer = before_arg2;
+      arg2 = ARG_NONE;
+      present = true;
+    }
+
+    SVM_ASSERT_RETURN(present, SVM_ASM_ERR_EXPECTED_TOKEN);
+    if (!svm_asm_check_constraint(opcode_meta[op].arg2_restrict, arg2)) {
+      if (!ctx->part) {
+        printf("Second argument to %.*s %s\n", op_tok->length, op_tok->str, svm_asm_constraint2errstr(opcode_meta[op].arg2_restrict));
+      }
+      return SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED;
+    }
+  }
+
+  svm_asm_value_t arg1_value = {0}, arg2_value = {0};
+
+  if (arg1 == ARG_IMM) {
+    SVM_ASM_ERROR_CHECK_RETURN(svm_asm_eval(ctx, &arg1_tok, &arg1_value));
+  }
+
+  if (arg2 == ARG_IMM) {
+    SVM_ASM_ERROR_CHECK_RETURN(svm_asm_eval(ctx, &arg2_tok, &arg2_value));
+  }
+
+  // Label targets of control transfers are encoded relative to the
+  // reference, so code stays position independent
+  if (arg1_value.label && (op == OP_JMP || op == OP_INV)) {
+    arg1 = ARG_REL;
+  }
+
+  svm_lines_add(&ctx->lines, ctx->code.size, op_tok->line);
+  svm_asm_push_i32(ctx, svm_instruction_to_int32(svm_pack_instruction(op, ext, arg1, arg2)));
+
+  if (arg1 == ARG_IMM || arg1 == ARG_REL) {
+    svm_asm_push_value(ctx, &arg1_value, arg1 == ARG_REL);
+  }
+
+  if (arg2 == ARG_IMM) {
+    svm_asm_push_value(ctx, &arg2_value, false);
+  }
+
+  return SVM_ASM_OK;
+}
+
+/**
+ * Assembles all complete statements available to lexer, that start before
+ * limit
+ *
+ * @note On return lexer points to the first statement, that wasn't assembled
+ */
+static svm_asm_error_t svm_asm_parse(svm_asm_t * ctx, svm_asm_lexer_t * lexer, const char * limit) {
+  for (;;) {
+    svm_asm_lexer_t start = *lexer;
+    svm_asm_token_t op_tok;
+
+    bool present = svm_asm_next_token(lexer, &op_tok);
+
+    if (present && op_tok.str >= limit) {
+      *lexer = start;
+      return SVM_ASM_OK;
+    }
+
+    svm_asm_error_t res = present ? svm_asm_statement(ctx, lexer, &op_tok) : SVM_ASM_OK;
+
+    if (lexer->starved) {
+      *lexer = start;
+      return SVM_ASM_OK;
+    }
+
+    if (!present || res != SVM_ASM_OK) {
+      return res;
+    }
+  }
+}
+
+/**
+ * Feeds file to assembler chunk by chunk
+ */
+static svm_asm_error_t svm_asm_stream(svm_asm_t * ctx, FILE * file) {
+  char chunk[SVM_ASM_STREAM_CHUNK_SIZE];
+  size_t size;
+
+  while ((size = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    SVM_ASM_ERROR_CHECK_RETURN(svm_asm_feed(ctx, chunk, size));
+  }
+
+  return svm_asm_finish(ctx);
+}
+
+#if USE_SVM_ASM_PARALLEL
+/**
+ * Returns position of the next token (or end of source)
+ */
+static const char * svm_asm_peek(svm_asm_lexer_t lexer) {
+  svm_asm_token_t token;
+
+  return svm_asm_next_token(&lexer, &token) ? token.str : lexer.end;
+}
+
+/**
+ * Assembles part of source, labels stay unresolved until merge
+ */
+static void * svm_asm_part_worker(void * arg) {
+  svm_asm_part_t * part = arg;
+  svm_asm_lexer_t lexer = {.pos = part->begin, .end = part->end, .line = 1, .final = true};
+
+  part->res = svm_asm_init(&part->ctx);
+  part->ctx.part = true;
+  part->first = svm_asm_peek(lexer);
+
+  if (part->res == SVM_ASM_OK) {
+    svm_asm_presize(&part->ctx, part->limit - part->begin);
+    part->res = svm_asm_parse(&part->ctx, &lexer, part->limit);
+  }
+
+  part->stop = svm_asm_peek(lexer);
+
+  for (const char * pos = part->begin; (pos = memchr(pos, '\n', part->limit - pos)); ++pos) {
+    part->lines++;
+  }
+
+  return NULL;
+}
+
+/**
+ * Looks symbol of part up in context, adding it if it wasn't there
+ *
+ * @note Name isn't copied, arena of part must be adopted by context
+ */
+static svm_asm_symbol_t * svm_asm_adopt_symbol(svm_asm_t * ctx, const svm_asm_symbol_t * local) {
+  if ((ctx->symbols.size + 1) * 4 > ctx->symbols.capacity * 3) {
+    svm_asm_symbols_grow(ctx);
+  }
+
+  svm_asm_symbol_t * symbol = svm_asm_symbol_slot(ctx, local->name, strlen(local->name), local->hash);
+
+  if (!symbol->name) {
+    symbol->name = local->name;
+    symbol->hash = local->hash;
+    symbol->location = -1;
+    symbol->fixups = -1;
+    ctx->symbols.size++;
+  }
+
+  return symbol;
+}
+
+/**
+ * Drops everything assembled into context, keeping file of line table
+ */
+static void svm_asm_reset(svm_asm_t * ctx) {
+  char * file = ctx->lines.file;
+
+  ctx->lines.file = NULL;
+  svm_asm_free(ctx);
+  svm_asm_init(ctx);
+  ctx->lines.file = file;
+}
+
+/**
+ * Appends part to code, rebasing its locations
+ *
+ * All references of part are still in fixup chains of its labels, so
+ * they resolve to the first definition in the whole source, as they would
+ * in a single pass
+ *
+ * @retval false If line table of part doesn't line up with the one of
+ *         context (context is left partially merged)
+ */
+static bool svm_asm_merge(svm_asm_t * ctx, svm_asm_part_t * part, uint32_t line_base) {
+  svm_asm_t * src = &part->ctx;
+  int32_t base = ctx->code.size;
+
+  SVM_ASM_RESERVE(ctx, ctx->code, ctx->code.size + src->code.size);
+
+  memcpy(ctx->code.buffer + base, src->code.buffer, src->code.size * sizeof(src->code.buffer[0]));
+  ctx->code.size += src->code.size;
+
+  SVM_ASM_RESERVE(ctx, ctx->relocs, ctx->relocs.size + src->relocs.size);
+
+  for (uint32_t i = 0; i < src->relocs.size; ++i) {
+    ctx->relocs.buffer[ctx->relocs.size++] = src->relocs.buffer[i] + base;
+  }
+
+  // Addends stay sorted, as parts are merged in order
+  SVM_ASM_RESERVE(ctx, ctx->addends, ctx->addends.size + src->addends.size);
+
+  for (uint32_t i = 0; i < src->addends.size; ++i) {
+    ctx->addends.buffer[ctx->addends.size].location = src->addends.buffer[i].location + base;
+    ctx->addends.buffer[ctx->addends.size].addend = src->addends.buffer[i].addend;
+    ctx->addends.size++;
+  }
+
+  ctx->data += src->data;
+
+  if (svm_lines_append(&ctx->lines, &src->lines, base, line_base) != SVM_OK) {
+    return false;
+  }
+
+  ctx->reallocs += src->reallocs;
+
+  // Arena of part (with its names) is kept, instead of names being copied
+  if (src->arena) {
+    svm_asm_arena_block_t * tail = src->arena;
+
+    while (tail->next) {
+      tail = tail->next;
+    }
+
+    if (ctx->arena) {
+      tail->next = ctx->arena->next;
+      ctx->arena->next = src->arena;
+    } else {
+      ctx->arena = src->arena;
+    }
+
+    src->arena = NULL;
+  }
+
+  while ((ctx->symbols.size + src->symbols.size) * 4 > ctx->symbols.capacity * 3) {
+    svm_asm_symbols_grow(ctx);
+  }
+
+  for (uint32_t i = 0; i < src->symbols.capacity; ++i) {
+    const svm_asm_symbol_t * local = &src->symbols.buffer[i];
+
+    if (!local->name) {
+      continue;
+    }
+
+    svm_asm_symbol_t * symbol = svm_asm_adopt_symbol(ctx, local);
+
+    if (symbol->location == -1 && local->location != -1) {
+      symbol->location = local->location + base;
+      svm_asm_resolve_fixups(ctx, symbol);
+    }
+
+    // Resolve references of part, or add them to the chain of context
+    for (int32_t location = local->fixups; location != -1; ) {
+      int32_t link = ctx->code.buffer[location + base];
+      int32_t next = SVM_ASM_FIXUP_NEXT(link);
+      bool relative = SVM_ASM_FIXUP_RELATIVE(link);
+
+      if (symbol->location != -1) {
+        int32_t target = symbol->location + svm_asm_addend(ctx, location + base);
+        ctx->code.buffer[location + base] = relative ? target - (location + base) : target;
+      } else {
+        ctx->code.buffer[location + base] = SVM_ASM_FIXUP_LINK(next != -1 ? next + base : symbol->fixups, relative);
+      }
+
+      location = next;
+    }
+
+    if (symbol->location == -1 && local->fixups != -1) {
+      symbol->fixups = local->fixups + base;
+    }
+  }
+
+  SVM_ASM_RESERVE(ctx, ctx->labels, ctx->labels.size + src->labels.size);
+
+  for (uint32_t i = 0; i < src->labels.size; ++i) {
+    ctx->labels.buffer[ctx->labels.size].name = src->labels.buffer[i].name;
+    ctx->labels.buffer[ctx->labels.size].location = src->labels.buffer[i].location + base;
+    ctx->labels.size++;
+  }
+
+  return true;
+}
+#endif
+
+/**
+ * Prints disassembly & labels of assembled code, if enabled
+ */
+static void svm_asm_print(const svm_asm_t * ctx) {
+  (void) ctx;
+
+#if USE_SVM_ASM_PRINT_DISASM
+  printf("Disassembly:\n");
+  svm_disassemble(ctx->code.buffer, ctx->code.size);
+#endif
 
 #if USE_SVM_ASM_PRINT_LABELS
   printf("Labels:\n");
@@ -374,6 +1383,338 @@ svm_asm_error_t svm_asm_file(svm_asm_t * ctx, const char * filename) {
     printf("0x%04x | '%s'\n", ctx->labels.buffer[i].location, ctx->labels.buffer[i].name);
   }
 #endif
+}
+
+/* Shared functions ========================================================= */
+svm_asm_error_t svm_asm_init(svm_asm_t * ctx) {
+  SVM_ASSERT_RETURN(ctx, SVM_ASM_ERR_NULL);
+
+  memset(ctx, 0, sizeof(*ctx));
+
+  ctx->code.capacity = 32;
+  ctx->code.buffer = svm_malloc(ctx->code.capacity * sizeof(typeof(ctx->code.buffer[0])));
+
+  if (!ctx->code.buffer) {
+    printf("Failed to allocate buffer for bytecode\n");
+    return SVM_ASM_ERR_BAD_ALLOC;
+  }
+
+  svm_lines_init(&ctx->lines, NULL);
+
+  ctx->stream.line = 1;
+
+  ctx->labels.capacity = 8;
+  ctx->labels.buffer = svm_malloc(ctx->labels.capacity * sizeof(ctx->labels.buffer[0]));
+
+  if (!ctx->labels.buffer) {
+    printf("Failed to allocate buffer for labels\n");
+    return SVM_ASM_ERR_BAD_ALLOC;
+  }
+
+  return SVM_ASM_OK;
+}
+
+svm_asm_error_t svm_asm_free(svm_asm_t * ctx) {
+  if (ctx->code.buffer) {
+    svm_free(ctx->code.buffer);
+  }
+
+  if (ctx->labels.buffer) {
+    svm_free(ctx->labels.buffer);
+  }
+
+  if (ctx->relocs.buffer) {
+    svm_free(ctx->relocs.buffer);
+  }
+
+  if (ctx->addends.buffer) {
+    svm_free(ctx->addends.buffer);
+  }
+
+  if (ctx->symbols.buffer) {
+    svm_free(ctx->symbols.buffer);
+  }
+
+  if (ctx->stream.buffer) {
+    svm_free(ctx->stream.buffer);
+  }
+
+  while (ctx->arena) {
+    svm_asm_arena_block_t * next = ctx->arena->next;
+    svm_free(ctx->arena);
+    ctx->arena = next;
+  }
+
+  svm_lines_free(&ctx->lines);
 
   return SVM_ASM_OK;
 }
+
+svm_asm_error_t svm_asm(svm_asm_t * ctx, const char * source, size_t size) {
+  SVM_ASSERT_RETURN(ctx && (source || !size), SVM_ASM_ERR_NULL);
+
+  svm_asm_lexer_t lexer = {.pos = source, .end = source + size, .line = 1, .final = true};
+
+  svm_asm_presize(ctx, size);
+
+  SVM_ASM_ERROR_CHECK_RETURN(svm_asm_parse(ctx, &lexer, lexer.end));
+
+  return svm_asm_check_undefined(ctx);
+}
+
+svm_asm_error_t svm_asm_parallel(svm_asm_t * ctx, const char * source, size_t size, uint32_t jobs) {
+  SVM_ASSERT_RETURN(ctx && (source || !size), SVM_ASM_ERR_NULL);
+
+#if USE_SVM_ASM_PARALLEL
+  if (!jobs) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = online > 0 ? online : 1;
+  }
+
+  if (jobs > size / SVM_ASM_PARALLEL_PART_SIZE) {
+    jobs = size / SVM_ASM_PARALLEL_PART_SIZE;
+  }
+
+  if (jobs <= 1) {
+    return svm_asm(ctx, source, size);
+  }
+
+  // Parts can't see constants of each other, so those are left to a single pass
+  const char * end = source + size;
+
+  for (const char * pos = source; (pos = memchr(pos, '.', end - pos)); ++pos) {
+    if (end - pos >= 6 && !memcmp(pos, ".const", 6)) {
+      return svm_asm(ctx, source, size);
+    }
+  }
+
+  svm_asm_part_t * parts = svm_asm_arena_alloc(ctx, jobs * sizeof(svm_asm_part_t), _Alignof(svm_asm_part_t));
+
+  memset(parts, 0, jobs * sizeof(svm_asm_part_t));
+
+  // Split at line starts, so every part begins between tokens
+
+  for (uint32_t i = 0; i < jobs; ++i) {
+    const char * begin = i ? parts[i - 1].limit : source;
+    const char * limit = source + size / jobs * (i + 1);
+
+    if (i == jobs - 1 || limit <= begin) {
+      limit = i == jobs - 1 ? end : begin;
+    } else {
+      const char * newline = memchr(limit - 1, '\n', end - limit + 1);
+      limit = newline ? newline + 1 : end;
+    }
+
+    parts[i].begin = begin;
+    parts[i].limit = limit;
+    parts[i].end = end;
+  }
+
+  for (uint32_t i = 1; i < jobs; ++i) {
+    parts[i].started = pthread_create(&parts[i].thread, NULL, svm_asm_part_worker, &parts[i]) == 0;
+
+    if (!parts[i].started) {
+      svm_asm_part_worker(&parts[i]);
+    }
+  }
+
+  svm_asm_part_worker(&parts[0]);
+
+  for (uint32_t i = 1; i < jobs; ++i) {
+    if (parts[i].started) {
+      pthread_join(parts[i].thread, NULL);
+    }
+  }
+
+  // Parts must line up with statements, that a single pass would see
+  bool consistent = true;
+
+  for (uint32_t i = 0; i < jobs; ++i) {
+    consistent &= parts[i].res == SVM_ASM_OK;
+    consistent &= i == jobs - 1 || parts[i].stop == parts[i + 1].first;
+  }
+
+  uint32_t line_base = 0;
+  bool merged = false;
+
+  for (uint32_t i = 0; i < jobs; ++i) {
+    if (consistent) {
+      consistent = svm_asm_merge(ctx, &parts[i], line_base);
+      line_base += parts[i].lines;
+      merged = true;
+    }
+
+    svm_asm_free(&parts[i].ctx);
+  }
+
+  // Errors are reported (and statements, spanning parts, assembled) by a single pass
+  if (!consistent) {
+    if (merged) {
+      svm_asm_reset(ctx);
+    }
+
+    return svm_asm(ctx, source, size);
+  }
+
+  return svm_asm_check_undefined(ctx);
+#else
+  return svm_asm(ctx, source, size);
+#endif
+}
+
+svm_asm_error_t svm_asm_feed(svm_asm_t * ctx, const char * chunk, size_t size) {
+  SVM_ASSERT_RETURN(ctx && (chunk || !size), SVM_ASM_ERR_NULL);
+
+  const char * source = chunk;
+
+  // Incomplete statement from previous chunk has to be continued, otherwise
+  // chunk is parsed in place
+  if (ctx->stream.size) {
+    SVM_ASM_RESERVE(ctx, ctx->stream, ctx->stream.size + size);
+    memcpy(ctx->stream.buffer + ctx->stream.size, chunk, size);
+    source = ctx->stream.buffer;
+    size += ctx->stream.size;
+  }
+
+  svm_asm_lexer_t lexer = {.pos = source, .end = source + size, .line = ctx->stream.line};
+  svm_asm_error_t res = svm_asm_parse(ctx, &lexer, lexer.end);
+
+  // Keep the rest until more input arrives
+  size_t rest = lexer.end - lexer.pos;
+
+  SVM_ASM_RESERVE(ctx, ctx->stream, rest);
+  memmove(ctx->stream.buffer, lexer.pos, rest);
+  ctx->stream.size = rest;
+  ctx->stream.line = lexer.line;
+
+  return res;
+}
+
+svm_asm_error_t svm_asm_finish(svm_asm_t * ctx) {
+  SVM_ASSERT_RETURN(ctx, SVM_ASM_ERR_NULL);
+
+  svm_asm_lexer_t lexer = {
+    .pos = ctx->stream.buffer,
+    .end = ctx->stream.buffer + ctx->stream.size,
+    .line = ctx->stream.line,
+    .final = true
+  };
+
+  svm_asm_error_t res = svm_asm_parse(ctx, &lexer, lexer.end);
+
+  ctx->stream.size = 0;
+  ctx->stream.line = 1;
+
+  SVM_ASM_ERROR_CHECK_RETURN(res);
+
+  return svm_asm_check_undefined(ctx);
+}
+
+const char * svm_asm_map_file(const char * filename, size_t * size) {
+#if USE_SVM_ASM_MMAP
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  *size = st.st_size;
+
+  // Empty file can't be mapped
+  void * source = *size ? mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0) : (void *) "";
+  close(fd);
+
+  if (source == MAP_FAILED) {
+    return NULL;
+  }
+
+  if (*size) {
+    madvise(source, *size, MADV_SEQUENTIAL);
+  }
+
+  return source;
+#else
+  FILE * file = fopen(filename, "r");
+
+  if (!file) {
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char * source = svm_malloc(*size + 1);
+
+  if (source && fread(source, 1, *size, file) != *size) {
+    svm_free(source);
+    source = NULL;
+  }
+
+  fclose(file);
+
+  return source;
+#endif
+}
+
+void svm_asm_unmap_file(const char * source, size_t size) {
+#if USE_SVM_ASM_MMAP
+  if (size) {
+    munmap((void *) source, size);
+  }
+#else
+  svm_free((void *) source);
+#endif
+}
+
+svm_asm_error_t svm_asm_source(svm_asm_t * ctx, const char * filename, const char * source, size_t size) {
+  SVM_ASSERT_RETURN(ctx && filename && (source || !size), SVM_ASM_ERR_NULL);
+
+  svm_asm_init(ctx);
+  svm_lines_init(&ctx->lines, filename);
+
+#if USE_SVM_ASM_PRINT_TOKENS
+  SVM_ASM_ERROR_CHECK_RETURN(svm_asm(ctx, source, size));
+#else
+  SVM_ASM_ERROR_CHECK_RETURN(svm_asm_parallel(ctx, source, size, 0));
+#endif
+
+  svm_asm_print(ctx);
+
+  return SVM_ASM_OK;
+}
+
+svm_asm_error_t svm_asm_file(svm_asm_t * ctx, const char * filename) {
+  SVM_ASSERT_RETURN(ctx && filename, SVM_ASM_ERR_NULL);
+
+  if (!strcmp(filename, "-")) {
+    svm_asm_init(ctx);
+    svm_lines_init(&ctx->lines, "<stdin>");
+    SVM_ASM_ERROR_CHECK_RETURN(svm_asm_stream(ctx, stdin));
+
+    svm_asm_print(ctx);
+
+    return SVM_ASM_OK;
+  }
+
+  size_t size;
+  const char * source = svm_asm_map_file(filename, &size);
+
+  if (!source) {
+    printf("Failed to open %s\n", filename);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  svm_asm_error_t res = svm_asm_source(ctx, filename, source, size);
+
+  svm_asm_unmap_file(source, size);
+
+  return res;
+}
@@ -13,9 +13,62 @@ extern "C" {
 
 /* Includes ================================================================= */
 #include "svm.h"
+#include "svm_lines.h"
 
 /* Defines ================================================================== */
-#define SVM_LABEL_NAME_MAX 32
+/**
+ * Assembler version, bumped whenever the same source assembles into different code
+ */
+#define SVM_ASM_VERSION 2
+
+/**
+ * Map source files read-only instead of reading them into memory
+ */
+#ifndef USE_SVM_ASM_MMAP
+#define USE_SVM_ASM_MMAP 1
+#endif
+
+/**
+ * Assemble large sources on multiple threads
+ */
+#ifndef USE_SVM_ASM_PARALLEL
+#define USE_SVM_ASM_PARALLEL 1
+#endif
+
+/**
+ * Minimal size of source part, assembled by a single thread
+ */
+#ifndef SVM_ASM_PARALLEL_PART_SIZE
+#define SVM_ASM_PARALLEL_PART_SIZE (256 * 1024)
+#endif
+
+/**
+ * Size of chunks, stdin is read in, and growth step of stream buffer
+ */
+#ifndef SVM_ASM_STREAM_CHUNK_SIZE
+#define SVM_ASM_STREAM_CHUNK_SIZE 4096
+#endif
+
+/**
+ * Size of the first block of assembler arena (next ones double)
+ */
+#ifndef SVM_ASM_ARENA_BLOCK_SIZE
+#define SVM_ASM_ARENA_BLOCK_SIZE 4096
+#endif
+
+/**
+ * Expected source bytes per code word, buffers are presized by it
+ */
+#ifndef SVM_ASM_SOURCE_BYTES_PER_WORD
+#define SVM_ASM_SOURCE_BYTES_PER_WORD 8
+#endif
+
+/**
+ * Initial capacity of symbol table (power of 2)
+ */
+#ifndef SVM_ASM_SYMBOLS_INITIAL
+#define SVM_ASM_SYMBOLS_INITIAL 64
+#endif
 
 /* Macros =================================================================== */
 /* Enums ==================================================================== */
@@ -30,6 +83,10 @@ typedef enum {
   SVM_ASM_ERR_UNDEFINED_LABEL,            /** Undefined label referenced */
   SVM_ASM_ERR_FILE_OPEN_FAILED,           /** Failed to open file */
   SVM_ASM_ERR_EXPECTED_TOKEN,             /** Expected token, but got nothing */
+  SVM_ASM_ERR_BAD_REFERENCE,              /** Code reference doesn't point to an instruction */
+  SVM_ASM_ERR_BAD_PROFILE,                /** Malformed profile */
+  SVM_ASM_ERR_BAD_EXPRESSION,             /** Malformed expression, or it can't be evaluated */
+  SVM_ASM_ERR_BAD_DIRECTIVE,              /** Malformed directive, or constant redefined */
 } svm_asm_error_t;
 
 /* Types ==================================================================== */
@@ -37,10 +94,39 @@ typedef enum {
  * Label, contains name and location
  */
 typedef struct {
-  char name[SVM_LABEL_NAME_MAX];
+  const char * name;  /** Interned name */
   int32_t location;
 } svm_asm_label_t;
 
+/**
+ * Symbol table entry
+ */
+typedef struct {
+  const char * name;  /** Interned name (NULL for empty slot) */
+  uint32_t hash;      /** Hash of name */
+  int32_t location;   /** Location of the first definition (-1 until defined), or value of constant */
+  int32_t fixups;     /** Last reference before definition, earlier ones are chained through code (-1 if none) */
+  bool constant;      /** Defined by .const */
+} svm_asm_symbol_t;
+
+/**
+ * Offset, added to label location in unresolved reference (label+4)
+ */
+typedef struct {
+  uint32_t location;  /** Location of reference */
+  int32_t addend;
+} svm_asm_addend_t;
+
+/**
+ * Block of assembler arena, allocations never move
+ */
+typedef struct svm_asm_arena_block_t {
+  struct svm_asm_arena_block_t * next;
+  uint32_t capacity;
+  uint32_t size;
+  _Alignas(max_align_t) char buffer[];
+} svm_asm_arena_block_t;
+
 /**
  * SVM Asm Context
  */
@@ -58,10 +144,46 @@ typedef struct {
   } labels;
 
   struct {
-    svm_asm_label_t * buffer;
+    svm_asm_symbol_t * buffer;  /** Open addressing, linear probing */
+    uint32_t capacity;          /** Power of 2 */
+    uint32_t size;
+  } symbols;
+
+  svm_asm_arena_block_t * arena;  /** Interned names & temporary allocations, current block first */
+
+  struct {
+    uint32_t * buffer;  /** Code locations, that hold label references */
+    uint32_t capacity;
+    uint32_t size;
+  } relocs;
+
+  struct {
+    svm_asm_addend_t * buffer;  /** Sorted by location, only for references in fixup chains */
     uint32_t capacity;
     uint32_t size;
-  } patches;
+  } addends;
+
+  struct {
+    char * buffer;      /** Incomplete statement, carried over to the next chunk */
+    uint32_t capacity;
+    uint32_t size;
+    uint32_t line;      /** Line, buffer starts at */
+  } stream;
+
+  svm_lines_t lines;  /** Code index to source line table */
+
+  bool part;          /** Assembling a part of source - labels are resolved & errors reported on merge */
+
+  uint32_t constants; /** Count of constants, defined with .const */
+
+  uint32_t data;      /** Count of words, emitted by .word & .data (code can't be decoded, if there are any) */
+
+  uint32_t reallocs;  /** Count of buffer reallocations during assembly */
+
+  struct {
+    uint32_t call_stack_size; /** Required call stack size (0 if unknown) */
+    uint32_t stack_size;      /** Required stack size (0 if unknown) */
+  } meta;
 } svm_asm_t;
 
 /* Variables ================================================================ */
@@ -83,30 +205,146 @@ svm_asm_error_t svm_asm_free(svm_asm_t * code);
 /**
  * Assemble source
  *
+ * Besides instructions & labels, source may contain directives:
+ *
+ *   .const NAME EXPR      - defines constant, usable after the definition
+ *   .word EXPR...         - emits value of every expression till the end of line
+ *   .data COUNT [EXPR]    - emits COUNT words of EXPR (0 by default)
+ *
+ * Immediate arguments & directive values are expressions without spaces,
+ * made of numbers, constants, labels, unary - ~ + and binary * / % + -
+ * << >> & ^ | with C precedence, and parentheses (WIDTH*8+table). At most
+ * one label may be used, and only with offset added to it (table-4)
+ *
+ * @note The result will be available in code->code.buffer & code->code.size
+ *
+ * @param code Context
+ * @param source Source code (isn't modified, doesn't need to be NULL-terminated)
+ * @param size Size of source in bytes
+ *
+ * @note References are patched as soon as label is defined, all undefined
+ *       labels are reported at the end
+ *
+ * @retval SVM_ASM_OK If assembly was successful
+ * @retval SVM_ASM_ERR_EXPECTED_TOKEN If expected next token, but there was none
+ * @retval SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED If instruction argument constraint wasn't met
+ * @retval SVM_ASM_ERR_UNDEFINED_LABEL If referenced label was never defined
+ * @retval SVM_ASM_ERR_BAD_EXPRESSION If expression is malformed or can't be evaluated
+ * @retval SVM_ASM_ERR_BAD_DIRECTIVE If directive is malformed, or constant is redefined
+ */
+svm_asm_error_t svm_asm(svm_asm_t * code, const char * source, size_t size);
+
+/**
+ * Assemble source on multiple threads
+ *
+ * Source is split at line boundaries into parts, that are assembled
+ * independently and then concatenated, with references resolved across
+ * parts. Result is identical to svm_asm.
+ *
+ * Source is assembled by svm_asm on the calling thread instead, if:
+ *   - jobs is 1, or source is under 2 * SVM_ASM_PARALLEL_PART_SIZE (jobs
+ *     are limited to one per SVM_ASM_PARALLEL_PART_SIZE of source)
+ *   - it contains .const anywhere (parts can't see constants of each other)
+ *   - USE_SVM_ASM_PARALLEL is 0
+ *
+ * Source is assembled by svm_asm again after parts are done (so the time
+ * spent on parts is lost), if parts are inconsistent:
+ *   - assembly of any part failed (errors are reported by the single pass)
+ *   - a statement spans two parts (a part doesn't start where the
+ *     previous one stopped)
+ *
+ * @param code Context
+ * @param source Source code (isn't modified, doesn't need to be NULL-terminated)
+ * @param size Size of source in bytes
+ * @param jobs Max count of threads (0 - count of online CPUs)
+ *
+ * @retval SVM_ASM_OK If assembly was successful
+ * @retval SVM_ASM_ERR_EXPECTED_TOKEN If expected next token, but there was none
+ * @retval SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED If instruction argument constraint wasn't met
+ * @retval SVM_ASM_ERR_UNDEFINED_LABEL If referenced label was never defined
+ */
+svm_asm_error_t svm_asm_parallel(svm_asm_t * code, const char * source, size_t size, uint32_t jobs);
+
+/**
+ * Assemble next chunk of source
+ *
+ * Chunks may split tokens and statements anywhere, unfinished statement is
+ * kept until the next chunk (or svm_asm_finish), so memory use doesn't
+ * depend on total source size
+ *
+ * @param code Context
+ * @param chunk Part of source code (doesn't need to be NULL-terminated)
+ * @param size Size of chunk in bytes
+ *
+ * @retval SVM_ASM_OK If chunk was consumed
+ * @retval SVM_ASM_ERR_EXPECTED_TOKEN If expected next token, but there was none
+ * @retval SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED If instruction argument constraint wasn't met
+ */
+svm_asm_error_t svm_asm_feed(svm_asm_t * code, const char * chunk, size_t size);
+
+/**
+ * Finish assembly of source, fed with svm_asm_feed
+ *
+ * @param code Context
+ *
+ * @retval SVM_ASM_OK If assembly was successful
+ * @retval SVM_ASM_ERR_EXPECTED_TOKEN If source ended in the middle of instruction
+ * @retval SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED If instruction argument constraint wasn't met
+ * @retval SVM_ASM_ERR_UNDEFINED_LABEL If referenced label was never defined
+ */
+svm_asm_error_t svm_asm_finish(svm_asm_t * code);
+
+/**
+ * Reads whole source file into memory (maps it, if USE_SVM_ASM_MMAP)
+ *
+ * @param filename Path to source file
+ * @param size Will contain size of source in bytes
+ *
+ * @returns Source (not NULL-terminated), must be released with
+ *          svm_asm_unmap_file, or NULL if file couldn't be read
+ */
+const char * svm_asm_map_file(const char * filename, size_t * size);
+
+/**
+ * Releases source, read by svm_asm_map_file
+ *
+ * @param source Source
+ * @param size Size of source in bytes
+ */
+void svm_asm_unmap_file(const char * source, size_t size);
+
+/**
+ * Assemble source, read from file, print debug info
+ *
  * @note The result will be available in code->code.buffer & code->code.size
+ * @note Calls svm_asm_parallel (svm_asm, if tokens are printed)
  *
  * @param code Context
- * @param source NULL-terminated string containing source code
+ * @param filename Name of file, source was read from (for line table)
+ * @param source Source code (isn't modified, doesn't need to be NULL-terminated)
+ * @param size Size of source in bytes
  *
  * @retval SVM_ASM_OK If assembly was successful
  * @retval SVM_ASM_ERR_EXPECTED_TOKEN If expected next token, but there was none
  * @retval SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED If instruction argument constraint wasn't met
+ * @retval SVM_ASM_ERR_UNDEFINED_LABEL If referenced label was never defined
  */
-svm_asm_error_t svm_asm(svm_asm_t * code, char * source);
+svm_asm_error_t svm_asm_source(svm_asm_t * code, const char * filename, const char * source, size_t size);
 
 /**
- * Assemble source from file, patches labels, print debug info
+ * Assemble source from file, print debug info
  *
  * @note The result will be available in code->code.buffer & code->code.size
- * @note Calls svm_asm
+ * @note Calls svm_asm_parallel (svm_asm, if tokens are printed)
  *
  * @param code Context
  * @param filename NULL-terminated string containing filename to read source
- *                 from
+ *                 from ("-" to read stdin)
  *
  * @retval SVM_ASM_OK If assembly was successful
  * @retval SVM_ASM_ERR_EXPECTED_TOKEN If expected next token, but there was none
  * @retval SVM_ASM_ERR_ARG_CONSTRAINT_UNSATISFIED If instruction argument constraint wasn't met
+ * @retval SVM_ASM_ERR_UNDEFINED_LABEL If referenced label was never defined
  * @retval SVM_ASM_ERR_FILE_OPEN_FAILED If couldn't open file
  */
 svm_asm_error_t svm_asm_file(svm_asm_t * ctx, const char * filename);
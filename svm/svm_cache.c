@@ -0,0 +1,225 @@
+/** ========================================================================= *
+ *
+ * @file svm_cache.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_cache.h"
+#include "svm_obj.h"
+#include "svm_util.h"
+#include <sys/stat.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+
+/* Defines ================================================================== */
+/**
+ * FNV-1a 64 offset basis
+ */
+#define SVM_CACHE_HASH_BASIS 14695981039346656037ull
+
+/**
+ * FNV-1a 64 prime
+ */
+#define SVM_CACHE_HASH_PRIME 1099511628211ull
+
+/**
+ * Names of temporary entry, tried before giving up
+ */
+#define SVM_CACHE_TEMP_ATTEMPTS 16
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static uint64_t svm_cache_hash(uint64_t hash, const void * data, size_t size) {
+  const uint8_t * bytes = data;
+
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * SVM_CACHE_HASH_PRIME;
+  }
+
+  return hash;
+}
+
+static void svm_cache_path(char * path, size_t size, const char * dir, uint64_t key) {
+  snprintf(path, size, "%s/%016llx.svmo", dir, (unsigned long long) key);
+}
+
+/**
+ * Creates temporary file next to path, with mode 0644 & ~umask
+ *
+ * mkstemp would create it with 0600, and reading umask (to fchmod) is racy
+ * with threads, creating other files
+ *
+ * @returns File descriptor, or -1 on failure (temp contains last tried name)
+ */
+static int svm_cache_create_temp(char * temp, size_t size, const char * path) {
+  static uint32_t counter = 0;
+
+  for (uint32_t i = 0; i < SVM_CACHE_TEMP_ATTEMPTS; ++i) {
+    uint32_t id = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+
+    if (snprintf(temp, size, "%s.%ld.%u", path, (long) getpid(), id) >= (int) size) {
+      return -1;
+    }
+
+    // Name may be left over by a crashed process with the same pid
+    int fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+    if (fd >= 0 || errno != EEXIST) {
+      return fd;
+    }
+  }
+
+  return -1;
+}
+
+/* Shared functions ========================================================= */
+svm_asm_error_t svm_cache_key(const char * source, size_t source_size, const void * options, size_t size, uint64_t * key) {
+  SVM_ASSERT_RETURN((source || !source_size) && key && (options || !size), SVM_ASM_ERR_NULL);
+
+  uint32_t versions[2] = {SVM_ASM_VERSION, SVM_OBJ_VERSION};
+  uint64_t hash = SVM_CACHE_HASH_BASIS;
+
+  hash = svm_cache_hash(hash, versions, sizeof(versions));
+  hash = svm_cache_hash(hash, &size, sizeof(size));
+  hash = svm_cache_hash(hash, options, size);
+  hash = svm_cache_hash(hash, source, source_size);
+
+  *key = hash;
+
+  return SVM_ASM_OK;
+}
+
+bool svm_cache_load(svm_asm_t * ctx, const char * dir, uint64_t key, const char * filename) {
+  SVM_ASSERT_RETURN(ctx && dir && filename, false);
+
+  char path[PATH_MAX];
+  svm_cache_path(path, sizeof(path), dir, key);
+
+  int fd = open(path, O_RDONLY);
+  SVM_ASSERT_RETURN(fd >= 0, false);
+
+  struct stat st;
+  uint8_t * data = NULL;
+  bool hit = false;
+
+  if (fstat(fd, &st) || !st.st_size || st.st_size > UINT32_MAX) {
+    goto exit;
+  }
+
+  data = svm_malloc(st.st_size);
+
+  if (!data || read(fd, data, st.st_size) != st.st_size) {
+    goto exit;
+  }
+
+  svm_code_t code;
+  svm_lines_t lines;
+
+  if (svm_obj_load(&code, data, st.st_size) != SVM_OK) {
+    goto exit;
+  }
+
+  if (svm_obj_load_lines(data, st.st_size, &lines) != SVM_OK) {
+    svm_obj_free(&code);
+    goto exit;
+  }
+
+  // Entry is shared by every file with the same source
+  if (lines.file) {
+    svm_free(lines.file);
+  }
+
+  lines.file = svm_malloc(strlen(filename) + 1);
+
+  if (!lines.file) {
+    svm_lines_free(&lines);
+    svm_obj_free(&code);
+    goto exit;
+  }
+
+  strcpy(lines.file, filename);
+
+  svm_asm_init(ctx);
+
+  svm_free(ctx->code.buffer);
+
+  ctx->code.buffer = code.buffer;
+  ctx->code.capacity = code.size;
+  ctx->code.size = code.size;
+  ctx->meta.call_stack_size = code.meta.call_stack_size;
+  ctx->meta.stack_size = code.meta.stack_size;
+  ctx->lines = lines;
+
+  hit = true;
+
+exit:
+  if (data) {
+    svm_free(data);
+  }
+
+  close(fd);
+
+  return hit;
+}
+
+svm_asm_error_t svm_cache_store(const svm_asm_t * ctx, const char * dir, uint64_t key) {
+  SVM_ASSERT_RETURN(ctx && dir, SVM_ASM_ERR_NULL);
+
+  if (mkdir(dir, 0777) && errno != EEXIST) {
+    printf("Failed to create cache directory %s\n", dir);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  svm_code_t code = {
+    .buffer = ctx->code.buffer,
+    .size = ctx->code.size,
+    .meta.call_stack_size = ctx->meta.call_stack_size,
+    .meta.stack_size = ctx->meta.stack_size,
+  };
+
+  uint8_t * data;
+  uint32_t size;
+
+  if (svm_obj_save(&code, &ctx->lines, SVM_OBJ_COMPRESSION_NONE, &data, &size) != SVM_OK) {
+    return SVM_ASM_ERR_BAD_ALLOC;
+  }
+
+  char path[PATH_MAX];
+  char temp[PATH_MAX];
+
+  svm_cache_path(path, sizeof(path), dir, key);
+
+  int fd = svm_cache_create_temp(temp, sizeof(temp), path);
+
+  if (fd < 0) {
+    printf("Failed to open %s\n", temp);
+    svm_free(data);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  bool written = write(fd, data, size) == size;
+
+  close(fd);
+  svm_free(data);
+
+  // Rename is atomic, readers see either no entry or a complete one
+  if (!written || rename(temp, path)) {
+    printf("Failed to write %s\n", path);
+    unlink(temp);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  return SVM_ASM_OK;
+}
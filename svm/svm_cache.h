@@ -0,0 +1,87 @@
+/** ========================================================================= *
+ *
+ * @file svm_cache.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Assembly cache - directory of objects, keyed by a hash of the source text
+ *
+ * Key covers the source, SVM_ASM_VERSION, SVM_OBJ_VERSION and caller
+ * supplied options (e.g. optimizer configuration), so any change to them
+ * misses the cache. Entries are stored as uncompressed objects with line
+ * table, named after the key:
+ *
+ *   <dir>/<16 hex digits of key>.svmo
+ *
+ * Entries are written into a temporary file first and renamed into place,
+ * so concurrent builds never see a partially written entry. Entries are
+ * created with 0644, limited by umask (like other output files)
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include "svm_asm.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Computes cache key of source
+ *
+ * Key must be computed from the same buffer, that is assembled, so the
+ * entry can't be stored under the key of a different version of the file
+ *
+ * @param source Source code
+ * @param source_size Size of source in bytes
+ * @param options Options, that affect assembled code (may be NULL)
+ * @param size Size of options in bytes
+ * @param key Will contain the key
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ */
+svm_asm_error_t svm_cache_key(const char * source, size_t source_size, const void * options, size_t size, uint64_t * key);
+
+/**
+ * Loads cached object into assembler context
+ *
+ * On hit ctx is initialized with code, meta and line table of the entry,
+ * line table is attributed to filename. Labels are not cached
+ *
+ * @note ctx must be released with svm_asm_free only on hit
+ *
+ * @param ctx Assembler context to initialize
+ * @param dir Cache directory
+ * @param key Cache key
+ * @param filename Path to source file, entry was assembled from
+ *
+ * @retval true On hit
+ * @retval false If there is no valid entry for key
+ */
+bool svm_cache_load(svm_asm_t * ctx, const char * dir, uint64_t key, const char * filename);
+
+/**
+ * Stores assembled code into cache
+ *
+ * Creates cache directory, if it doesn't exist
+ *
+ * @param ctx Assembler context with patched code
+ * @param dir Cache directory
+ * @param key Cache key
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_FILE_OPEN_FAILED If couldn't write entry
+ * @retval SVM_ASM_ERR_BAD_ALLOC If allocation failed
+ */
+svm_asm_error_t svm_cache_store(const svm_asm_t * ctx, const char * dir, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,389 @@
+/** ========================================================================= *
+ *
+ * @file svm_cfg.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_cfg.h"
+#include "svm_util.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static bool svm_cfg_is_transfer(svm_opcode_t op) {
+  return op == OP_JMP || op == OP_INV || op == OP_RET || op == OP_END;
+}
+
+/**
+ * Marks instructions, whose address can be taken as a plain value
+ * (moved to register, pushed, passed to sys, etc.)
+ */
+static void svm_cfg_mark_address_taken(const svm_opt_t * opt, const uint32_t * map, bool * taken) {
+  for (uint32_t i = svm_opt_next_live(opt, 0); i < opt->insns.size; i = svm_opt_next_live(opt, i + 1)) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    for (uint32_t arg = 0; arg < 2; ++arg) {
+      if (insn->target[arg] == SVM_OPT_ID_NONE) {
+        continue;
+      }
+
+      if (arg == 0 && (insn->op == OP_JMP || insn->op == OP_INV)) {
+        continue;
+      }
+
+      taken[svm_opt_resolve(opt, map, insn->target[arg])] = true;
+    }
+  }
+
+  if (opt->ctx) {
+    return;
+  }
+
+  // Raw code has no relocations, so every immediate, that happens to
+  // be an address of some instruction, may be one
+  uint32_t size = 0;
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    if (opt->insns.buffer[i].address != SVM_OPT_ADDRESS_NONE) {
+      size = opt->insns.buffer[i].address + svm_opt_insn_size(&opt->insns.buffer[i]);
+    }
+  }
+
+  uint32_t * index = svm_malloc((size + 1) * sizeof(uint32_t));
+
+  if (!index) {
+    // Can't tell anything, so everything is taken
+    memset(taken, 1, opt->insns.size * sizeof(bool));
+    return;
+  }
+
+  memset(index, 0xFF, (size + 1) * sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    if (opt->insns.buffer[i].address != SVM_OPT_ADDRESS_NONE) {
+      index[opt->insns.buffer[i].address] = i;
+    }
+  }
+
+  for (uint32_t i = svm_opt_next_live(opt, 0); i < opt->insns.size; i = svm_opt_next_live(opt, i + 1)) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    for (uint32_t arg = 0; arg < 2; ++arg) {
+      svm_arg_type_t type = arg ? insn->arg2 : insn->arg1;
+      uint32_t value = insn->value[arg];
+
+      if (type == ARG_IMM && insn->target[arg] == SVM_OPT_ID_NONE && value < size && index[value] != SVM_OPT_ID_NONE) {
+        taken[svm_opt_next_live(opt, index[value])] = true;
+      }
+    }
+  }
+
+  svm_free(index);
+}
+
+static bool svm_cfg_is_root(const svm_cfg_t * cfg, uint32_t b) {
+  return b == 0 || cfg->blocks.buffer[b].entry;
+}
+
+/**
+ * Walks dominator tree up from a and b until they meet
+ */
+static uint32_t svm_cfg_intersect(const svm_cfg_t * cfg, const uint32_t * order, uint32_t a, uint32_t b) {
+  uint32_t root = cfg->blocks.size;
+
+  while (a != b) {
+    while (a != root && (b == root || order[a] > order[b])) {
+      a = cfg->idom[a];
+    }
+
+    while (b != root && (a == root || order[b] > order[a])) {
+      b = cfg->idom[b];
+    }
+  }
+
+  return a;
+}
+
+static uint32_t svm_cfg_target_block(const svm_cfg_t * cfg, const uint32_t * map, uint32_t id) {
+  uint32_t index = svm_opt_resolve(cfg->opt, map, id);
+  return index < cfg->opt->insns.size ? cfg->block[index] : SVM_CFG_NONE;
+}
+
+/* Shared functions ========================================================= */
+svm_asm_error_t svm_cfg_build(svm_cfg_t * cfg, svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(cfg && opt, SVM_ASM_ERR_NULL);
+
+  memset(cfg, 0, sizeof(*cfg));
+
+  cfg->opt = opt;
+
+  uint32_t size = opt->insns.size;
+  svm_asm_error_t res = SVM_ASM_OK;
+
+  uint32_t * map = svm_opt_index_map(opt);
+  bool * leaders = svm_malloc((size + 1) * sizeof(bool));
+  bool * taken = svm_malloc((size + 1) * sizeof(bool));
+  cfg->block = svm_malloc((size + 1) * sizeof(uint32_t));
+
+  if (!map || !leaders || !taken || !cfg->block) {
+    res = SVM_ASM_ERR_BAD_ALLOC;
+    goto exit;
+  }
+
+  memset(leaders, 0, (size + 1) * sizeof(bool));
+  memset(taken, 0, (size + 1) * sizeof(bool));
+  memset(cfg->block, 0xFF, (size + 1) * sizeof(uint32_t));
+
+  svm_cfg_mark_address_taken(opt, map, taken);
+
+  // Find leaders
+  leaders[svm_opt_next_live(opt, 0)] = true;
+
+  for (uint32_t i = svm_opt_next_live(opt, 0); i < size; i = svm_opt_next_live(opt, i + 1)) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (insn->target[0] != SVM_OPT_ID_NONE) {
+      leaders[svm_opt_resolve(opt, map, insn->target[0])] = true;
+    }
+
+    if (insn->target[1] != SVM_OPT_ID_NONE) {
+      leaders[svm_opt_resolve(opt, map, insn->target[1])] = true;
+    }
+
+    if (svm_cfg_is_transfer(insn->op)) {
+      leaders[svm_opt_next_live(opt, i + 1)] = true;
+    }
+
+    if ((insn->op == OP_JMP || insn->op == OP_INV) && insn->target[0] == SVM_OPT_ID_NONE && insn->arg1 != ARG_IMM) {
+      cfg->indirect = true;
+    }
+  }
+
+  for (uint32_t i = 0; opt->ctx && i < opt->ctx->labels.size; ++i) {
+    leaders[svm_opt_resolve(opt, map, opt->labels[i])] = true;
+
+    // Any label can be a target of register jump
+    if (cfg->indirect) {
+      taken[svm_opt_resolve(opt, map, opt->labels[i])] = true;
+    }
+  }
+
+  // Split into blocks
+  for (uint32_t i = svm_opt_next_live(opt, 0); i < size; i = svm_opt_next_live(opt, i + 1)) {
+    if (leaders[i] || taken[i]) {
+      if (cfg->blocks.size + 1 >= cfg->blocks.capacity) {
+        cfg->blocks.capacity += 32;
+        SVM_REALLOC_CHECK(cfg->blocks.buffer, cfg->blocks.capacity * sizeof(cfg->blocks.buffer[0]));
+      }
+
+      svm_cfg_block_t * block = &cfg->blocks.buffer[cfg->blocks.size++];
+
+      memset(block, 0, sizeof(*block));
+      block->first = i;
+      block->succ[SVM_CFG_SUCC_TARGET] = SVM_CFG_NONE;
+      block->succ[SVM_CFG_SUCC_NEXT] = SVM_CFG_NONE;
+      block->entry = taken[i];
+    }
+
+    cfg->blocks.buffer[cfg->blocks.size - 1].last = i;
+    cfg->block[i] = cfg->blocks.size - 1;
+  }
+
+  // Connect blocks
+  for (uint32_t b = 0; b < cfg->blocks.size; ++b) {
+    svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+    const svm_opt_insn_t * last = &opt->insns.buffer[block->last];
+    uint32_t next = b + 1 < cfg->blocks.size ? b + 1 : SVM_CFG_NONE;
+
+    switch (last->op) {
+      case OP_JMP:
+      case OP_INV:
+        if (last->target[0] != SVM_OPT_ID_NONE) {
+          block->succ[SVM_CFG_SUCC_TARGET] = svm_cfg_target_block(cfg, map, last->target[0]);
+        }
+
+        if (last->op == OP_INV || last->ext != EXT_NONE) {
+          block->succ[SVM_CFG_SUCC_NEXT] = next;
+        }
+
+        block->call = last->op == OP_INV;
+        break;
+
+      case OP_RET:
+      case OP_END:
+        break;
+
+      default:
+        block->succ[SVM_CFG_SUCC_NEXT] = next;
+        break;
+    }
+
+    for (uint32_t s = 0; s < 2; ++s) {
+      if (block->succ[s] != SVM_CFG_NONE) {
+        cfg->blocks.buffer[block->succ[s]].preds++;
+      }
+    }
+  }
+
+exit:
+  svm_free(map);
+  svm_free(leaders);
+  svm_free(taken);
+
+  if (res != SVM_ASM_OK) {
+    svm_cfg_free(cfg);
+  }
+
+  return res;
+}
+
+svm_asm_error_t svm_cfg_dominators(svm_cfg_t * cfg) {
+  SVM_ASSERT_RETURN(cfg, SVM_ASM_ERR_NULL);
+
+  uint32_t blocks = cfg->blocks.size;
+  uint32_t root = blocks;
+  svm_asm_error_t res = SVM_ASM_OK;
+
+  // Virtual root, connected to every entry, has index of block count
+  uint32_t * rpo = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * order = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * stack = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint8_t * next = svm_malloc((blocks + 1) * sizeof(uint8_t));
+  SVM_REALLOC_CHECK(cfg->idom, (blocks + 1) * sizeof(uint32_t));
+
+  if (!rpo || !order || !stack || !next) {
+    res = SVM_ASM_ERR_BAD_ALLOC;
+    goto exit;
+  }
+
+  memset(order, 0xFF, (blocks + 1) * sizeof(uint32_t));
+  memset(next, 0, (blocks + 1) * sizeof(uint8_t));
+
+  // Reverse post order by iterative depth first search
+  uint32_t count = 0, depth = 0, post = blocks + 1;
+
+  for (uint32_t r = 0; r < blocks; ++r) {
+    if (!svm_cfg_is_root(cfg, r) || order[r] != SVM_CFG_NONE) {
+      continue;
+    }
+
+    order[r] = 0;
+    stack[depth++] = r;
+
+    while (depth) {
+      uint32_t b = stack[depth - 1];
+
+      if (next[b] < 2) {
+        uint32_t succ = cfg->blocks.buffer[b].succ[next[b]++];
+
+        if (succ != SVM_CFG_NONE && order[succ] == SVM_CFG_NONE) {
+          order[succ] = 0;
+          stack[depth++] = succ;
+        }
+
+        continue;
+      }
+
+      rpo[--post] = b;
+      depth--;
+      count++;
+    }
+  }
+
+  rpo[--post] = root;
+
+  for (uint32_t i = post; i <= blocks; ++i) {
+    order[rpo[i]] = i;
+  }
+
+  for (uint32_t b = 0; b <= blocks; ++b) {
+    cfg->idom[b] = SVM_CFG_NONE;
+  }
+
+  cfg->idom[root] = root;
+
+  // Cooper, Harvey & Kennedy - iterate intersection of predecessors'
+  // dominators in reverse post order until fixed point
+  for (bool changed = true; changed; ) {
+    changed = false;
+
+    for (uint32_t i = post + 1; i <= blocks; ++i) {
+      uint32_t b = rpo[i];
+      uint32_t idom = svm_cfg_is_root(cfg, b) ? root : SVM_CFG_NONE;
+
+      for (uint32_t p = 0; p < blocks && idom != root; ++p) {
+        const svm_cfg_block_t * pred = &cfg->blocks.buffer[p];
+
+        if ((pred->succ[0] != b && pred->succ[1] != b) || cfg->idom[p] == SVM_CFG_NONE) {
+          continue;
+        }
+
+        idom = idom == SVM_CFG_NONE ? p : svm_cfg_intersect(cfg, order, p, idom);
+      }
+
+      if (idom != cfg->idom[b]) {
+        cfg->idom[b] = idom;
+        changed = true;
+      }
+    }
+  }
+
+  // Entries are dominated by nothing real
+  for (uint32_t b = 0; b < blocks; ++b) {
+    if (cfg->idom[b] == root) {
+      cfg->idom[b] = SVM_CFG_NONE;
+    }
+  }
+
+exit:
+  svm_free(rpo);
+  svm_free(order);
+  svm_free(stack);
+  svm_free(next);
+
+  return res;
+}
+
+bool svm_cfg_dominates(const svm_cfg_t * cfg, uint32_t a, uint32_t b) {
+  SVM_ASSERT_RETURN(cfg && cfg->idom, false);
+
+  for (uint32_t steps = 0; b != SVM_CFG_NONE && steps <= cfg->blocks.size; ++steps) {
+    if (a == b) {
+      return true;
+    }
+
+    b = cfg->idom[b];
+  }
+
+  return false;
+}
+
+svm_asm_error_t svm_cfg_free(svm_cfg_t * cfg) {
+  SVM_ASSERT_RETURN(cfg, SVM_ASM_ERR_NULL);
+
+  if (cfg->blocks.buffer) {
+    svm_free(cfg->blocks.buffer);
+  }
+
+  if (cfg->block) {
+    svm_free(cfg->block);
+  }
+
+  if (cfg->idom) {
+    svm_free(cfg->idom);
+  }
+
+  memset(cfg, 0, sizeof(*cfg));
+
+  return SVM_ASM_OK;
+}
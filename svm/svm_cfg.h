@@ -0,0 +1,120 @@
+/** ========================================================================= *
+ *
+ * @file svm_cfg.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Control flow graph over decoded code
+ *
+ * Basic block starts at the beginning of code, at labels, at instructions
+ * referenced by other instructions, and right after jmp, inv, ret and end.
+ * Blocks are stored in code order, so block 0 is always the entry point.
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include "svm_opt.h"
+
+/* Defines ================================================================== */
+/**
+ * Marks absent block
+ */
+#define SVM_CFG_NONE UINT32_MAX
+
+/**
+ * Index of branch target successor
+ */
+#define SVM_CFG_SUCC_TARGET 0
+
+/**
+ * Index of fall through successor
+ */
+#define SVM_CFG_SUCC_NEXT 1
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/**
+ * Basic block
+ */
+typedef struct {
+  uint32_t first;       /** Index of the first instruction */
+  uint32_t last;        /** Index of the last instruction */
+  uint32_t succ[2];     /** Branch target & fall through successors (or SVM_CFG_NONE) */
+  uint32_t preds;       /** Count of edges into the block */
+  bool entry;           /** Block can be entered from unknown location (address taken) */
+  bool call;            /** Block ends with inv, fall through successor is a return site */
+} svm_cfg_block_t;
+
+/**
+ * Control flow graph
+ */
+typedef struct {
+  svm_opt_t * opt;      /** Optimizer context, graph was built over */
+
+  struct {
+    svm_cfg_block_t * buffer;
+    uint32_t capacity;
+    uint32_t size;
+  } blocks;
+
+  uint32_t * block;     /** Block of each instruction (SVM_CFG_NONE for removed ones) */
+  uint32_t * idom;      /** Immediate dominator of each block (NULL until svm_cfg_dominators) */
+  bool indirect;        /** Code contains jumps or invokes to a register */
+} svm_cfg_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Splits live instructions of optimizer context into basic blocks
+ *
+ * @note Graph becomes stale, once instructions are removed or changed
+ *
+ * @param cfg Graph to build
+ * @param opt Optimizer context
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_BAD_ALLOC If allocation failed
+ */
+svm_asm_error_t svm_cfg_build(svm_cfg_t * cfg, svm_opt_t * opt);
+
+/**
+ * Computes immediate dominators of blocks
+ *
+ * Code is entered at block 0 and at every address taken block, so those
+ * are dominated only by the entry itself. Unreachable blocks get
+ * SVM_CFG_NONE, as do entries
+ *
+ * @param cfg Graph
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_BAD_ALLOC If allocation failed
+ */
+svm_asm_error_t svm_cfg_dominators(svm_cfg_t * cfg);
+
+/**
+ * Checks if every path from entry to block b goes through block a
+ *
+ * @note Requires svm_cfg_dominators
+ *
+ * @param cfg Graph
+ * @param a Dominator block
+ * @param b Dominated block
+ */
+bool svm_cfg_dominates(const svm_cfg_t * cfg, uint32_t a, uint32_t b);
+
+/**
+ * Releases graph
+ *
+ * @param cfg Graph
+ */
+svm_asm_error_t svm_cfg_free(svm_cfg_t * cfg);
+
+#ifdef __cplusplus
+}
+#endif
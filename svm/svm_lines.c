@@ -0,0 +1,207 @@
+/** ========================================================================= *
+ *
+ * @file svm_lines.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_lines.h"
+#include "svm_util.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static void svm_lines_push_u32(svm_lines_t * lines, uint32_t value) {
+  // LEB128 of u32 takes at most 5 bytes
+  if (lines->size + 5 >= lines->capacity) {
+    svm_lines_reserve(lines, lines->size + 5);
+  }
+
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    lines->buffer[lines->size++] = byte | (value ? 0x80 : 0);
+  } while (value);
+}
+
+static bool svm_lines_read_u32(const uint8_t ** ip, const uint8_t * iend, uint32_t * value) {
+  *value = 0;
+
+  for (uint32_t shift = 0; shift < 35; shift += 7) {
+    if (*ip >= iend) {
+      return false;
+    }
+
+    uint8_t byte = *(*ip)++;
+    *value |= (uint32_t) (byte & 0x7F) << shift;
+
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Shared functions ========================================================= */
+svm_error_t svm_lines_init(svm_lines_t * lines, const char * file) {
+  SVM_ASSERT_RETURN(lines, SVM_ERR_NULL);
+
+  memset(lines, 0, sizeof(*lines));
+
+  if (file) {
+    lines->file = svm_malloc(strlen(file) + 1);
+    SVM_ASSERT_RETURN(lines->file, SVM_ERR_BAD_ALLOC);
+    strcpy(lines->file, file);
+  }
+
+  return SVM_OK;
+}
+
+svm_error_t svm_lines_free(svm_lines_t * lines) {
+  SVM_ASSERT_RETURN(lines, SVM_ERR_NULL);
+
+  if (lines->file) {
+    svm_free(lines->file);
+  }
+
+  if (lines->buffer) {
+    svm_free(lines->buffer);
+  }
+
+  memset(lines, 0, sizeof(*lines));
+
+  return SVM_OK;
+}
+
+svm_error_t svm_lines_reserve(svm_lines_t * lines, uint32_t size) {
+  SVM_ASSERT_RETURN(lines, SVM_ERR_NULL);
+
+  if (size >= lines->capacity) {
+    lines->capacity = svm_grow_capacity(lines->capacity, size + 1);
+    SVM_REALLOC_CHECK(lines->buffer, lines->capacity);
+  }
+
+  return SVM_OK;
+}
+
+svm_error_t svm_lines_add(svm_lines_t * lines, uint32_t pc, uint32_t line) {
+  SVM_ASSERT_RETURN(lines, SVM_ERR_NULL);
+  SVM_ASSERT_RETURN(pc >= lines->last_pc, SVM_ERR);
+
+  if (line == lines->last_line) {
+    return SVM_OK;
+  }
+
+  int32_t line_delta = (int32_t) (line - lines->last_line);
+
+  svm_lines_push_u32(lines, pc - lines->last_pc);
+  svm_lines_push_u32(lines, ((uint32_t) line_delta << 1) ^ (uint32_t) (line_delta >> 31));
+
+  lines->last_pc = pc;
+  lines->last_line = line;
+
+  return SVM_OK;
+}
+
+svm_error_t svm_lines_append(svm_lines_t * lines, const svm_lines_t * other, uint32_t pc_base, uint32_t line_base) {
+  SVM_ASSERT_RETURN(lines && other, SVM_ERR_NULL);
+
+  svm_lines_iter_t iter = {0};
+
+  if (!svm_lines_next(other, &iter)) {
+    return SVM_OK;
+  }
+
+  // Only the first entry is encoded relative to the start of table,
+  // the rest are deltas and can be copied as is
+  SVM_ASSERT_RETURN(iter.pc + pc_base >= lines->last_pc && iter.line + line_base != lines->last_line, SVM_ERR);
+
+  svm_lines_add(lines, iter.pc + pc_base, iter.line + line_base);
+
+  uint32_t rest = other->size - iter.offset;
+
+  svm_lines_reserve(lines, lines->size + rest);
+
+  memcpy(lines->buffer + lines->size, other->buffer + iter.offset, rest);
+  lines->size += rest;
+
+  lines->last_pc = other->last_pc + pc_base;
+  lines->last_line = other->last_line + line_base;
+
+  return SVM_OK;
+}
+
+svm_error_t svm_lines_set(svm_lines_t * lines, const uint8_t * buffer, uint32_t size) {
+  SVM_ASSERT_RETURN(lines && (buffer || !size), SVM_ERR_NULL);
+
+  if (size > lines->capacity) {
+    lines->capacity = size;
+    SVM_REALLOC_CHECK(lines->buffer, lines->capacity);
+  }
+
+  memcpy(lines->buffer, buffer, size);
+  lines->size = size;
+
+  // Restore encoder state, so more entries could be appended
+  const uint8_t * ip = lines->buffer;
+  const uint8_t * iend = lines->buffer + lines->size;
+  uint32_t pc_delta, line_delta;
+
+  lines->last_pc = 0;
+  lines->last_line = 0;
+
+  while (ip < iend) {
+    SVM_ASSERT_RETURN(svm_lines_read_u32(&ip, iend, &pc_delta), SVM_ERR_BAD_OBJECT);
+    SVM_ASSERT_RETURN(svm_lines_read_u32(&ip, iend, &line_delta), SVM_ERR_BAD_OBJECT);
+
+    lines->last_pc += pc_delta;
+    lines->last_line += (line_delta >> 1) ^ -(line_delta & 1);
+  }
+
+  return SVM_OK;
+}
+
+bool svm_lines_next(const svm_lines_t * lines, svm_lines_iter_t * iter) {
+  SVM_ASSERT_RETURN(lines && iter, false);
+
+  const uint8_t * ip = lines->buffer + iter->offset;
+  const uint8_t * iend = lines->buffer + lines->size;
+  uint32_t pc_delta, line_delta;
+
+  if (!svm_lines_read_u32(&ip, iend, &pc_delta) || !svm_lines_read_u32(&ip, iend, &line_delta)) {
+    return false;
+  }
+
+  iter->offset = ip - lines->buffer;
+  iter->pc += pc_delta;
+  iter->line += (line_delta >> 1) ^ -(line_delta & 1);
+
+  return true;
+}
+
+bool svm_lines_lookup(const svm_lines_t * lines, uint32_t pc, uint32_t * line) {
+  SVM_ASSERT_RETURN(lines && line, false);
+
+  svm_lines_iter_t iter = {0};
+  svm_lines_iter_t next = {0};
+  bool found = false;
+
+  while (svm_lines_next(lines, &next) && next.pc <= pc) {
+    iter = next;
+    found = true;
+  }
+
+  *line = iter.line;
+
+  return found;
+}
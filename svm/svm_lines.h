@@ -0,0 +1,130 @@
+/** ========================================================================= *
+ *
+ * @file svm_lines.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Code index to source line table
+ *
+ * Table is a sequence of (pc delta, line delta) pairs, each stored as
+ * LEB128 (line delta is zigzag encoded). Entry is added only when line
+ * changes, and is valid from it's pc up until the next entry.
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include "svm.h"
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/**
+ * Line table
+ */
+typedef struct {
+  char * file;        /** Source file name (may be NULL) */
+
+  uint8_t * buffer;   /** Encoded entries */
+  uint32_t capacity;
+  uint32_t size;
+
+  uint32_t last_pc;   /** Encoder state - pc of the last entry */
+  uint32_t last_line; /** Encoder state - line of the last entry */
+} svm_lines_t;
+
+/**
+ * Line table iterator, must be zero-initialized before first use
+ */
+typedef struct {
+  uint32_t offset;    /** Offset of next entry in encoded buffer */
+  uint32_t pc;        /** pc of current entry */
+  uint32_t line;      /** Line of current entry */
+} svm_lines_iter_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Initializes line table
+ *
+ * @param lines Line table
+ * @param file Source file name, will be copied (may be NULL)
+ */
+svm_error_t svm_lines_init(svm_lines_t * lines, const char * file);
+
+/**
+ * Releases line table resources
+ *
+ * @param lines Line table
+ */
+svm_error_t svm_lines_free(svm_lines_t * lines);
+
+/**
+ * Makes sure encoded table can grow to size bytes without reallocation
+ *
+ * @param lines Line table
+ * @param size Size of encoded entries in bytes
+ */
+svm_error_t svm_lines_reserve(svm_lines_t * lines, uint32_t size);
+
+/**
+ * Records that code starting at pc comes from line
+ *
+ * @note pc must not decrease between calls
+ *
+ * @param lines Line table
+ * @param pc Index into code
+ * @param line Source line (starting from 1)
+ */
+svm_error_t svm_lines_add(svm_lines_t * lines, uint32_t pc, uint32_t line);
+
+/**
+ * Appends entries of other table, shifted by pc & line bases
+ *
+ * @note Shifted entries must not go before the last entry of lines
+ *
+ * @param lines Line table
+ * @param other Table to append
+ * @param pc_base Added to every pc of other
+ * @param line_base Added to every line of other
+ */
+svm_error_t svm_lines_append(svm_lines_t * lines, const svm_lines_t * other, uint32_t pc_base, uint32_t line_base);
+
+/**
+ * Loads already encoded table
+ *
+ * @param lines Line table (must be initialized)
+ * @param buffer Encoded entries, will be copied
+ * @param size Size of encoded entries in bytes
+ */
+svm_error_t svm_lines_set(svm_lines_t * lines, const uint8_t * buffer, uint32_t size);
+
+/**
+ * Advances iterator to the next entry
+ *
+ * @param lines Line table
+ * @param iter Iterator
+ *
+ * @retval true If iterator now points to valid entry
+ */
+bool svm_lines_next(const svm_lines_t * lines, svm_lines_iter_t * iter);
+
+/**
+ * Finds source line for pc
+ *
+ * @param lines Line table
+ * @param pc Index into code
+ * @param line Will contain source line
+ *
+ * @retval true If line was found
+ */
+bool svm_lines_lookup(const svm_lines_t * lines, uint32_t pc, uint32_t * line);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,230 @@
+/** ========================================================================= *
+ *
+ * @file svm_lz.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_lz.h"
+#include "svm_util.h"
+#include <string.h>
+
+/* Defines ================================================================== */
+#define SVM_LZ_HASH_SIZE  (1 << SVM_LZ_HASH_LOG)
+#define SVM_LZ_RUN_MASK   15
+#define SVM_LZ_SHORT_COPY 16
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static inline uint32_t svm_lz_read32(const uint8_t * p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t svm_lz_hash(uint32_t value) {
+  return (value * 2654435761u) >> (32 - SVM_LZ_HASH_LOG);
+}
+
+static inline uint32_t svm_lz_length_size(uint32_t length) {
+  return length < SVM_LZ_RUN_MASK ? 0 : (length - SVM_LZ_RUN_MASK) / 255 + 1;
+}
+
+static inline uint8_t * svm_lz_write_length(uint8_t * op, uint32_t length) {
+  if (length < SVM_LZ_RUN_MASK) {
+    return op;
+  }
+
+  length -= SVM_LZ_RUN_MASK;
+
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+
+  *op++ = length;
+
+  return op;
+}
+
+static inline bool svm_lz_read_length(const uint8_t ** ip, const uint8_t * iend, uint32_t * length) {
+  uint8_t byte;
+
+  do {
+    if (*ip >= iend) {
+      return false;
+    }
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+
+  return true;
+}
+
+static uint8_t * svm_lz_emit(
+    uint8_t * op, uint8_t * oend,
+    const uint8_t * literals, uint32_t literal_count,
+    uint32_t offset, uint32_t match_length
+) {
+  uint32_t match_code = match_length ? match_length - SVM_LZ_MIN_MATCH : 0;
+
+  uint32_t needed = 1 + svm_lz_length_size(literal_count) + literal_count
+                  + (match_length ? 2 + svm_lz_length_size(match_code) : 0);
+
+  if (needed > oend - op) {
+    return NULL;
+  }
+
+  uint8_t * token = op++;
+  *token = (literal_count < SVM_LZ_RUN_MASK ? literal_count : SVM_LZ_RUN_MASK) << 4;
+
+  op = svm_lz_write_length(op, literal_count);
+  memcpy(op, literals, literal_count);
+  op += literal_count;
+
+  if (match_length) {
+    *token |= match_code < SVM_LZ_RUN_MASK ? match_code : SVM_LZ_RUN_MASK;
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    op = svm_lz_write_length(op, match_code);
+  }
+
+  return op;
+}
+
+/* Shared functions ========================================================= */
+uint32_t svm_lz_compress(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity) {
+  SVM_ASSERT_RETURN((src || !size) && dst, 0);
+
+  // Positions are stored +1, so 0 marks an empty slot
+  uint32_t table[SVM_LZ_HASH_SIZE] = {0};
+
+  const uint8_t * ip = src;
+  const uint8_t * anchor = src;
+  const uint8_t * iend = src + size;
+  uint8_t * op = dst;
+  uint8_t * oend = dst + capacity;
+
+  while (iend - ip >= SVM_LZ_MIN_MATCH) {
+    uint32_t sequence = svm_lz_read32(ip);
+    uint32_t hash = svm_lz_hash(sequence);
+    uint32_t candidate = table[hash];
+
+    table[hash] = ip - src + 1;
+
+    if (!candidate) {
+      ip++;
+      continue;
+    }
+
+    const uint8_t * ref = src + candidate - 1;
+
+    if (ip - ref > SVM_LZ_MAX_OFFSET || svm_lz_read32(ref) != sequence) {
+      ip++;
+      continue;
+    }
+
+    uint32_t length = SVM_LZ_MIN_MATCH;
+    while (ip + length < iend && ref[length] == ip[length]) {
+      length++;
+    }
+
+    op = svm_lz_emit(op, oend, anchor, ip - anchor, ip - ref, length);
+    SVM_ASSERT_RETURN(op, 0);
+
+    ip += length;
+    anchor = ip;
+  }
+
+  op = svm_lz_emit(op, oend, anchor, iend - anchor, 0, 0);
+  SVM_ASSERT_RETURN(op, 0);
+
+  return op - dst;
+}
+
+bool svm_lz_decompress(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t dst_size) {
+  SVM_ASSERT_RETURN((src || !size) && (dst || !dst_size), false);
+
+  const uint8_t * ip = src;
+  const uint8_t * iend = src + size;
+  uint8_t * op = dst;
+  uint8_t * oend = dst + dst_size;
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+
+    uint32_t literal_count = token >> 4;
+    if (literal_count == SVM_LZ_RUN_MASK) {
+      SVM_ASSERT_RETURN(svm_lz_read_length(&ip, iend, &literal_count), false);
+    }
+
+    SVM_ASSERT_RETURN(literal_count <= iend - ip && literal_count <= oend - op, false);
+
+    // Short runs are copied with fixed size, when there is room to overshoot
+    if (literal_count <= SVM_LZ_SHORT_COPY && iend - ip >= SVM_LZ_SHORT_COPY && oend - op >= SVM_LZ_SHORT_COPY) {
+      memcpy(op, ip, SVM_LZ_SHORT_COPY);
+    } else {
+      memcpy(op, ip, literal_count);
+    }
+    op += literal_count;
+    ip += literal_count;
+
+    // Last sequence carries only literals
+    if (ip >= iend) {
+      break;
+    }
+
+    SVM_ASSERT_RETURN(iend - ip >= 2, false);
+
+    uint32_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+
+    SVM_ASSERT_RETURN(offset && offset <= op - dst, false);
+
+    uint32_t length = token & SVM_LZ_RUN_MASK;
+    if (length == SVM_LZ_RUN_MASK) {
+      SVM_ASSERT_RETURN(svm_lz_read_length(&ip, iend, &length), false);
+    }
+    length += SVM_LZ_MIN_MATCH;
+
+    SVM_ASSERT_RETURN(length <= oend - op, false);
+
+    const uint8_t * ref = op - offset;
+    uint8_t * match_end = op + length;
+
+    if (oend - op >= length + SVM_LZ_SHORT_COPY) {
+      // Close references repeat with period of offset, so expand the pattern
+      // until it's at least 8 bytes long
+      if (offset < 8) {
+        uint32_t period = offset * ((8 + offset - 1) / offset);
+        for (uint32_t i = 0; i < period; ++i) {
+          op[i] = ref[i];
+        }
+        op += period;
+        ref = op - period;
+      }
+
+      // Source never overlaps the 8 bytes being written, so copy in words,
+      // overshooting at most 7 bytes, which will be overwritten later
+      while (op < match_end) {
+        memcpy(op, ref, 8);
+        op += 8;
+        ref += 8;
+      }
+    } else {
+      while (op < match_end) {
+        *op++ = *ref++;
+      }
+    }
+
+    op = match_end;
+  }
+
+  return op == oend;
+}
@@ -0,0 +1,83 @@
+/** ========================================================================= *
+ *
+ * @file svm_lz.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Small self-contained LZ77 block codec, used for compressed SVM objects
+ *
+ * Stream is a sequence of [token][literals][offset][match] records:
+ *  - token high nibble - literal count (15 means more bytes follow)
+ *  - token low nibble  - match length - SVM_LZ_MIN_MATCH (15 means more
+ *                        bytes follow)
+ *  - offset            - 16 bit little-endian distance back into output
+ * Extra length bytes are added up while they equal 255. Last record has
+ * no offset & match.
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Defines ================================================================== */
+/**
+ * Shortest match, that will be encoded as a back reference
+ */
+#define SVM_LZ_MIN_MATCH 4
+
+/**
+ * Maximal back reference distance
+ */
+#define SVM_LZ_MAX_OFFSET 0xFFFF
+
+/**
+ * Provides definition for compressor hash table size (log2), if not provided
+ */
+#ifndef SVM_LZ_HASH_LOG
+#define SVM_LZ_HASH_LOG 12
+#endif
+
+/* Macros =================================================================== */
+/**
+ * Worst case compressed size for input of given size
+ */
+#define SVM_LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Compresses src into dst
+ *
+ * @param src Input buffer
+ * @param size Input size in bytes
+ * @param dst Output buffer
+ * @param capacity Output buffer size, SVM_LZ_BOUND(size) is always enough
+ *
+ * @returns Compressed size in bytes
+ * @retval 0 If dst is too small
+ */
+uint32_t svm_lz_compress(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t capacity);
+
+/**
+ * Decompresses src into dst in a single pass
+ *
+ * @param src Compressed buffer
+ * @param size Compressed size in bytes
+ * @param dst Output buffer
+ * @param dst_size Expected decompressed size in bytes
+ *
+ * @retval true If stream was valid and produced exactly dst_size bytes
+ */
+bool svm_lz_decompress(const uint8_t * src, uint32_t size, uint8_t * dst, uint32_t dst_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,348 @@
+/** ========================================================================= *
+ *
+ * @file svm_obj.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_obj.h"
+#include "svm_lz.h"
+#include "svm_util.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static svm_error_t svm_obj_read_file(const char * filename, uint8_t ** data, uint32_t * size) {
+  FILE * file = fopen(filename, "rb");
+
+  if (!file) {
+    printf("Failed to open %s\n", filename);
+    return SVM_ERR_IO;
+  }
+
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  *data = svm_malloc(*size ? *size : 1);
+
+  if (!*data) {
+    fclose(file);
+    return SVM_ERR_BAD_ALLOC;
+  }
+
+  if (fread(*data, 1, *size, file) != *size) {
+    printf("Failed to read %s\n", filename);
+    svm_free(*data);
+    fclose(file);
+    return SVM_ERR_IO;
+  }
+
+  fclose(file);
+
+  return SVM_OK;
+}
+
+static svm_error_t svm_obj_parse_lines(
+    const svm_obj_lines_header_t * header,
+    const uint8_t * data,
+    uint32_t size,
+    svm_lines_t * lines
+) {
+  SVM_ASSERT_RETURN(!memcmp(header->magic, SVM_OBJ_LINES_MAGIC, sizeof(header->magic)), SVM_ERR_BAD_OBJECT);
+  SVM_ASSERT_RETURN(header->file_size <= size && header->size <= size - header->file_size, SVM_ERR_BAD_OBJECT);
+
+  SVM_ERROR_CHECK_RETURN(svm_lines_init(lines, NULL));
+
+  if (header->file_size) {
+    lines->file = svm_malloc(header->file_size + 1);
+    SVM_ASSERT_RETURN(lines->file, SVM_ERR_BAD_ALLOC);
+    memcpy(lines->file, data, header->file_size);
+    lines->file[header->file_size] = '\0';
+  }
+
+  svm_error_t err = svm_lines_set(lines, data + header->file_size, header->size);
+
+  if (err != SVM_OK) {
+    svm_lines_free(lines);
+  }
+
+  return err;
+}
+
+/* Shared functions ========================================================= */
+bool svm_obj_check(const uint8_t * data, uint32_t size) {
+  SVM_ASSERT_RETURN(data && size >= sizeof(svm_obj_header_t), false);
+
+  const svm_obj_header_t * header = (const svm_obj_header_t *) data;
+
+  return !memcmp(header->magic, SVM_OBJ_MAGIC, sizeof(header->magic))
+      && header->version == SVM_OBJ_VERSION
+      && header->compression < SVM_OBJ_COMPRESSION_MAX
+      && header->payload_size <= size - sizeof(svm_obj_header_t);
+}
+
+svm_error_t svm_obj_load(svm_code_t * code, const uint8_t * data, uint32_t size) {
+  SVM_ASSERT_RETURN(code && data, SVM_ERR_NULL);
+  SVM_ASSERT_RETURN(svm_obj_check(data, size), SVM_ERR_BAD_OBJECT);
+
+  const svm_obj_header_t * header = (const svm_obj_header_t *) data;
+  const uint8_t * payload = data + sizeof(svm_obj_header_t);
+  uint32_t code_bytes = header->code_size * sizeof(code->buffer[0]);
+
+  SVM_ASSERT_RETURN(header->code_size && code_bytes / sizeof(code->buffer[0]) == header->code_size, SVM_ERR_BAD_OBJECT);
+
+  if (header->compression == SVM_OBJ_COMPRESSION_NONE) {
+    SVM_ASSERT_RETURN(header->payload_size == code_bytes, SVM_ERR_BAD_OBJECT);
+  }
+
+  int32_t * buffer = svm_malloc(code_bytes);
+  SVM_ASSERT_RETURN(buffer, SVM_ERR_BAD_ALLOC);
+
+  switch (header->compression) {
+    case SVM_OBJ_COMPRESSION_NONE:
+      memcpy(buffer, payload, code_bytes);
+      break;
+
+    case SVM_OBJ_COMPRESSION_LZ:
+      if (!svm_lz_decompress(payload, header->payload_size, (uint8_t *) buffer, code_bytes)) {
+        svm_free(buffer);
+        return SVM_ERR_BAD_OBJECT;
+      }
+      break;
+
+    default:
+      svm_free(buffer);
+      return SVM_ERR_BAD_OBJECT;
+  }
+
+  code->buffer = buffer;
+  code->size = header->code_size;
+  code->meta.call_stack_size = header->call_stack_size;
+  code->meta.stack_size = header->stack_size;
+
+  return SVM_OK;
+}
+
+svm_error_t svm_obj_load_lines(const uint8_t * data, uint32_t size, svm_lines_t * lines) {
+  SVM_ASSERT_RETURN(data && lines, SVM_ERR_NULL);
+  SVM_ASSERT_RETURN(svm_obj_check(data, size), SVM_ERR_BAD_OBJECT);
+
+  const svm_obj_header_t * header = (const svm_obj_header_t *) data;
+  uint32_t offset = sizeof(svm_obj_header_t) + header->payload_size;
+
+  SVM_ASSERT_RETURN(size - offset >= sizeof(svm_obj_lines_header_t), SVM_ERR_BAD_OBJECT);
+
+  const svm_obj_lines_header_t * lines_header = (const svm_obj_lines_header_t *) (data + offset);
+  offset += sizeof(svm_obj_lines_header_t);
+
+  return svm_obj_parse_lines(lines_header, data + offset, size - offset, lines);
+}
+
+svm_error_t svm_obj_save(
+    const svm_code_t * code,
+    const svm_lines_t * lines,
+    svm_obj_compression_t compression,
+    uint8_t ** data,
+    uint32_t * size
+) {
+  SVM_ASSERT_RETURN(code && code->buffer && data && size, SVM_ERR_NULL);
+  SVM_ASSERT_RETURN(compression < SVM_OBJ_COMPRESSION_MAX, SVM_ERR_BAD_OBJECT);
+
+  uint32_t code_bytes = code->size * sizeof(code->buffer[0]);
+  uint32_t capacity = compression == SVM_OBJ_COMPRESSION_LZ ? SVM_LZ_BOUND(code_bytes) : code_bytes;
+  uint32_t file_size = lines && lines->file ? strlen(lines->file) : 0;
+  uint32_t lines_size = lines ? sizeof(svm_obj_lines_header_t) + file_size + lines->size : 0;
+
+  uint8_t * buffer = svm_malloc(sizeof(svm_obj_header_t) + capacity + lines_size);
+  SVM_ASSERT_RETURN(buffer, SVM_ERR_BAD_ALLOC);
+
+  svm_obj_header_t * header = (svm_obj_header_t *) buffer;
+  uint8_t * payload = buffer + sizeof(svm_obj_header_t);
+
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, SVM_OBJ_MAGIC, sizeof(header->magic));
+  header->version = SVM_OBJ_VERSION;
+  header->compression = compression;
+  header->call_stack_size = code->meta.call_stack_size;
+  header->stack_size = code->meta.stack_size;
+  header->code_size = code->size;
+
+  if (compression == SVM_OBJ_COMPRESSION_LZ) {
+    header->payload_size = svm_lz_compress((const uint8_t *) code->buffer, code_bytes, payload, capacity);
+  }
+
+  // Payload, that failed to compress or didn't shrink, is stored as is
+  if (compression != SVM_OBJ_COMPRESSION_LZ || !header->payload_size || header->payload_size >= code_bytes) {
+    memcpy(payload, code->buffer, code_bytes);
+    header->compression = SVM_OBJ_COMPRESSION_NONE;
+    header->payload_size = code_bytes;
+  }
+
+  *data = buffer;
+  *size = sizeof(svm_obj_header_t) + header->payload_size;
+
+  if (lines) {
+    svm_obj_lines_header_t * lines_header = (svm_obj_lines_header_t *) (buffer + *size);
+
+    memcpy(lines_header->magic, SVM_OBJ_LINES_MAGIC, sizeof(lines_header->magic));
+    lines_header->file_size = file_size;
+    lines_header->size = lines->size;
+    *size += sizeof(svm_obj_lines_header_t);
+
+    memcpy(buffer + *size, lines->file, file_size);
+    *size += file_size;
+
+    memcpy(buffer + *size, lines->buffer, lines->size);
+    *size += lines->size;
+  }
+
+  return SVM_OK;
+}
+
+bool svm_obj_check_file(const char * filename) {
+  SVM_ASSERT_RETURN(filename, false);
+
+  FILE * file = fopen(filename, "rb");
+  SVM_ASSERT_RETURN(file, false);
+
+  svm_obj_header_t header;
+  uint32_t size = fread(&header, 1, sizeof(header), file);
+
+  fseek(file, 0, SEEK_END);
+  uint32_t fsize = ftell(file);
+  fclose(file);
+
+  // svm_obj_check only looks at the header, but validates payload size
+  // against the full file size
+  return size == sizeof(header) && svm_obj_check((const uint8_t *) &header, fsize);
+}
+
+svm_error_t svm_obj_load_file(svm_code_t * code, const char * filename) {
+  SVM_ASSERT_RETURN(code && filename, SVM_ERR_NULL);
+
+  uint8_t * data;
+  uint32_t size;
+
+  SVM_ERROR_CHECK_RETURN(svm_obj_read_file(filename, &data, &size));
+
+  svm_error_t err = svm_obj_load(code, data, size);
+
+  svm_free(data);
+
+  return err;
+}
+
+svm_error_t svm_obj_load_lines_file(const char * filename, svm_lines_t * lines) {
+  SVM_ASSERT_RETURN(filename && lines, SVM_ERR_NULL);
+
+  FILE * file = fopen(filename, "rb");
+
+  if (!file) {
+    printf("Failed to open %s\n", filename);
+    return SVM_ERR_IO;
+  }
+
+  svm_obj_header_t header;
+  svm_obj_lines_header_t lines_header;
+  svm_error_t err = SVM_ERR_BAD_OBJECT;
+  uint8_t * data = NULL;
+
+  fseek(file, 0, SEEK_END);
+  uint32_t fsize = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if (fread(&header, 1, sizeof(header), file) != sizeof(header) || !svm_obj_check((const uint8_t *) &header, fsize)) {
+    goto exit;
+  }
+
+  // Skip the code
+  fseek(file, header.payload_size, SEEK_CUR);
+
+  if (fread(&lines_header, 1, sizeof(lines_header), file) != sizeof(lines_header)) {
+    goto exit;
+  }
+
+  uint32_t remaining = fsize - (sizeof(header) + header.payload_size + sizeof(lines_header));
+
+  if (lines_header.file_size > remaining || lines_header.size > remaining - lines_header.file_size) {
+    goto exit;
+  }
+
+  data = svm_malloc(lines_header.file_size + lines_header.size + 1);
+
+  if (!data) {
+    err = SVM_ERR_BAD_ALLOC;
+    goto exit;
+  }
+
+  if (fread(data, 1, lines_header.file_size + lines_header.size, file) != lines_header.file_size + lines_header.size) {
+    err = SVM_ERR_IO;
+    goto exit;
+  }
+
+  err = svm_obj_parse_lines(&lines_header, data, lines_header.file_size + lines_header.size, lines);
+
+exit:
+  if (data) {
+    svm_free(data);
+  }
+
+  fclose(file);
+
+  return err;
+}
+
+svm_error_t svm_obj_save_file(
+    const svm_code_t * code,
+    const svm_lines_t * lines,
+    svm_obj_compression_t compression,
+    const char * filename
+) {
+  SVM_ASSERT_RETURN(code && filename, SVM_ERR_NULL);
+
+  uint8_t * data;
+  uint32_t size;
+
+  SVM_ERROR_CHECK_RETURN(svm_obj_save(code, lines, compression, &data, &size));
+
+  FILE * file = fopen(filename, "wb");
+
+  if (!file) {
+    printf("Failed to open %s\n", filename);
+    svm_free(data);
+    return SVM_ERR_IO;
+  }
+
+  bool written = fwrite(data, 1, size, file) == size;
+
+  fclose(file);
+  svm_free(data);
+
+  if (!written) {
+    printf("Failed to write %s\n", filename);
+    return SVM_ERR_IO;
+  }
+
+  return SVM_OK;
+}
+
+void svm_obj_free(svm_code_t * code) {
+  SVM_ASSERT_RETURN(code);
+
+  if (code->buffer) {
+    svm_free(code->buffer);
+    code->buffer = NULL;
+  }
+
+  code->size = 0;
+}
@@ -0,0 +1,209 @@
+/** ========================================================================= *
+ *
+ * @file svm_obj.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * SVM object format - assembled code with it's metadata, either stored
+ * as-is, or compressed with svm_lz
+ *
+ * Payload may be followed by optional line table section, which is never
+ * touched by svm_obj_load, and is read only on demand
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include "svm.h"
+#include "svm_lines.h"
+
+/* Defines ================================================================== */
+/**
+ * Object file magic
+ */
+#define SVM_OBJ_MAGIC "SVMO"
+
+/**
+ * Line table section magic
+ */
+#define SVM_OBJ_LINES_MAGIC "SVML"
+
+/**
+ * Object format version
+ */
+#define SVM_OBJ_VERSION 1
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/**
+ * Object payload compression
+ */
+typedef enum {
+  SVM_OBJ_COMPRESSION_NONE = 0, /** Payload is raw code buffer */
+  SVM_OBJ_COMPRESSION_LZ,       /** Payload is code buffer compressed with svm_lz */
+
+  SVM_OBJ_COMPRESSION_MAX       /** Special marker to get count of compression types */
+} svm_obj_compression_t;
+
+/* Types ==================================================================== */
+/**
+ * Object header
+ *
+ * @note All fields are stored in host byte order, same as the code itself
+ */
+typedef struct __PACKED {
+  char     magic[4];        /** SVM_OBJ_MAGIC */
+  uint8_t  version;         /** SVM_OBJ_VERSION */
+  uint8_t  compression;     /** svm_obj_compression_t */
+  uint16_t reserved;        /** Must be 0 */
+  uint32_t call_stack_size; /** svm_code_t meta.call_stack_size */
+  uint32_t stack_size;      /** svm_code_t meta.stack_size */
+  uint32_t code_size;       /** Code size in words */
+  uint32_t payload_size;    /** Size of payload, that follows the header, in bytes */
+} svm_obj_header_t;
+
+/**
+ * Line table section header, follows the payload
+ */
+typedef struct __PACKED {
+  char     magic[4];        /** SVM_OBJ_LINES_MAGIC */
+  uint32_t file_size;       /** Length of source file name, that follows the header */
+  uint32_t size;            /** Size of encoded table, that follows the file name */
+} svm_obj_lines_header_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Checks if buffer starts with a valid object header
+ *
+ * @param data Object buffer
+ * @param size Object buffer size in bytes
+ */
+bool svm_obj_check(const uint8_t * data, uint32_t size);
+
+/**
+ * Loads object into code context
+ *
+ * Allocates code->buffer and decompresses payload (if compressed) straight
+ * into it, in a single pass
+ *
+ * @note code->buffer must be released with svm_obj_free
+ *
+ * @param code Code context to fill
+ * @param data Object buffer
+ * @param size Object buffer size in bytes
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If pointer to code or data is NULL
+ * @retval SVM_ERR_BAD_OBJECT If object is malformed or unsupported
+ * @retval SVM_ERR_BAD_ALLOC If code buffer allocation failed
+ */
+svm_error_t svm_obj_load(svm_code_t * code, const uint8_t * data, uint32_t size);
+
+/**
+ * Loads line table section from object
+ *
+ * @param data Object buffer
+ * @param size Object buffer size in bytes
+ * @param lines Line table to initialize, must be released with svm_lines_free
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_BAD_OBJECT If object is malformed, or has no line table
+ */
+svm_error_t svm_obj_load_lines(const uint8_t * data, uint32_t size, svm_lines_t * lines);
+
+/**
+ * Serializes code context into object
+ *
+ * @note *data is allocated with svm_malloc, and must be released with svm_free
+ * @note If LZ doesn't make payload smaller, it's stored uncompressed (and
+ *       header says so)
+ *
+ * @param code Code context
+ * @param lines Line table to store alongside the code (may be NULL)
+ * @param compression Payload compression
+ * @param data Will contain pointer to object buffer
+ * @param size Will contain object size in bytes
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_NULL If some pointer is NULL
+ * @retval SVM_ERR_BAD_OBJECT If compression is unknown
+ * @retval SVM_ERR_BAD_ALLOC If object buffer allocation failed
+ */
+svm_error_t svm_obj_save(
+    const svm_code_t * code,
+    const svm_lines_t * lines,
+    svm_obj_compression_t compression,
+    uint8_t ** data,
+    uint32_t * size
+);
+
+/**
+ * Checks if file is an object
+ *
+ * @param filename Path to file
+ */
+bool svm_obj_check_file(const char * filename);
+
+/**
+ * Reads object file and loads it into code context
+ *
+ * @note Calls svm_obj_load
+ *
+ * @param code Code context to fill
+ * @param filename Path to object file
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_IO If file couldn't be read
+ * @retval SVM_ERR_BAD_OBJECT If object is malformed or unsupported
+ */
+svm_error_t svm_obj_load_file(svm_code_t * code, const char * filename);
+
+/**
+ * Reads only line table section of object file
+ *
+ * @note Code payload is skipped, not read
+ *
+ * @param filename Path to object file
+ * @param lines Line table to initialize, must be released with svm_lines_free
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_IO If file couldn't be read
+ * @retval SVM_ERR_BAD_OBJECT If object is malformed, or has no line table
+ */
+svm_error_t svm_obj_load_lines_file(const char * filename, svm_lines_t * lines);
+
+/**
+ * Serializes code context and writes it into object file
+ *
+ * @note Calls svm_obj_save
+ *
+ * @param code Code context
+ * @param lines Line table to store alongside the code (may be NULL)
+ * @param compression Payload compression
+ * @param filename Path to object file
+ *
+ * @retval SVM_OK If operation completed successfully
+ * @retval SVM_ERR_IO If file couldn't be written
+ */
+svm_error_t svm_obj_save_file(
+    const svm_code_t * code,
+    const svm_lines_t * lines,
+    svm_obj_compression_t compression,
+    const char * filename
+);
+
+/**
+ * Releases code buffer, allocated by svm_obj_load
+ *
+ * @param code Code context
+ */
+void svm_obj_free(svm_code_t * code);
+
+#ifdef __cplusplus
+}
+#endif
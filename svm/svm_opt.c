@@ -0,0 +1,3170 @@
+/** ========================================================================= *
+ *
+ * @file svm_opt.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_opt.h"
+#include "svm_cfg.h"
+#include "svm_util.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Defines ================================================================== */
+/**
+ * Marks function, which depth is being computed (call is recursive)
+ */
+#define SVM_OPT_DEPTH_VISITING (UINT32_MAX - 1)
+
+/**
+ * Marks function, which depth wasn't computed yet
+ */
+#define SVM_OPT_DEPTH_NONE (UINT32_MAX - 2)
+
+/**
+ * Set of all registers
+ */
+#define SVM_OPT_REGS_ALL ((svm_opt_regs_t) ((1ull << R_MAX) - 1))
+
+/**
+ * Marks block, stack depth at which wasn't computed yet
+ */
+#define SVM_OPT_STACK_NONE INT32_MIN
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/**
+ * Flag value, known at assembly time
+ */
+typedef enum {
+  SVM_OPT_FLAG_FALSE = 0,
+  SVM_OPT_FLAG_TRUE,
+  SVM_OPT_FLAG_UNKNOWN,
+} svm_opt_flag_t;
+
+/**
+ * State of a complementary flag pair (EQ/NE, LT/GE, GT/LE, NZ/Z)
+ */
+typedef enum {
+  SVM_OPT_PAIR_CLEAN = 0,         /** Both flags are cleared */
+  SVM_OPT_PAIR_EXCLUSIVE,         /** Exactly one flag is set */
+  SVM_OPT_PAIR_UNKNOWN,           /** Anything, as flags are sticky */
+} svm_opt_pair_t;
+
+/* Types ==================================================================== */
+/**
+ * Register value, known at assembly time
+ */
+typedef struct {
+  bool known;
+  bool nonneg;  /** Value is known to be non-negative, even if value itself isn't known */
+  int32_t value;
+} svm_opt_value_t;
+
+/**
+ * Machine state, known at assembly time
+ */
+typedef struct {
+  bool reached;                   /** State was reached by analysis */
+  svm_opt_value_t regs[R_MAX];
+  svm_opt_flag_t flags[EXT_MAX];  /** Indexed by ext, EXT_NONE is unused */
+} svm_opt_state_t;
+
+/**
+ * States of complementary flag pairs
+ */
+typedef struct {
+  bool reached;
+  svm_opt_pair_t pairs[4];
+} svm_opt_pairs_t;
+
+/**
+ * Set of registers, bit per register
+ */
+typedef uint32_t svm_opt_regs_t;
+
+/**
+ * Summary of a function - code, entered by inv, up to it's returns
+ */
+typedef struct {
+  bool function;            /** Block is a target of inv */
+  bool balanced;            /** Function leaves stack as it was, and never pops below it */
+  svm_opt_regs_t uses;      /** Registers function may read */
+  svm_opt_regs_t clobbers;  /** Registers function may write */
+} svm_opt_func_t;
+
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static bool svm_opt_is_reg(svm_arg_type_t arg) {
+  return arg >= ARG_R0 && arg <= ARG_R15;
+}
+
+static bool svm_opt_is_alu(svm_opcode_t op) {
+  return op >= OP_ADD && op <= OP_SHR;
+}
+
+static uint32_t svm_opt_value_location(const svm_opt_insn_t * insn, uint32_t address, uint32_t arg) {
+  return address + 1 + (arg == 1 && svm_arg_has_value(insn->arg1) ? 1 : 0);
+}
+
+/**
+ * Marks instructions, that can be entered other than by falling through
+ */
+static bool * svm_opt_entries(const svm_opt_t * opt, const uint32_t * map) {
+  bool * entries = svm_malloc((opt->insns.size + 1) * sizeof(bool));
+  SVM_ASSERT_RETURN(entries, NULL);
+
+  memset(entries, 0, (opt->insns.size + 1) * sizeof(bool));
+
+  for (uint32_t i = svm_opt_next_live(opt, 0); i < opt->insns.size; i = svm_opt_next_live(opt, i + 1)) {
+    for (uint32_t arg = 0; arg < 2; ++arg) {
+      if (opt->insns.buffer[i].target[arg] != SVM_OPT_ID_NONE) {
+        entries[svm_opt_resolve(opt, map, opt->insns.buffer[i].target[arg])] = true;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; opt->ctx && i < opt->ctx->labels.size; ++i) {
+    entries[svm_opt_resolve(opt, map, opt->labels[i])] = true;
+  }
+
+  return entries;
+}
+
+static void svm_opt_remove(svm_opt_t * opt, bool * entries, uint32_t index) {
+  opt->insns.buffer[index].removed = true;
+
+  // Whatever entered removed instruction, now enters the next one
+  if (entries[index]) {
+    entries[svm_opt_next_live(opt, index)] = true;
+  }
+}
+
+static bool svm_opt_is_identity(const svm_opt_insn_t * insn) {
+  if (!svm_opt_is_reg(insn->arg1)) {
+    return false;
+  }
+
+  if (insn->op == OP_MOV || insn->op == OP_AND || insn->op == OP_OR) {
+    return insn->arg2 == insn->arg1;
+  }
+
+  if (!svm_opt_is_alu(insn->op) || insn->arg2 != ARG_IMM || insn->target[1] != SVM_OPT_ID_NONE) {
+    return false;
+  }
+
+  switch (insn->op) {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_OR:
+    case OP_XOR:
+    case OP_SHL:
+    case OP_SHR:
+      return insn->value[1] == 0;
+
+    case OP_MUL:
+    case OP_DIV:
+      return insn->value[1] == 1;
+
+    default:
+      return false;
+  }
+}
+
+static bool svm_opt_is_conditional(svm_opcode_t op) {
+  return op == OP_MOV || op == OP_PUSH || op == OP_POP || op == OP_JMP || op == OP_INV || svm_opt_is_alu(op);
+}
+
+static void svm_opt_reg_range(const svm_opt_insn_t * insn, svm_register_t * from, svm_register_t * to) {
+  *from = svm_arg_to_reg(insn->arg1);
+  *to = svm_opt_is_reg(insn->arg2) ? svm_arg_to_reg(insn->arg2) : *from;
+}
+
+static void svm_opt_state_unknown(svm_opt_state_t * state) {
+  state->reached = true;
+
+  for (uint32_t reg = 0; reg < R_MAX; ++reg) {
+    state->regs[reg].known = false;
+    state->regs[reg].nonneg = false;
+  }
+
+  for (svm_ext_t ext = EXT_NONE + 1; ext < EXT_MAX; ++ext) {
+    state->flags[ext] = SVM_OPT_FLAG_UNKNOWN;
+  }
+}
+
+static bool svm_opt_state_meet(svm_opt_state_t * dst, const svm_opt_state_t * src) {
+  if (!src->reached) {
+    return false;
+  }
+
+  if (!dst->reached) {
+    *dst = *src;
+    return true;
+  }
+
+  bool changed = false;
+
+  for (uint32_t reg = 0; reg < R_MAX; ++reg) {
+    if (dst->regs[reg].known && (!src->regs[reg].known || dst->regs[reg].value != src->regs[reg].value)) {
+      dst->regs[reg].known = false;
+      changed = true;
+    }
+
+    if (dst->regs[reg].nonneg && !src->regs[reg].nonneg) {
+      dst->regs[reg].nonneg = false;
+      changed = true;
+    }
+  }
+
+  for (svm_ext_t ext = EXT_NONE + 1; ext < EXT_MAX; ++ext) {
+    if (dst->flags[ext] != src->flags[ext] && dst->flags[ext] != SVM_OPT_FLAG_UNKNOWN) {
+      dst->flags[ext] = SVM_OPT_FLAG_UNKNOWN;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static svm_opt_flag_t svm_opt_condition(const svm_opt_state_t * state, svm_ext_t ext) {
+  if (ext == EXT_NONE) {
+    return SVM_OPT_FLAG_TRUE;
+  }
+
+  return ext < EXT_MAX ? state->flags[ext] : SVM_OPT_FLAG_FALSE;
+}
+
+static bool svm_opt_arg_value(const svm_opt_state_t * state, const svm_opt_insn_t * insn, uint32_t arg, int32_t * value) {
+  svm_arg_type_t type = arg ? insn->arg2 : insn->arg1;
+
+  if (svm_opt_is_reg(type)) {
+    *value = state->regs[svm_arg_to_reg(type)].value;
+    return state->regs[svm_arg_to_reg(type)].known;
+  }
+
+  // Addresses of labels change with layout, so they are never constant
+  if (type == ARG_IMM && insn->target[arg] == SVM_OPT_ID_NONE) {
+    *value = insn->value[arg];
+    return true;
+  }
+
+  return false;
+}
+
+static bool svm_opt_arg_nonneg(const svm_opt_state_t * state, const svm_opt_insn_t * insn, uint32_t arg) {
+  svm_arg_type_t type = arg ? insn->arg2 : insn->arg1;
+
+  if (svm_opt_is_reg(type)) {
+    return state->regs[svm_arg_to_reg(type)].nonneg;
+  }
+
+  // Label addresses aren't constant, but are never negative
+  if (svm_arg_has_value(type) && insn->target[arg] != SVM_OPT_ID_NONE) {
+    return true;
+  }
+
+  return type == ARG_IMM && insn->value[arg] >= 0;
+}
+
+static bool svm_opt_fold(svm_opcode_t op, int32_t a, int32_t b, int32_t * result) {
+  switch (op) {
+    case OP_ADD: *result = (int32_t) ((uint32_t) a + (uint32_t) b); return true;
+    case OP_SUB: *result = (int32_t) ((uint32_t) a - (uint32_t) b); return true;
+    case OP_MUL: *result = (int32_t) ((uint32_t) a * (uint32_t) b); return true;
+    case OP_AND: *result = a & b; return true;
+    case OP_OR:  *result = a | b; return true;
+    case OP_XOR: *result = a ^ b; return true;
+
+    // Faulting or undefined operations are left for runtime
+    case OP_DIV:
+      if (!b || (a == INT32_MIN && b == -1)) {
+        return false;
+      }
+      *result = a / b;
+      return true;
+
+    case OP_SHL:
+      if (b < 0 || b > 31) {
+        return false;
+      }
+      *result = (int32_t) ((uint32_t) a << b);
+      return true;
+
+    case OP_SHR:
+      if (b < 0 || b > 31) {
+        return false;
+      }
+      *result = a >> b;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static void svm_opt_state_write(svm_opt_state_t * state, svm_register_t reg, bool known, bool nonneg, int32_t value) {
+  state->regs[reg].known = known;
+  state->regs[reg].nonneg = known ? value >= 0 : nonneg;
+  state->regs[reg].value = value;
+
+  // Flags are sticky, so set flag stays set
+  if (known) {
+    state->flags[value ? EXT_NZ : EXT_Z] = SVM_OPT_FLAG_TRUE;
+  } else {
+    state->flags[EXT_NZ] = state->flags[EXT_NZ] == SVM_OPT_FLAG_TRUE ? SVM_OPT_FLAG_TRUE : SVM_OPT_FLAG_UNKNOWN;
+    state->flags[EXT_Z] = state->flags[EXT_Z] == SVM_OPT_FLAG_TRUE ? SVM_OPT_FLAG_TRUE : SVM_OPT_FLAG_UNKNOWN;
+  }
+}
+
+/**
+ * Checks if result of arithmetic instruction is non-negative, whatever
+ * the exact values of it's operands are
+ */
+static bool svm_opt_result_nonneg(const svm_opt_state_t * state, const svm_opt_insn_t * insn) {
+  bool lhs = svm_opt_arg_nonneg(state, insn, 0), rhs = svm_opt_arg_nonneg(state, insn, 1);
+
+  switch (insn->op) {
+    case OP_AND:
+      return lhs || rhs;
+
+    case OP_OR:
+    case OP_XOR:
+    case OP_DIV:
+      return lhs && rhs;
+
+    case OP_SHR:
+      return lhs;
+
+    // May overflow into sign bit
+    default:
+      return false;
+  }
+}
+
+/**
+ * Applies instruction to state, as if it's condition is satisfied
+ */
+static void svm_opt_state_execute(svm_opt_state_t * state, const svm_opt_insn_t * insn) {
+  int32_t a = 0, b = 0, result = 0;
+
+  switch (insn->op) {
+    case OP_NOP:
+    case OP_END:
+    case OP_RET:
+    case OP_JMP:
+    case OP_INV:
+    case OP_PUSH:
+      break;
+
+    case OP_MOV:
+      if (svm_opt_is_reg(insn->arg1)) {
+        bool known = svm_opt_arg_value(state, insn, 1, &b);
+        svm_opt_state_write(state, svm_arg_to_reg(insn->arg1), known, svm_opt_arg_nonneg(state, insn, 1), b);
+      }
+      break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_SHL:
+    case OP_SHR:
+      if (svm_opt_is_reg(insn->arg1)) {
+        bool known = svm_opt_arg_value(state, insn, 0, &a) && svm_opt_arg_value(state, insn, 1, &b)
+                  && svm_opt_fold(insn->op, a, b, &result);
+        svm_opt_state_write(state, svm_arg_to_reg(insn->arg1), known, svm_opt_result_nonneg(state, insn), result);
+      }
+      break;
+
+    case OP_POP:
+      if (svm_opt_is_reg(insn->arg1)) {
+        svm_register_t from, to;
+        svm_opt_reg_range(insn, &from, &to);
+
+        for (svm_register_t reg = from; reg <= to; ++reg) {
+          state->regs[reg].known = false;
+          state->regs[reg].nonneg = false;
+        }
+      }
+      break;
+
+    case OP_CMP:
+      if (svm_opt_arg_value(state, insn, 0, &a) && svm_opt_arg_value(state, insn, 1, &b)) {
+        bool results[EXT_MAX] = {
+          [EXT_EQ] = a == b, [EXT_NE] = a != b, [EXT_LT] = a < b,
+          [EXT_LE] = a <= b, [EXT_GT] = a > b, [EXT_GE] = a >= b,
+        };
+
+        for (svm_ext_t ext = EXT_EQ; ext <= EXT_GE; ++ext) {
+          if (results[ext]) {
+            state->flags[ext] = SVM_OPT_FLAG_TRUE;
+          }
+        }
+      } else {
+        for (svm_ext_t ext = EXT_EQ; ext <= EXT_GE; ++ext) {
+          if (state->flags[ext] != SVM_OPT_FLAG_TRUE) {
+            state->flags[ext] = SVM_OPT_FLAG_UNKNOWN;
+          }
+        }
+      }
+      break;
+
+    case OP_CLF:
+      for (svm_ext_t ext = EXT_NONE + 1; ext < EXT_MAX; ++ext) {
+        if (insn->ext == EXT_NONE || insn->ext == ext) {
+          state->flags[ext] = SVM_OPT_FLAG_FALSE;
+        }
+      }
+      break;
+
+    // System call handler gets all registers
+    case OP_SYS:
+    default:
+      svm_opt_state_unknown(state);
+      break;
+  }
+}
+
+static void svm_opt_state_transfer(svm_opt_state_t * state, const svm_opt_insn_t * insn) {
+  if (!svm_opt_is_conditional(insn->op)) {
+    svm_opt_state_execute(state, insn);
+    return;
+  }
+
+  switch (svm_opt_condition(state, insn->ext)) {
+    case SVM_OPT_FLAG_TRUE:
+      svm_opt_state_execute(state, insn);
+      break;
+
+    case SVM_OPT_FLAG_FALSE:
+      break;
+
+    default: {
+      svm_opt_state_t executed = *state;
+      svm_opt_state_execute(&executed, insn);
+      svm_opt_state_meet(state, &executed);
+      break;
+    }
+  }
+}
+
+static bool svm_opt_reads_reg(const svm_opt_insn_t * insn, svm_register_t reg) {
+  svm_register_t from, to;
+
+  switch (insn->op) {
+    case OP_NOP:
+    case OP_END:
+    case OP_RET:
+    case OP_CLF:
+      return false;
+
+    case OP_POP:
+      return false;
+
+    case OP_MOV:
+      return svm_opt_is_reg(insn->arg2) && svm_arg_to_reg(insn->arg2) == reg;
+
+    case OP_PUSH:
+      if (!svm_opt_is_reg(insn->arg1)) {
+        return false;
+      }
+      svm_opt_reg_range(insn, &from, &to);
+      return reg >= from && reg <= to;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_SHL:
+    case OP_SHR:
+    case OP_CMP:
+    case OP_JMP:
+    case OP_INV:
+      return (svm_opt_is_reg(insn->arg1) && svm_arg_to_reg(insn->arg1) == reg)
+          || (svm_opt_is_reg(insn->arg2) && svm_arg_to_reg(insn->arg2) == reg);
+
+    default:
+      return true;
+  }
+}
+
+static bool svm_opt_overwrites_reg(const svm_opt_insn_t * insn, svm_register_t reg) {
+  if (insn->ext != EXT_NONE || !svm_opt_is_reg(insn->arg1)) {
+    return false;
+  }
+
+  if (insn->op == OP_MOV) {
+    return svm_arg_to_reg(insn->arg1) == reg;
+  }
+
+  if (insn->op == OP_POP) {
+    svm_register_t from, to;
+    svm_opt_reg_range(insn, &from, &to);
+    return reg >= from && reg <= to;
+  }
+
+  return false;
+}
+
+/**
+ * Checks if mov of known value at index is overwritten before it's value
+ * or it's flag is used, without leaving the block
+ */
+static bool svm_opt_is_dead_mov(const svm_opt_t * opt, const svm_cfg_block_t * block, uint32_t index, const svm_opt_state_t * state) {
+  const svm_opt_insn_t * insn = &opt->insns.buffer[index];
+
+  int32_t value;
+
+  // Value must be known, to know which flag mov sets
+  if (insn->op != OP_MOV || insn->ext != EXT_NONE || !svm_opt_is_reg(insn->arg1)
+      || !svm_opt_arg_value(state, insn, 1, &value)) {
+    return false;
+  }
+
+  svm_register_t reg = svm_arg_to_reg(insn->arg1);
+  svm_ext_t flag = value ? EXT_NZ : EXT_Z;
+  bool flag_set = state->flags[flag] == SVM_OPT_FLAG_TRUE;
+
+  for (uint32_t i = svm_opt_next_live(opt, index + 1); i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+    const svm_opt_insn_t * next = &opt->insns.buffer[i];
+
+    if (svm_opt_reads_reg(next, reg)) {
+      return false;
+    }
+
+    if (!flag_set && svm_opt_is_conditional(next->op) && next->ext == flag) {
+      return false;
+    }
+
+    if (svm_opt_overwrites_reg(next, reg)) {
+      // Flag is sticky, so either it was already set, or overwrite must set it too
+      return flag_set || (next->op == OP_MOV && next->arg2 == ARG_IMM
+                          && next->target[1] == SVM_OPT_ID_NONE && !next->value[1] == !value);
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Computes machine state at the beginning of each block
+ *
+ * @returns States, indexed by block (must be freed), or NULL if allocation failed
+ */
+static svm_opt_state_t * svm_opt_analyze(const svm_opt_t * opt, const svm_cfg_t * cfg) {
+  svm_opt_state_t * states = svm_malloc((cfg->blocks.size + 1) * sizeof(svm_opt_state_t));
+  SVM_ASSERT_RETURN(states, NULL);
+
+  memset(states, 0, (cfg->blocks.size + 1) * sizeof(svm_opt_state_t));
+
+  svm_opt_state_t unknown;
+  svm_opt_state_unknown(&unknown);
+
+  for (uint32_t b = 0; b < cfg->blocks.size; ++b) {
+    if (cfg->blocks.buffer[b].entry) {
+      states[b] = unknown;
+    }
+  }
+
+  // Task starts with cleared flags, registers are provided by whoever creates it
+  if (cfg->blocks.size && !cfg->blocks.buffer[0].entry) {
+    states[0] = unknown;
+    memset(states[0].flags, 0, sizeof(states[0].flags));
+  }
+
+  // Propagate until fixed point
+  for (bool changed = true; changed; ) {
+    changed = false;
+
+    for (uint32_t b = 0; b < cfg->blocks.size; ++b) {
+      const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+      svm_opt_state_t state = states[b];
+
+      if (!state.reached) {
+        continue;
+      }
+
+      for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+        svm_opt_state_transfer(&state, &opt->insns.buffer[i]);
+      }
+
+      if (block->succ[SVM_CFG_SUCC_TARGET] != SVM_CFG_NONE) {
+        changed |= svm_opt_state_meet(&states[block->succ[SVM_CFG_SUCC_TARGET]], &state);
+      }
+
+      // Callee may do anything before returning
+      if (block->succ[SVM_CFG_SUCC_NEXT] != SVM_CFG_NONE) {
+        changed |= svm_opt_state_meet(&states[block->succ[SVM_CFG_SUCC_NEXT]], block->call ? &unknown : &state);
+      }
+    }
+  }
+
+  return states;
+}
+
+/**
+ * Single round of constant propagation - analysis over fresh graph,
+ * followed by rewriting
+ */
+static uint32_t svm_opt_constprop_round(svm_opt_t * opt) {
+  svm_cfg_t cfg;
+
+  if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  uint32_t changes = 0;
+  svm_opt_state_t * states = svm_opt_analyze(opt, &cfg);
+
+  if (!states) {
+    svm_cfg_free(&cfg);
+    return 0;
+  }
+
+  // Rewrite
+  for (uint32_t b = 0; b < cfg.blocks.size; ++b) {
+    svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+    svm_opt_state_t state = states[b];
+
+    // Unreachable code is left as is
+    if (!state.reached) {
+      continue;
+    }
+
+    for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+      svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+      if (svm_opt_is_conditional(insn->op) && insn->ext != EXT_NONE) {
+        svm_opt_flag_t condition = svm_opt_condition(&state, insn->ext);
+
+        if (condition == SVM_OPT_FLAG_FALSE) {
+          insn->removed = true;
+          changes++;
+          continue;
+        }
+
+        if (condition == SVM_OPT_FLAG_TRUE) {
+          insn->ext = EXT_NONE;
+          changes++;
+        }
+      }
+
+      int32_t lhs, rhs, result;
+
+      if (svm_opt_is_alu(insn->op) && insn->ext == EXT_NONE && svm_opt_is_reg(insn->arg1)
+          && svm_opt_arg_value(&state, insn, 0, &lhs) && svm_opt_arg_value(&state, insn, 1, &rhs)
+          && svm_opt_fold(insn->op, lhs, rhs, &result)) {
+        // mov sets the same flags
+        insn->op = OP_MOV;
+        insn->arg2 = ARG_IMM;
+        insn->value[1] = result;
+        insn->target[1] = SVM_OPT_ID_NONE;
+        changes++;
+      }
+
+      if (svm_opt_is_dead_mov(opt, block, i, &state)) {
+        insn->removed = true;
+        changes++;
+        continue;
+      }
+
+      svm_opt_state_transfer(&state, insn);
+    }
+  }
+
+  svm_free(states);
+  svm_cfg_free(&cfg);
+
+  return changes;
+}
+
+/**
+ * Returns k, if value is 2^k (k > 0), or 0 otherwise
+ */
+static uint32_t svm_opt_log2(int32_t value) {
+  if (value <= 1 || (value & (value - 1))) {
+    return 0;
+  }
+
+  uint32_t k = 0;
+
+  while (value >>= 1) {
+    k++;
+  }
+
+  return k;
+}
+
+/**
+ * Turns arithmetic instruction into it's cheaper or constant equivalent
+ *
+ * Every rewrite produces the same value, so NZ/Z are set the same way
+ */
+static bool svm_opt_reduce_insn(svm_opt_insn_t * insn, const svm_opt_state_t * state) {
+  if (!svm_opt_is_alu(insn->op) || !svm_opt_is_reg(insn->arg1)) {
+    return false;
+  }
+
+  int32_t rhs = 0;
+  bool self = insn->arg2 == insn->arg1;
+  bool known = svm_opt_arg_value(state, insn, 1, &rhs);
+
+  svm_opcode_t op = insn->op;
+  int32_t value = 0;
+
+  // Register operand, that makes instruction an identity, is replaced
+  // with immediate, so that peephole can remove it
+  svm_opt_insn_t imm = *insn;
+  imm.arg2 = ARG_IMM;
+  imm.value[1] = rhs;
+
+  if (self && (insn->op == OP_SUB || insn->op == OP_XOR)) {
+    op = OP_MOV;
+    value = 0;
+  } else if (!known) {
+    return false;
+  } else if ((insn->op == OP_MUL || insn->op == OP_AND) && rhs == 0) {
+    op = OP_MOV;
+    value = 0;
+  } else if (insn->op == OP_OR && rhs == -1) {
+    op = OP_MOV;
+    value = -1;
+  } else if (insn->op == OP_MUL && svm_opt_log2(rhs)) {
+    // Wraps the same way
+    op = OP_SHL;
+    value = svm_opt_log2(rhs);
+  } else if (insn->op == OP_DIV && svm_opt_log2(rhs) && svm_opt_arg_nonneg(state, insn, 0)) {
+    // Division truncates towards zero, but shift rounds down, so they
+    // only agree on non-negative dividend
+    op = OP_SHR;
+    value = svm_opt_log2(rhs);
+  } else if (svm_opt_is_reg(insn->arg2) && svm_opt_is_identity(&imm)) {
+    value = rhs;
+  } else {
+    return false;
+  }
+
+  insn->op = op;
+  insn->arg2 = ARG_IMM;
+  insn->value[1] = value;
+  insn->target[1] = SVM_OPT_ID_NONE;
+
+  return true;
+}
+
+/**
+ * Returns condition, that holds exactly when ext doesn't, provided
+ * their flag pair is exclusive (or EXT_MAX, if there is none)
+ */
+static svm_ext_t svm_opt_invert_ext(svm_ext_t ext) {
+  switch (ext) {
+    case EXT_EQ: return EXT_NE;
+    case EXT_NE: return EXT_EQ;
+    case EXT_LT: return EXT_GE;
+    case EXT_GE: return EXT_LT;
+    case EXT_GT: return EXT_LE;
+    case EXT_LE: return EXT_GT;
+    case EXT_NZ: return EXT_Z;
+    case EXT_Z:  return EXT_NZ;
+    default:
+      return EXT_MAX;
+  }
+}
+
+static uint32_t svm_opt_ext_pair(svm_ext_t ext) {
+  switch (ext) {
+    case EXT_EQ: case EXT_NE: return 0;
+    case EXT_LT: case EXT_GE: return 1;
+    case EXT_GT: case EXT_LE: return 2;
+    default:
+      return 3;
+  }
+}
+
+static bool svm_opt_pairs_meet(svm_opt_pairs_t * dst, const svm_opt_pairs_t * src) {
+  if (!src->reached) {
+    return false;
+  }
+
+  if (!dst->reached) {
+    *dst = *src;
+    return true;
+  }
+
+  bool changed = false;
+
+  for (uint32_t pair = 0; pair < 4; ++pair) {
+    if (dst->pairs[pair] != src->pairs[pair] && dst->pairs[pair] != SVM_OPT_PAIR_UNKNOWN) {
+      dst->pairs[pair] = SVM_OPT_PAIR_UNKNOWN;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static void svm_opt_pairs_set(svm_opt_pairs_t * pairs, uint32_t pair) {
+  // Setting one flag of a clean pair makes it exclusive, but the other
+  // one may already be set
+  pairs->pairs[pair] = pairs->pairs[pair] == SVM_OPT_PAIR_CLEAN ? SVM_OPT_PAIR_EXCLUSIVE : SVM_OPT_PAIR_UNKNOWN;
+}
+
+static void svm_opt_pairs_transfer(svm_opt_pairs_t * pairs, const svm_opt_insn_t * insn) {
+  svm_opt_pairs_t executed = *pairs;
+
+  switch (insn->op) {
+    case OP_CLF:
+      for (uint32_t pair = 0; pair < 4; ++pair) {
+        if (insn->ext == EXT_NONE) {
+          pairs->pairs[pair] = SVM_OPT_PAIR_CLEAN;
+        } else if (svm_opt_ext_pair(insn->ext) == pair && pairs->pairs[pair] != SVM_OPT_PAIR_CLEAN) {
+          pairs->pairs[pair] = SVM_OPT_PAIR_UNKNOWN;
+        }
+      }
+      return;
+
+    case OP_CMP:
+      for (uint32_t pair = 0; pair < 3; ++pair) {
+        svm_opt_pairs_set(pairs, pair);
+      }
+      return;
+
+    case OP_SYS:
+      for (uint32_t pair = 0; pair < 4; ++pair) {
+        pairs->pairs[pair] = SVM_OPT_PAIR_UNKNOWN;
+      }
+      return;
+
+    case OP_MOV:
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_SHL:
+    case OP_SHR:
+      svm_opt_pairs_set(&executed, 3);
+
+      if (insn->ext == EXT_NONE) {
+        *pairs = executed;
+      } else {
+        svm_opt_pairs_meet(pairs, &executed);
+      }
+      return;
+
+    default:
+      return;
+  }
+}
+
+/**
+ * Checks if conditional jump can be inverted, given the state of flag pairs before it
+ */
+static bool svm_opt_invertible(const svm_opt_insn_t * insn, const svm_opt_pairs_t * pairs) {
+  return svm_opt_invert_ext(insn->ext) != EXT_MAX
+      && pairs->pairs[svm_opt_ext_pair(insn->ext)] == SVM_OPT_PAIR_EXCLUSIVE;
+}
+
+/**
+ * Finds blocks, at the end of which flag pairs are exclusive, so
+ * conditional jump can be inverted
+ *
+ * @param pairs State at the end of each block
+ */
+static void svm_opt_pairs_analyze(const svm_opt_t * opt, const svm_cfg_t * cfg, svm_opt_pairs_t * pairs) {
+  svm_opt_pairs_t unknown = {.reached = true};
+  svm_opt_pairs_t * in = svm_malloc((cfg->blocks.size + 1) * sizeof(svm_opt_pairs_t));
+
+  memset(pairs, 0, cfg->blocks.size * sizeof(svm_opt_pairs_t));
+
+  if (!in) {
+    return;
+  }
+
+  memset(in, 0, (cfg->blocks.size + 1) * sizeof(svm_opt_pairs_t));
+
+  for (uint32_t pair = 0; pair < 4; ++pair) {
+    unknown.pairs[pair] = SVM_OPT_PAIR_UNKNOWN;
+  }
+
+  for (uint32_t b = 0; b < cfg->blocks.size; ++b) {
+    if (cfg->blocks.buffer[b].entry) {
+      in[b] = unknown;
+    }
+  }
+
+  // Task starts with cleared flags
+  if (cfg->blocks.size && !cfg->blocks.buffer[0].entry) {
+    in[0].reached = true;
+  }
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+
+    for (uint32_t b = 0; b < cfg->blocks.size; ++b) {
+      const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+      svm_opt_pairs_t state = in[b];
+
+      if (!state.reached) {
+        continue;
+      }
+
+      for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+        svm_opt_pairs_transfer(&state, &opt->insns.buffer[i]);
+      }
+
+      pairs[b] = state;
+
+      if (block->succ[SVM_CFG_SUCC_TARGET] != SVM_CFG_NONE) {
+        changed |= svm_opt_pairs_meet(&in[block->succ[SVM_CFG_SUCC_TARGET]], &state);
+      }
+
+      if (block->succ[SVM_CFG_SUCC_NEXT] != SVM_CFG_NONE) {
+        changed |= svm_opt_pairs_meet(&in[block->succ[SVM_CFG_SUCC_NEXT]], block->call ? &unknown : &state);
+      }
+    }
+  }
+
+  svm_free(in);
+}
+
+/**
+ * Points all references to live instructions, and drops removed ones
+ */
+static svm_asm_error_t svm_opt_compact(svm_opt_t * opt) {
+  uint32_t * map = svm_opt_index_map(opt);
+  SVM_ASSERT_RETURN(map, SVM_ASM_ERR_BAD_ALLOC);
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    for (uint32_t arg = 0; arg < 2; ++arg) {
+      uint32_t id = opt->insns.buffer[i].target[arg];
+
+      if (id != SVM_OPT_ID_NONE && id != SVM_OPT_ID_END) {
+        uint32_t index = svm_opt_resolve(opt, map, id);
+        opt->insns.buffer[i].target[arg] = index < opt->insns.size ? opt->insns.buffer[index].id : SVM_OPT_ID_END;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; opt->ctx && i < opt->ctx->labels.size; ++i) {
+    if (opt->labels[i] != SVM_OPT_ID_END) {
+      uint32_t index = svm_opt_resolve(opt, map, opt->labels[i]);
+      opt->labels[i] = index < opt->insns.size ? opt->insns.buffer[index].id : SVM_OPT_ID_END;
+    }
+  }
+
+  uint32_t size = 0;
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    if (!opt->insns.buffer[i].removed) {
+      opt->insns.buffer[size++] = opt->insns.buffer[i];
+    }
+  }
+
+  opt->insns.size = size;
+
+  svm_free(map);
+
+  return SVM_ASM_OK;
+}
+
+/**
+ * Appends unconditional jump to instruction id to instruction buffer
+ */
+static void svm_opt_push_jmp(svm_opt_t * opt, svm_opt_insn_t * buffer, uint32_t * size, uint32_t target, uint32_t line) {
+  svm_opt_insn_t * jmp = &buffer[(*size)++];
+
+  memset(jmp, 0, sizeof(*jmp));
+  jmp->id = opt->next_id++;
+  jmp->address = SVM_OPT_ADDRESS_NONE;
+  jmp->line = line;
+  jmp->op = OP_JMP;
+  jmp->ext = EXT_NONE;
+  jmp->arg1 = opt->ctx ? ARG_REL : ARG_IMM;
+  jmp->arg2 = ARG_NONE;
+  jmp->target[0] = target;
+  jmp->target[1] = SVM_OPT_ID_NONE;
+}
+
+/**
+ * Rebuilds instruction list from blocks in given order, fixing up fall through
+ *
+ * Unconditional jump to the next block in order is removed, conditional one
+ * is inverted if possible, where fall through is broken, jump is inserted
+ *
+ * @param order Blocks in new order (every block exactly once, block 0 first)
+ * @param pairs State of flag pairs at the end of each block
+ *
+ * @returns Count of removed and inverted jumps
+ */
+static uint32_t svm_opt_place(svm_opt_t * opt, const svm_cfg_t * cfg, const uint32_t * order, uint32_t count, const svm_opt_pairs_t * pairs) {
+  // Every block may need an extra jump
+  svm_opt_insn_t * buffer = svm_malloc((opt->insns.size + count + 1) * sizeof(svm_opt_insn_t));
+  SVM_ASSERT_RETURN(buffer, 0);
+
+  uint32_t changes = 0;
+  uint32_t size = 0;
+
+  for (uint32_t o = 0; o < count; ++o) {
+    const svm_cfg_block_t * block = &cfg->blocks.buffer[order[o]];
+    uint32_t layout_next = o + 1 < count ? order[o + 1] : SVM_CFG_NONE;
+    uint32_t target = block->succ[SVM_CFG_SUCC_TARGET];
+    uint32_t next = block->succ[SVM_CFG_SUCC_NEXT];
+    uint32_t next_id = next != SVM_CFG_NONE ? opt->insns.buffer[cfg->blocks.buffer[next].first].id : SVM_OPT_ID_NONE;
+
+    memcpy(&buffer[size], &opt->insns.buffer[block->first], (block->last - block->first + 1) * sizeof(svm_opt_insn_t));
+    size += block->last - block->first + 1;
+
+    svm_opt_insn_t * last = &buffer[size - 1];
+
+    if (last->op == OP_JMP && last->ext == EXT_NONE) {
+      // Kept as removed, so that references to it resolve to the target
+      if (target != SVM_CFG_NONE && target == layout_next) {
+        last->removed = true;
+        changes++;
+      }
+    } else if (last->op == OP_JMP && target != SVM_CFG_NONE) {
+      if (target == layout_next && next != SVM_CFG_NONE && svm_opt_invertible(last, &pairs[order[o]])) {
+        last->ext = svm_opt_invert_ext(last->ext);
+        last->target[0] = next_id;
+        changes++;
+      } else if (next != SVM_CFG_NONE && next != layout_next) {
+        svm_opt_push_jmp(opt, buffer, &size, next_id, last->line);
+      }
+    } else if (last->op != OP_RET && last->op != OP_END) {
+      if (next != SVM_CFG_NONE && next != layout_next) {
+        svm_opt_push_jmp(opt, buffer, &size, next_id, last->line);
+      }
+    }
+  }
+
+  svm_free(opt->insns.buffer);
+  opt->insns.buffer = buffer;
+  opt->insns.size = size;
+  opt->insns.capacity = opt->insns.size + count + 1;
+
+  return changes;
+}
+
+/**
+ * Follows chain of jumps, that are taken whenever jump with condition
+ * ext into id is taken (jumps don't change flags)
+ *
+ * @returns Id of the final target
+ */
+static uint32_t svm_opt_thread_target(const svm_opt_t * opt, const uint32_t * map, uint32_t id, svm_ext_t ext) {
+  // Chain can't be longer than code, unless it loops
+  for (uint32_t steps = 0; steps < opt->insns.size; ++steps) {
+    uint32_t index = svm_opt_resolve(opt, map, id);
+
+    if (index >= opt->insns.size) {
+      break;
+    }
+
+    const svm_opt_insn_t * insn = &opt->insns.buffer[index];
+
+    if (insn->op != OP_JMP || insn->target[0] == SVM_OPT_ID_NONE || (insn->ext != EXT_NONE && insn->ext != ext)) {
+      break;
+    }
+
+    id = insn->target[0];
+  }
+
+  return id;
+}
+
+/**
+ * Redirects jumps & invokes to the end of jump chains, and replaces
+ * unconditional jumps to ret or end with the instruction itself
+ */
+static uint32_t svm_opt_thread_jumps(svm_opt_t * opt) {
+  uint32_t * map = svm_opt_index_map(opt);
+  SVM_ASSERT_RETURN(map, 0);
+
+  uint32_t changes = 0;
+
+  for (uint32_t i = svm_opt_next_live(opt, 0); i < opt->insns.size; i = svm_opt_next_live(opt, i + 1)) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if ((insn->op != OP_JMP && insn->op != OP_INV) || insn->target[0] == SVM_OPT_ID_NONE) {
+      continue;
+    }
+
+    uint32_t id = svm_opt_thread_target(opt, map, insn->target[0], insn->ext);
+
+    if (svm_opt_resolve(opt, map, id) != svm_opt_resolve(opt, map, insn->target[0])) {
+      insn->target[0] = id;
+      changes++;
+    }
+
+    uint32_t index = svm_opt_resolve(opt, map, insn->target[0]);
+
+    if (insn->op == OP_JMP && insn->ext == EXT_NONE && index < opt->insns.size
+        && (opt->insns.buffer[index].op == OP_RET || opt->insns.buffer[index].op == OP_END)) {
+      insn->op = opt->insns.buffer[index].op;
+      insn->arg1 = ARG_NONE;
+      insn->arg2 = ARG_NONE;
+      insn->value[0] = 0;
+      insn->value[1] = 0;
+      insn->target[0] = SVM_OPT_ID_NONE;
+      insn->target[1] = SVM_OPT_ID_NONE;
+      changes++;
+    }
+  }
+
+  svm_free(map);
+
+  return changes;
+}
+
+/**
+ * Moves blocks, entered only by unconditional jump from another block,
+ * right after that block, so the jump can be dropped
+ */
+static uint32_t svm_opt_merge_blocks(svm_opt_t * opt) {
+  if (svm_opt_compact(opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  svm_cfg_t cfg;
+
+  if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  uint32_t blocks = cfg.blocks.size;
+  uint32_t changes = 0;
+  bool merged = false;
+
+  uint32_t * follow = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * prev = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * order = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  svm_opt_pairs_t * pairs = svm_malloc((blocks + 1) * sizeof(svm_opt_pairs_t));
+
+  if (!follow || !prev || !order || !pairs) {
+    goto exit;
+  }
+
+  memset(follow, 0xFF, (blocks + 1) * sizeof(uint32_t));
+  memset(prev, 0xFF, (blocks + 1) * sizeof(uint32_t));
+
+  for (uint32_t a = 0; a < blocks; ++a) {
+    const svm_opt_insn_t * last = &opt->insns.buffer[cfg.blocks.buffer[a].last];
+    uint32_t b = cfg.blocks.buffer[a].succ[SVM_CFG_SUCC_TARGET];
+
+    if (last->op != OP_JMP || last->ext != EXT_NONE || b == SVM_CFG_NONE || b == 0 || b == a) {
+      continue;
+    }
+
+    const svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+    const svm_opt_insn_t * end = &opt->insns.buffer[block->last];
+
+    // Moved block must not fall through anywhere, including past the end of code
+    if (block->entry || block->preds != 1
+        || (end->op != OP_RET && end->op != OP_END && (end->op != OP_JMP || end->ext != EXT_NONE))) {
+      continue;
+    }
+
+    // Attaching b to a block, that is itself attached to b, would lose both
+    uint32_t head = a;
+
+    while (prev[head] != SVM_CFG_NONE && head != b) {
+      head = prev[head];
+    }
+
+    if (head == b) {
+      continue;
+    }
+
+    follow[a] = b;
+    prev[b] = a;
+    merged = true;
+  }
+
+  if (!merged) {
+    goto exit;
+  }
+
+  uint32_t count = 0;
+
+  for (uint32_t b = 0; b < blocks; ++b) {
+    for (uint32_t c = prev[b] == SVM_CFG_NONE ? b : SVM_CFG_NONE; c != SVM_CFG_NONE; c = follow[c]) {
+      order[count++] = c;
+    }
+  }
+
+  svm_opt_pairs_analyze(opt, &cfg, pairs);
+  changes = svm_opt_place(opt, &cfg, order, count, pairs);
+
+exit:
+  svm_free(follow);
+  svm_free(prev);
+  svm_free(order);
+  svm_free(pairs);
+  svm_cfg_free(&cfg);
+
+  return changes;
+}
+
+/**
+ * Finds body of subroutine, that can be inlined - single entry, straight
+ * line code, that ends with ret, without jumps or calls
+ *
+ * @param entries Instructions, that can be entered other than by falling through
+ * @param first Index of the first instruction of subroutine
+ * @param max_size Max instruction count of body (ret excluded)
+ * @param size Will contain instruction count of body
+ */
+static bool svm_opt_inline_body(const svm_opt_t * opt, const bool * entries, uint32_t first, uint32_t max_size, uint32_t * size) {
+  *size = 0;
+
+  for (uint32_t i = first; i < opt->insns.size; i = svm_opt_next_live(opt, i + 1)) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (insn->op == OP_RET) {
+      return true;
+    }
+
+    if (insn->op == OP_JMP || insn->op == OP_INV || insn->op == OP_END || (i != first && entries[i])) {
+      return false;
+    }
+
+    if (++*size > max_size) {
+      return false;
+    }
+  }
+
+  // Falls through past the end of code
+  return false;
+}
+
+/**
+ * Computes max count of nested calls, function at entry block can make
+ *
+ * @param depth Depth of every function, indexed by entry block
+ *
+ * @returns Depth or SVM_OPT_DEPTH_UNKNOWN, if function is recursive
+ */
+static uint32_t svm_opt_function_depth(const svm_cfg_t * cfg, uint32_t entry, uint32_t * depth) {
+  if (depth[entry] == SVM_OPT_DEPTH_VISITING) {
+    return SVM_OPT_DEPTH_UNKNOWN;
+  }
+
+  if (depth[entry] != SVM_OPT_DEPTH_NONE) {
+    return depth[entry];
+  }
+
+  depth[entry] = SVM_OPT_DEPTH_VISITING;
+
+  uint32_t result = 0;
+  uint32_t count = 0;
+  uint32_t * work = svm_malloc((cfg->blocks.size + 1) * sizeof(uint32_t));
+  bool * seen = svm_malloc((cfg->blocks.size + 1) * sizeof(bool));
+
+  if (!work || !seen) {
+    result = SVM_OPT_DEPTH_UNKNOWN;
+    goto exit;
+  }
+
+  memset(seen, 0, (cfg->blocks.size + 1) * sizeof(bool));
+
+  seen[entry] = true;
+  work[count++] = entry;
+
+  // Walk blocks of the function, call edges lead into callees
+  while (count && result != SVM_OPT_DEPTH_UNKNOWN) {
+    const svm_cfg_block_t * block = &cfg->blocks.buffer[work[--count]];
+
+    for (uint32_t s = 0; s < 2; ++s) {
+      uint32_t succ = block->succ[s];
+
+      if (succ == SVM_CFG_NONE) {
+        continue;
+      }
+
+      if (s == SVM_CFG_SUCC_TARGET && block->call) {
+        uint32_t callee = svm_opt_function_depth(cfg, succ, depth);
+        result = callee == SVM_OPT_DEPTH_UNKNOWN ? SVM_OPT_DEPTH_UNKNOWN : (callee + 1 > result ? callee + 1 : result);
+        continue;
+      }
+
+      if (!seen[succ]) {
+        seen[succ] = true;
+        work[count++] = succ;
+      }
+    }
+  }
+
+exit:
+  svm_free(work);
+  svm_free(seen);
+
+  depth[entry] = result;
+
+  return result;
+}
+
+/**
+ * Single round of inlining, inlined bodies may become inlinable themselves
+ */
+static uint32_t svm_opt_inline_round(svm_opt_t * opt, uint32_t max_size, int32_t * words) {
+  uint32_t * map = svm_opt_index_map(opt);
+  bool * entries = map ? svm_opt_entries(opt, map) : NULL;
+  uint32_t * bodies = svm_malloc((opt->insns.size + 1) * sizeof(uint32_t));
+  uint32_t * sizes = svm_malloc((opt->insns.size + 1) * sizeof(uint32_t));
+  svm_opt_insn_t * buffer = NULL;
+
+  uint32_t inlined = 0;
+  uint32_t total = opt->insns.size;
+
+  if (!map || !entries || !bodies || !sizes || !max_size) {
+    goto exit;
+  }
+
+  // Find call sites
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    bodies[i] = SVM_OPT_ID_NONE;
+
+    // Conditional call can't be inlined, as body may change flags
+    if (insn->removed || insn->op != OP_INV || insn->ext != EXT_NONE || insn->target[0] == SVM_OPT_ID_NONE) {
+      continue;
+    }
+
+    uint32_t first = svm_opt_resolve(opt, map, insn->target[0]);
+
+    if (first < opt->insns.size && svm_opt_inline_body(opt, entries, first, max_size, &sizes[i])) {
+      bodies[i] = first;
+      total += sizes[i];
+      inlined++;
+    }
+  }
+
+  if (!inlined) {
+    goto exit;
+  }
+
+  buffer = svm_malloc((total + 1) * sizeof(svm_opt_insn_t));
+
+  if (!buffer) {
+    inlined = 0;
+    goto exit;
+  }
+
+  // Replace call sites with copies of bodies
+  uint32_t size = 0;
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    svm_opt_insn_t * call = &opt->insns.buffer[i];
+
+    if (bodies[i] == SVM_OPT_ID_NONE) {
+      buffer[size++] = *call;
+      continue;
+    }
+
+    *words -= svm_opt_insn_size(call);
+
+    // Call site keeps it's id, so references to it land on the body,
+    // or on whatever follows, if body is empty
+    uint32_t copied = 0;
+
+    for (uint32_t j = bodies[i]; copied < sizes[i]; j = svm_opt_next_live(opt, j + 1), ++copied) {
+      svm_opt_insn_t * insn = &buffer[size++];
+
+      *insn = opt->insns.buffer[j];
+      insn->id = copied ? opt->next_id++ : call->id;
+      insn->address = copied ? SVM_OPT_ADDRESS_NONE : call->address;
+
+      *words += svm_opt_insn_size(insn);
+    }
+
+    if (!copied) {
+      buffer[size] = *call;
+      buffer[size++].removed = true;
+    }
+  }
+
+  svm_free(opt->insns.buffer);
+  opt->insns.buffer = buffer;
+  opt->insns.size = size;
+  opt->insns.capacity = total + 1;
+
+exit:
+  svm_free(map);
+  svm_free(entries);
+  svm_free(bodies);
+  svm_free(sizes);
+
+  return inlined;
+}
+
+static svm_opt_regs_t svm_opt_reg_mask(svm_arg_type_t arg) {
+  return svm_opt_is_reg(arg) ? 1u << svm_arg_to_reg(arg) : 0;
+}
+
+static svm_opt_regs_t svm_opt_range_mask(const svm_opt_insn_t * insn) {
+  if (!svm_opt_is_reg(insn->arg1)) {
+    return 0;
+  }
+
+  svm_register_t from, to;
+  svm_opt_reg_range(insn, &from, &to);
+
+  return (svm_opt_regs_t) (((1ull << (to + 1)) - 1) & ~((1ull << from) - 1));
+}
+
+/**
+ * Returns function, called by inv (or NULL if it's not known)
+ */
+static const svm_opt_func_t * svm_opt_callee(const svm_opt_t * opt, const svm_cfg_t * cfg, const uint32_t * map, const svm_opt_func_t * funcs, const svm_opt_insn_t * insn) {
+  if (insn->op != OP_INV || insn->target[0] == SVM_OPT_ID_NONE) {
+    return NULL;
+  }
+
+  uint32_t index = svm_opt_resolve(opt, map, insn->target[0]);
+
+  return index < opt->insns.size ? &funcs[cfg->block[index]] : NULL;
+}
+
+/**
+ * Registers, instruction may read
+ */
+static svm_opt_regs_t svm_opt_insn_uses(const svm_opt_insn_t * insn, const svm_opt_func_t * callee) {
+  switch (insn->op) {
+    case OP_NOP:
+    case OP_END:
+    case OP_RET:
+    case OP_CLF:
+    case OP_POP:
+      return 0;
+
+    case OP_MOV:
+      return svm_opt_reg_mask(insn->arg2);
+
+    case OP_PUSH:
+      return svm_opt_range_mask(insn);
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_SHL:
+    case OP_SHR:
+    case OP_CMP:
+    case OP_JMP:
+      return svm_opt_reg_mask(insn->arg1) | svm_opt_reg_mask(insn->arg2);
+
+    case OP_INV:
+      return svm_opt_reg_mask(insn->arg1) | (callee ? callee->uses : SVM_OPT_REGS_ALL);
+
+    // System call handler gets all registers
+    case OP_SYS:
+    default:
+      return SVM_OPT_REGS_ALL;
+  }
+}
+
+/**
+ * Registers, instruction may write
+ */
+static svm_opt_regs_t svm_opt_insn_defs(const svm_opt_insn_t * insn, const svm_opt_func_t * callee) {
+  switch (insn->op) {
+    case OP_MOV:
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_AND:
+    case OP_OR:
+    case OP_XOR:
+    case OP_SHL:
+    case OP_SHR:
+      return svm_opt_reg_mask(insn->arg1);
+
+    case OP_POP:
+      return svm_opt_range_mask(insn);
+
+    case OP_INV:
+      return callee ? callee->clobbers : SVM_OPT_REGS_ALL;
+
+    case OP_SYS:
+      return SVM_OPT_REGS_ALL;
+
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Registers, instruction surely writes
+ */
+static svm_opt_regs_t svm_opt_insn_kills(const svm_opt_insn_t * insn) {
+  if (insn->ext != EXT_NONE || insn->op == OP_INV || insn->op == OP_SYS) {
+    return 0;
+  }
+
+  return svm_opt_insn_defs(insn, NULL);
+}
+
+/**
+ * Returns count of words, instruction pushes to stack (negative for pop)
+ */
+static int32_t svm_opt_stack_delta(const svm_opt_insn_t * insn) {
+  svm_register_t from, to;
+
+  switch (insn->op) {
+    case OP_PUSH:
+      if (!svm_opt_is_reg(insn->arg1)) {
+        return 1;
+      }
+      svm_opt_reg_range(insn, &from, &to);
+      return to - from + 1;
+
+    case OP_POP:
+      svm_opt_reg_range(insn, &from, &to);
+      return -(to - from + 1);
+
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Computes summary of function at entry block from summaries of it's callees
+ *
+ * @param depth Scratch, stack depth for every block
+ * @param work Scratch, block worklist
+ */
+static svm_opt_func_t svm_opt_func_summarize(
+    const svm_opt_t * opt,
+    const svm_cfg_t * cfg,
+    const uint32_t * map,
+    const svm_opt_func_t * funcs,
+    uint32_t entry,
+    int32_t * depth,
+    uint32_t * work
+) {
+  svm_opt_func_t func = {.function = true, .balanced = true};
+  uint32_t count = 0;
+
+  for (uint32_t b = 0; b < cfg->blocks.size; ++b) {
+    depth[b] = SVM_OPT_STACK_NONE;
+  }
+
+  depth[entry] = 0;
+  work[count++] = entry;
+
+  while (count) {
+    uint32_t b = work[--count];
+    const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+    int32_t sp = depth[b];
+
+    for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+      const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+      const svm_opt_func_t * callee = svm_opt_callee(opt, cfg, map, funcs, insn);
+
+      func.uses |= svm_opt_insn_uses(insn, callee);
+      func.clobbers |= svm_opt_insn_defs(insn, callee);
+
+      if (svm_opt_stack_delta(insn) && insn->ext != EXT_NONE) {
+        func.balanced = false;
+      }
+
+      if (insn->op == OP_INV && (!callee || !callee->balanced)) {
+        func.balanced = false;
+      }
+
+      sp += svm_opt_stack_delta(insn);
+
+      if (sp < 0 || (insn->op == OP_RET && sp != 0)) {
+        func.balanced = false;
+      }
+    }
+
+    for (uint32_t s = 0; s < 2; ++s) {
+      uint32_t succ = block->succ[s];
+
+      // Callee is summarized on it's own
+      if (succ == SVM_CFG_NONE || (s == SVM_CFG_SUCC_TARGET && block->call)) {
+        continue;
+      }
+
+      if (depth[succ] == SVM_OPT_STACK_NONE) {
+        depth[succ] = sp;
+        work[count++] = succ;
+      } else if (depth[succ] != sp) {
+        func.balanced = false;
+      }
+    }
+  }
+
+  return func;
+}
+
+/**
+ * Computes registers, live before instruction at index from, given
+ * registers live at the end of it's block
+ */
+static svm_opt_regs_t svm_opt_live_before(
+    const svm_opt_t * opt,
+    const svm_cfg_t * cfg,
+    const uint32_t * map,
+    const svm_opt_func_t * funcs,
+    const svm_cfg_block_t * block,
+    uint32_t from,
+    svm_opt_regs_t live
+) {
+  for (uint32_t i = block->last + 1; i-- > from; ) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (!insn->removed) {
+      live = (live & ~svm_opt_insn_kills(insn)) | svm_opt_insn_uses(insn, svm_opt_callee(opt, cfg, map, funcs, insn));
+    }
+  }
+
+  return live;
+}
+
+/**
+ * Registers, live at the end of block
+ */
+static svm_opt_regs_t svm_opt_live_out(const svm_opt_t * opt, const svm_cfg_t * cfg, const svm_opt_regs_t * live_in, uint32_t b) {
+  const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+  const svm_opt_insn_t * last = &opt->insns.buffer[block->last];
+
+  // Caller is unknown
+  if (last->op == OP_RET) {
+    return SVM_OPT_REGS_ALL;
+  }
+
+  svm_opt_regs_t live = 0;
+
+  // Callee's reads are accounted for by inv itself
+  if (block->succ[SVM_CFG_SUCC_TARGET] != SVM_CFG_NONE && !block->call) {
+    live |= live_in[block->succ[SVM_CFG_SUCC_TARGET]];
+  }
+
+  if (block->succ[SVM_CFG_SUCC_NEXT] != SVM_CFG_NONE) {
+    live |= live_in[block->succ[SVM_CFG_SUCC_NEXT]];
+  }
+
+  return live;
+}
+
+/**
+ * Summarizes every function, that is called directly
+ *
+ * @param funcs Will contain summary for every block (function is set only for entries)
+ * @param depth Scratch, stack depth for every block
+ * @param work Scratch, block worklist
+ */
+static void svm_opt_summarize(
+    const svm_opt_t * opt,
+    const svm_cfg_t * cfg,
+    const uint32_t * map,
+    svm_opt_func_t * funcs,
+    int32_t * depth,
+    uint32_t * work
+) {
+  uint32_t blocks = cfg->blocks.size;
+
+  memset(funcs, 0, (blocks + 1) * sizeof(svm_opt_func_t));
+
+  for (uint32_t b = 0; b < blocks; ++b) {
+    const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+
+    if (block->call && block->succ[SVM_CFG_SUCC_TARGET] != SVM_CFG_NONE) {
+      funcs[block->succ[SVM_CFG_SUCC_TARGET]].function = true;
+      funcs[block->succ[SVM_CFG_SUCC_TARGET]].balanced = true;
+    }
+  }
+
+  // Summaries only grow (and balance is only lost), until fixed point
+  for (bool changed = true; changed; ) {
+    changed = false;
+
+    for (uint32_t b = 0; b < blocks; ++b) {
+      if (!funcs[b].function) {
+        continue;
+      }
+
+      svm_opt_func_t func = svm_opt_func_summarize(opt, cfg, map, funcs, b, depth, work);
+
+      func.uses |= funcs[b].uses;
+      func.clobbers |= funcs[b].clobbers;
+      func.balanced &= funcs[b].balanced;
+
+      if (func.uses != funcs[b].uses || func.clobbers != funcs[b].clobbers || func.balanced != funcs[b].balanced) {
+        funcs[b] = func;
+        changed = true;
+      }
+    }
+  }
+}
+
+/**
+ * Computes registers, live at the start of every block
+ */
+static void svm_opt_liveness(
+    const svm_opt_t * opt,
+    const svm_cfg_t * cfg,
+    const uint32_t * map,
+    const svm_opt_func_t * funcs,
+    svm_opt_regs_t * live_in
+) {
+  uint32_t blocks = cfg->blocks.size;
+
+  memset(live_in, 0, (blocks + 1) * sizeof(svm_opt_regs_t));
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+
+    for (uint32_t b = blocks; b-- > 0; ) {
+      const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+      svm_opt_regs_t live = svm_opt_live_before(
+          opt, cfg, map, funcs, block, block->first, svm_opt_live_out(opt, cfg, live_in, b)
+      );
+
+      if ((live_in[b] | live) != live_in[b]) {
+        live_in[b] |= live;
+        changed = true;
+      }
+    }
+  }
+}
+
+/**
+ * Narrows push & pop around call in block b to registers, that are
+ * both clobbered and live after pop
+ *
+ * @returns true if push & pop were changed
+ */
+static bool svm_opt_shrink_save(
+    svm_opt_t * opt,
+    const svm_cfg_t * cfg,
+    const uint32_t * map,
+    const svm_opt_func_t * funcs,
+    const svm_opt_regs_t * live_in,
+    uint32_t b
+) {
+  const svm_cfg_block_t * block = &cfg->blocks.buffer[b];
+  const svm_opt_insn_t * call = &opt->insns.buffer[block->last];
+  const svm_opt_func_t * callee = svm_opt_callee(opt, cfg, map, funcs, call);
+  uint32_t next = block->succ[SVM_CFG_SUCC_NEXT];
+
+  if (!block->call || !callee || !callee->balanced || next == SVM_CFG_NONE
+      || cfg->blocks.buffer[next].preds != 1 || cfg->blocks.buffer[next].entry) {
+    return false;
+  }
+
+  // Registers, that may change between push and pop
+  svm_opt_regs_t clobbers = callee->clobbers;
+  svm_opt_insn_t * push = NULL;
+  svm_opt_insn_t * pop = NULL;
+
+  for (uint32_t i = block->last; i-- > block->first; ) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (insn->removed) {
+      continue;
+    }
+
+    if (insn->op == OP_PUSH) {
+      push = insn;
+      break;
+    }
+
+    if (svm_opt_stack_delta(insn) || insn->op == OP_INV) {
+      return false;
+    }
+
+    clobbers |= svm_opt_insn_defs(insn, NULL);
+  }
+
+  const svm_cfg_block_t * site = &cfg->blocks.buffer[next];
+  uint32_t pop_index = site->first;
+
+  for (; pop_index <= site->last; pop_index = svm_opt_next_live(opt, pop_index + 1)) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[pop_index];
+
+    if (insn->op == OP_POP) {
+      pop = insn;
+      break;
+    }
+
+    if (svm_opt_stack_delta(insn) || insn->op == OP_INV) {
+      return false;
+    }
+
+    clobbers |= svm_opt_insn_defs(insn, NULL);
+  }
+
+  if (!push || !pop || push->ext != EXT_NONE || pop->ext != EXT_NONE
+      || !svm_opt_is_reg(push->arg1) || push->arg1 != pop->arg1 || push->arg2 != pop->arg2) {
+    return false;
+  }
+
+  svm_opt_regs_t saved = svm_opt_range_mask(push);
+  svm_opt_regs_t live = svm_opt_live_before(
+      opt, cfg, map, funcs, site, pop_index + 1, svm_opt_live_out(opt, cfg, live_in, next)
+  );
+  svm_opt_regs_t needed = saved & clobbers & live;
+
+  if (needed == saved) {
+    return false;
+  }
+
+  if (!needed) {
+    push->removed = true;
+    pop->removed = true;
+    return true;
+  }
+
+  // Only contiguous range can be pushed
+  svm_register_t from = __builtin_ctz(needed), to = 31 - __builtin_clz(needed);
+  svm_arg_type_t arg1 = (svm_arg_type_t) (ARG_R0 + from);
+  svm_arg_type_t arg2 = from == to ? ARG_NONE : (svm_arg_type_t) (ARG_R0 + to);
+
+  if (arg1 == push->arg1 && arg2 == push->arg2) {
+    return false;
+  }
+
+  push->arg1 = pop->arg1 = arg1;
+  push->arg2 = pop->arg2 = arg2;
+
+  return true;
+}
+
+/**
+ * Checks if instruction reads or may clear NZ/Z flags
+ */
+static bool svm_opt_nz_z_dependent(const svm_opt_insn_t * insn) {
+  if (insn->op == OP_CLF) {
+    return insn->ext == EXT_NONE || insn->ext == EXT_NZ || insn->ext == EXT_Z;
+  }
+
+  return insn->ext == EXT_NZ || insn->ext == EXT_Z;
+}
+
+/**
+ * Collects natural loop of header h - blocks, from which source of a back
+ * edge into h is reached without passing through h
+ *
+ * @param pred_first Start of predecessor list of every block in preds (blocks + 1 entries)
+ * @param preds Predecessors of blocks, grouped by block
+ * @param body Will mark blocks of the loop
+ * @param work Scratch, block worklist
+ *
+ * @returns Count of blocks in the loop (0 if h isn't a header, or loop
+ *          can be entered not through it)
+ */
+static uint32_t svm_opt_loop_body(
+    const svm_cfg_t * cfg,
+    const uint32_t * pred_first,
+    const uint32_t * preds,
+    uint32_t h,
+    bool * body,
+    uint32_t * work
+) {
+  uint32_t count = 0, size = 1;
+
+  memset(body, 0, cfg->blocks.size * sizeof(bool));
+  body[h] = true;
+
+  bool latched = false;
+
+  for (uint32_t p = pred_first[h]; p < pred_first[h + 1]; ++p) {
+    if (svm_cfg_dominates(cfg, h, preds[p])) {
+      latched = true;
+
+      if (!body[preds[p]]) {
+        body[preds[p]] = true;
+        work[count++] = preds[p];
+        size++;
+      }
+    }
+  }
+
+  while (count) {
+    uint32_t b = work[--count];
+
+    // Every block of a loop must be entered through header
+    if (!svm_cfg_dominates(cfg, h, b)) {
+      return 0;
+    }
+
+    for (uint32_t p = pred_first[b]; p < pred_first[b + 1]; ++p) {
+      if (!body[preds[p]]) {
+        body[preds[p]] = true;
+        work[count++] = preds[p];
+        size++;
+      }
+    }
+  }
+
+  return latched ? size : 0;
+}
+
+/**
+ * Selects invariant instructions of loop, that can be moved into it's preheader
+ *
+ * @param cands Blocks, that run on every iteration, in dominance order
+ * @param writes Count of instructions in the loop, that may write each register
+ * @param written Registers, that may be written in the loop
+ * @param live Registers, live at loop header
+ * @param hoist Will mark selected instructions
+ *
+ * @returns Count of selected instructions
+ */
+static uint32_t svm_opt_loop_invariants(
+    const svm_opt_t * opt,
+    const svm_cfg_t * cfg,
+    const uint32_t * cands,
+    uint32_t count,
+    const uint32_t * writes,
+    svm_opt_regs_t written,
+    svm_opt_regs_t live,
+    bool * hoist
+) {
+  svm_opt_regs_t banned = live;
+  uint32_t hoisted[R_MAX];
+  uint32_t chain[R_MAX];
+  uint32_t selected;
+
+  for (;;) {
+    memset(hoisted, 0, sizeof(hoisted));
+    memset(chain, 0xFF, sizeof(chain));
+    selected = 0;
+
+    // Destination, hoisted from more than one place, or read by the loop
+    // in between hoisted writes, would be seen with it's final value only
+    svm_opt_regs_t partial = 0;
+
+    for (uint32_t c = 0; c < count; ++c) {
+      const svm_cfg_block_t * block = &cfg->blocks.buffer[cands[c]];
+      svm_opt_regs_t invariant = ~written;
+      svm_opt_regs_t pending = 0, exposed = 0;
+
+      for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+        const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+        svm_opt_regs_t defs = svm_opt_insn_defs(insn, NULL);
+        svm_opt_regs_t uses = svm_opt_insn_uses(insn, NULL);
+
+        // Division by zero must fault only where it did, and header runs
+        // whenever loop is entered
+        hoist[i] = insn->ext == EXT_NONE
+            && (insn->op == OP_MOV || svm_opt_is_alu(insn->op))
+            && (insn->op != OP_DIV || c == 0)
+            && svm_opt_is_reg(insn->arg1)
+            && !(defs & banned)
+            && (uses & ~invariant) == 0;
+
+        if (hoist[i]) {
+          svm_register_t reg = svm_arg_to_reg(insn->arg1);
+
+          if ((chain[reg] != SVM_CFG_NONE && chain[reg] != c) || (exposed & defs)) {
+            partial |= defs;
+          }
+
+          chain[reg] = c;
+          hoisted[reg]++;
+          pending |= defs;
+          invariant |= defs;
+          selected++;
+        } else {
+          exposed |= uses & pending;
+          invariant &= insn->op == OP_INV || insn->op == OP_SYS ? ~written : ~defs;
+        }
+      }
+    }
+
+    // Write, left in the loop, would be skipped by hoisted ones
+    for (uint32_t r = 0; r < R_MAX; ++r) {
+      if (hoisted[r] && hoisted[r] != writes[r]) {
+        partial |= 1u << r;
+      }
+    }
+
+    if (!partial) {
+      return selected;
+    }
+
+    banned |= partial;
+
+    for (uint32_t c = 0; c < count; ++c) {
+      const svm_cfg_block_t * block = &cfg->blocks.buffer[cands[c]];
+      memset(&hoist[block->first], 0, (block->last - block->first + 1) * sizeof(bool));
+    }
+  }
+}
+
+/**
+ * Hoists invariants of loops, that don't overlap
+ *
+ * @returns Count of hoisted instructions
+ */
+static uint32_t svm_opt_licm_round(svm_opt_t * opt) {
+  svm_cfg_t cfg;
+
+  // Preheader is placed right before header, references to removed
+  // instructions there would resolve into it
+  if (svm_opt_compact(opt) != SVM_ASM_OK || svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  uint32_t blocks = cfg.blocks.size;
+  uint32_t size = opt->insns.size;
+  uint32_t hoisted = 0;
+
+  uint32_t * map = svm_opt_index_map(opt);
+  svm_opt_func_t * funcs = svm_malloc((blocks + 1) * sizeof(svm_opt_func_t));
+  svm_opt_regs_t * live_in = svm_malloc((blocks + 1) * sizeof(svm_opt_regs_t));
+  int32_t * depth = svm_malloc((blocks + 1) * sizeof(int32_t));
+  uint32_t * work = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * pred_first = svm_malloc((blocks + 2) * sizeof(uint32_t));
+  uint32_t * preds = svm_malloc((2 * blocks + 1) * sizeof(uint32_t));
+  uint32_t * loops = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * sizes = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * cands = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * owner = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * pre_id = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * pre_first = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * pre_count = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  bool * body = svm_malloc((blocks + 1) * sizeof(bool));
+  bool * hoist = svm_malloc((size + 1) * sizeof(bool));
+  uint32_t * list = svm_malloc((size + 1) * sizeof(uint32_t));
+
+  if (!map || !funcs || !live_in || !depth || !work || !pred_first || !preds || !loops || !sizes
+      || !cands || !owner || !pre_id || !pre_first || !pre_count || !body || !hoist || !list || cfg.indirect
+      || svm_cfg_dominators(&cfg) != SVM_ASM_OK) {
+    goto exit;
+  }
+
+  svm_opt_summarize(opt, &cfg, map, funcs, depth, work);
+  svm_opt_liveness(opt, &cfg, map, funcs, live_in);
+
+  // Predecessors by jumps & fall through (callee doesn't return into a loop by edge)
+  memset(pred_first, 0, (blocks + 2) * sizeof(uint32_t));
+
+  for (uint32_t pass = 0; pass < 2; ++pass) {
+    for (uint32_t b = 0; b < blocks; ++b) {
+      const svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+
+      for (uint32_t s = 0; s < 2; ++s) {
+        uint32_t succ = block->succ[s];
+
+        if (succ == SVM_CFG_NONE || (s == SVM_CFG_SUCC_TARGET && block->call)) {
+          continue;
+        }
+
+        if (pass == 0) {
+          pred_first[succ + 2]++;
+        } else {
+          preds[pred_first[succ + 1]++] = b;
+        }
+      }
+    }
+
+    for (uint32_t b = 0; pass == 0 && b < blocks; ++b) {
+      pred_first[b + 2] += pred_first[b + 1];
+    }
+  }
+
+  bool nz_z_read = false;
+
+  for (uint32_t i = 0; i < size; ++i) {
+    const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+    nz_z_read |= insn->op != OP_CLF && svm_opt_nz_z_dependent(insn);
+  }
+
+  // Inner loops first
+  uint32_t count = 0;
+
+  for (uint32_t h = 0; h < blocks; ++h) {
+    uint32_t body_size = svm_opt_loop_body(&cfg, pred_first, preds, h, body, work);
+
+    if (body_size) {
+      uint32_t l = count++;
+
+      for (; l > 0 && sizes[l - 1] > body_size; --l) {
+        loops[l] = loops[l - 1];
+        sizes[l] = sizes[l - 1];
+      }
+
+      loops[l] = h;
+      sizes[l] = body_size;
+    }
+  }
+
+  memset(owner, 0xFF, (blocks + 1) * sizeof(uint32_t));
+  memset(pre_id, 0xFF, (blocks + 1) * sizeof(uint32_t));
+  memset(hoist, 0, (size + 1) * sizeof(bool));
+
+  for (uint32_t l = 0; l < count; ++l) {
+    uint32_t h = loops[l];
+    const svm_cfg_block_t * header = &cfg.blocks.buffer[h];
+
+    svm_opt_loop_body(&cfg, pred_first, preds, h, body, work);
+
+    // Preheader falls into header, so header can't be entered by fall
+    // through from the loop itself
+    if (header->entry || (h > 0 && body[h - 1] && cfg.blocks.buffer[h - 1].succ[SVM_CFG_SUCC_NEXT] == h)) {
+      continue;
+    }
+
+    bool disjoint = true, calls = false, flags = false;
+    uint32_t writes[R_MAX] = {0};
+    svm_opt_regs_t written = 0;
+
+    for (uint32_t b = 0; b < blocks; ++b) {
+      if (!body[b]) {
+        continue;
+      }
+
+      disjoint &= owner[b] == SVM_CFG_NONE;
+
+      const svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+
+      for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+        const svm_opt_insn_t * insn = &opt->insns.buffer[i];
+        svm_opt_regs_t defs = svm_opt_insn_defs(insn, svm_opt_callee(opt, &cfg, map, funcs, insn));
+
+        written |= defs;
+        calls |= insn->op == OP_INV;
+        flags |= svm_opt_nz_z_dependent(insn);
+
+        for (uint32_t r = 0; r < R_MAX; ++r) {
+          writes[r] += (defs >> r) & 1;
+        }
+      }
+    }
+
+    // Hoisted instruction sets NZ/Z once before the loop instead of every
+    // iteration - that only matters if they are read or cleared in the loop.
+    // Loop may exit before non-header block runs, and flags would differ
+    if (!disjoint || (nz_z_read && (calls || flags))) {
+      continue;
+    }
+
+    // Blocks, that dominate every latch, run on every iteration. Those form
+    // a chain in dominator tree, walk it from any latch up to header
+    uint32_t latch = SVM_CFG_NONE, cand_count = 0;
+
+    for (uint32_t p = pred_first[h]; p < pred_first[h + 1]; ++p) {
+      if (body[preds[p]]) {
+        latch = preds[p];
+        break;
+      }
+    }
+
+    for (uint32_t b = latch; b != SVM_CFG_NONE; b = b == h ? SVM_CFG_NONE : cfg.idom[b]) {
+      bool every = true;
+
+      for (uint32_t p = pred_first[h]; p < pred_first[h + 1] && every; ++p) {
+        every = !body[preds[p]] || svm_cfg_dominates(&cfg, b, preds[p]);
+      }
+
+      if (every && (b == h || !nz_z_read)) {
+        cands[cand_count++] = b;
+      }
+    }
+
+    for (uint32_t c = 0; c < cand_count / 2; ++c) {
+      uint32_t tmp = cands[c];
+      cands[c] = cands[cand_count - 1 - c];
+      cands[cand_count - 1 - c] = tmp;
+    }
+
+    uint32_t selected = svm_opt_loop_invariants(opt, &cfg, cands, cand_count, writes, written, live_in[h], hoist);
+
+    if (!selected) {
+      continue;
+    }
+
+    for (uint32_t b = 0; b < blocks; ++b) {
+      owner[b] = body[b] ? h : owner[b];
+    }
+
+    pre_id[h] = opt->next_id;
+    pre_first[h] = hoisted;
+    pre_count[h] = selected;
+    opt->next_id += selected;
+
+    // Preheader keeps dominance order of hoisted instructions
+    for (uint32_t c = 0; c < cand_count; ++c) {
+      const svm_cfg_block_t * block = &cfg.blocks.buffer[cands[c]];
+
+      for (uint32_t i = block->first; i <= block->last; ++i) {
+        if (hoist[i]) {
+          list[hoisted++] = i;
+        }
+      }
+    }
+
+    // Entries from outside the loop go through preheader
+    uint32_t first_id = opt->insns.buffer[header->first].id;
+
+    for (uint32_t i = 0; i < size; ++i) {
+      svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+      for (uint32_t arg = 0; arg < 2 && !body[cfg.block[i]]; ++arg) {
+        if (insn->target[arg] == first_id) {
+          insn->target[arg] = pre_id[h];
+        }
+      }
+    }
+
+    for (uint32_t i = 0; opt->ctx && i < opt->ctx->labels.size; ++i) {
+      if (opt->labels[i] == first_id) {
+        opt->labels[i] = pre_id[h];
+      }
+    }
+  }
+
+  if (!hoisted) {
+    goto exit;
+  }
+
+  svm_opt_insn_t * buffer = svm_malloc((size + hoisted + 1) * sizeof(svm_opt_insn_t));
+
+  if (!buffer) {
+    hoisted = 0;
+    goto exit;
+  }
+
+  uint32_t new_size = 0;
+
+  for (uint32_t b = 0; b < blocks; ++b) {
+    const svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+
+    for (uint32_t k = 0; pre_id[b] != SVM_CFG_NONE && k < pre_count[b]; ++k) {
+      uint32_t index = list[pre_first[b] + k];
+      svm_opt_insn_t * insn = &buffer[new_size++];
+      *insn = opt->insns.buffer[index];
+      insn->id = pre_id[b] + k;
+      insn->address = SVM_OPT_ADDRESS_NONE;
+    }
+
+    for (uint32_t i = block->first; i <= block->last; ++i) {
+      buffer[new_size] = opt->insns.buffer[i];
+      buffer[new_size++].removed = hoist[i];
+    }
+  }
+
+  svm_free(opt->insns.buffer);
+  opt->insns.buffer = buffer;
+  opt->insns.size = new_size;
+  opt->insns.capacity = size + hoisted + 1;
+
+exit:
+  svm_free(map);
+  svm_free(funcs);
+  svm_free(live_in);
+  svm_free(depth);
+  svm_free(work);
+  svm_free(pred_first);
+  svm_free(preds);
+  svm_free(loops);
+  svm_free(sizes);
+  svm_free(cands);
+  svm_free(owner);
+  svm_free(pre_id);
+  svm_free(pre_first);
+  svm_free(pre_count);
+  svm_free(body);
+  svm_free(hoist);
+  svm_free(list);
+  svm_cfg_free(&cfg);
+
+  return hoisted;
+}
+
+/**
+ * Decodes code buffer into instruction list and resolves references
+ *
+ * @param opt Optimizer context (must be zeroed)
+ * @param buffer Code
+ * @param size Code size in words
+ * @param reloc_list Locations of label references (may be NULL)
+ * @param reloc_count Count of label references
+ * @param lines Line table (may be NULL)
+ * @param index Will map address to index of instruction, that starts there
+ */
+static svm_asm_error_t svm_opt_decode(
+    svm_opt_t * opt,
+    const int32_t * buffer,
+    uint32_t size,
+    const uint32_t * reloc_list,
+    uint32_t reloc_count,
+    const svm_lines_t * lines,
+    uint32_t * index
+) {
+  bool * relocs = svm_malloc((size + 1) * sizeof(bool));
+  SVM_ASSERT_RETURN(relocs, SVM_ASM_ERR_BAD_ALLOC);
+
+  memset(index, 0xFF, (size + 1) * sizeof(uint32_t));
+  memset(relocs, 0, (size + 1) * sizeof(bool));
+
+  for (uint32_t i = 0; i < reloc_count; ++i) {
+    if (reloc_list[i] < size) {
+      relocs[reloc_list[i]] = true;
+    }
+  }
+
+  svm_asm_error_t res = SVM_ASM_OK;
+  svm_lines_iter_t line = {0}, next_line = {0};
+  bool has_line = lines && svm_lines_next(lines, &next_line);
+
+  // Decode instructions
+  for (uint32_t address = 0; address < size; ) {
+    const svm_instruction_t * instruction = (const svm_instruction_t *) &buffer[address];
+
+    if (opt->insns.size + 1 >= opt->insns.capacity) {
+      opt->insns.capacity += 64;
+      SVM_REALLOC_CHECK(opt->insns.buffer, opt->insns.capacity * sizeof(opt->insns.buffer[0]));
+    }
+
+    svm_opt_insn_t * insn = &opt->insns.buffer[opt->insns.size];
+
+    memset(insn, 0, sizeof(*insn));
+    insn->id = opt->insns.size;
+    insn->address = address;
+    insn->op = instruction->op;
+    insn->ext = instruction->ext;
+    insn->arg1 = instruction->arg1;
+    insn->arg2 = instruction->arg2;
+    insn->target[0] = SVM_OPT_ID_NONE;
+    insn->target[1] = SVM_OPT_ID_NONE;
+
+    if (address + svm_opt_insn_size(insn) > size) {
+      res = SVM_ASM_ERR_BAD_REFERENCE;
+      goto exit;
+    }
+
+    if (svm_arg_has_value(insn->arg1)) {
+      insn->value[0] = buffer[svm_opt_value_location(insn, address, 0)];
+    }
+
+    if (svm_arg_has_value(insn->arg2)) {
+      insn->value[1] = buffer[svm_opt_value_location(insn, address, 1)];
+    }
+
+    while (has_line && next_line.pc <= address) {
+      line = next_line;
+      has_line = svm_lines_next(lines, &next_line);
+    }
+    insn->line = line.line;
+
+    index[address] = opt->insns.size++;
+    address += svm_opt_insn_size(insn);
+  }
+
+  opt->next_id = opt->insns.size;
+
+  // Resolve references into instruction ids
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    for (uint32_t arg = 0; arg < 2; ++arg) {
+      svm_arg_type_t type = arg ? insn->arg2 : insn->arg1;
+      uint32_t location = svm_opt_value_location(insn, insn->address, arg);
+      uint32_t address;
+
+      if (type == ARG_REL) {
+        address = location + insn->value[arg];
+      } else if (type == ARG_IMM && (relocs[location] || (arg == 0 && (insn->op == OP_JMP || insn->op == OP_INV)))) {
+        address = insn->value[arg];
+      } else {
+        continue;
+      }
+
+      if (address == size) {
+        insn->target[arg] = SVM_OPT_ID_END;
+      } else if (address < size && index[address] != SVM_OPT_ID_NONE) {
+        insn->target[arg] = opt->insns.buffer[index[address]].id;
+      } else {
+        res = SVM_ASM_ERR_BAD_REFERENCE;
+        goto exit;
+      }
+    }
+  }
+
+exit:
+  svm_free(relocs);
+
+  return res;
+}
+
+/* Shared functions ========================================================= */
+uint32_t svm_opt_next_live(const svm_opt_t * opt, uint32_t index) {
+  while (index < opt->insns.size && opt->insns.buffer[index].removed) {
+    index++;
+  }
+  return index;
+}
+
+uint32_t * svm_opt_index_map(const svm_opt_t * opt) {
+  uint32_t * map = svm_malloc(opt->next_id * sizeof(uint32_t));
+  SVM_ASSERT_RETURN(map, NULL);
+
+  memset(map, 0xFF, opt->next_id * sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    map[opt->insns.buffer[i].id] = i;
+  }
+
+  return map;
+}
+
+uint32_t svm_opt_resolve(const svm_opt_t * opt, const uint32_t * map, uint32_t id) {
+  if (id == SVM_OPT_ID_END || map[id] == SVM_OPT_ID_NONE) {
+    return opt->insns.size;
+  }
+  return svm_opt_next_live(opt, map[id]);
+}
+
+uint32_t svm_opt_insn_size(const svm_opt_insn_t * insn) {
+  SVM_ASSERT_RETURN(insn, 0);
+
+  return 1 + (svm_arg_has_value(insn->arg1) ? 1 : 0) + (svm_arg_has_value(insn->arg2) ? 1 : 0);
+}
+
+svm_asm_error_t svm_opt_init(svm_opt_t * opt, svm_asm_t * ctx) {
+  SVM_ASSERT_RETURN(opt && ctx, SVM_ASM_ERR_NULL);
+
+  memset(opt, 0, sizeof(*opt));
+
+  opt->ctx = ctx;
+
+  uint32_t size = ctx->code.size;
+  uint32_t * index = svm_malloc((size + 1) * sizeof(uint32_t));
+  SVM_ASSERT_RETURN(index, SVM_ASM_ERR_BAD_ALLOC);
+
+  svm_asm_error_t res = svm_opt_decode(
+      opt, ctx->code.buffer, size, ctx->relocs.buffer, ctx->relocs.size, &ctx->lines, index
+  );
+
+  if (res != SVM_ASM_OK) {
+    goto exit;
+  }
+
+  opt->labels = svm_malloc((ctx->labels.size + 1) * sizeof(uint32_t));
+
+  if (!opt->labels) {
+    res = SVM_ASM_ERR_BAD_ALLOC;
+    goto exit;
+  }
+
+  for (uint32_t i = 0; i < ctx->labels.size; ++i) {
+    uint32_t address = ctx->labels.buffer[i].location;
+
+    if (address == size) {
+      opt->labels[i] = SVM_OPT_ID_END;
+    } else if (address < size && index[address] != SVM_OPT_ID_NONE) {
+      opt->labels[i] = opt->insns.buffer[index[address]].id;
+    } else {
+      res = SVM_ASM_ERR_BAD_REFERENCE;
+      goto exit;
+    }
+  }
+
+exit:
+  svm_free(index);
+
+  if (res != SVM_ASM_OK) {
+    svm_opt_free(opt);
+  }
+
+  return res;
+}
+
+svm_asm_error_t svm_opt_init_code(svm_opt_t * opt, const svm_code_t * code) {
+  SVM_ASSERT_RETURN(opt && code, SVM_ASM_ERR_NULL);
+
+  memset(opt, 0, sizeof(*opt));
+
+  uint32_t * index = svm_malloc((code->size + 1) * sizeof(uint32_t));
+  SVM_ASSERT_RETURN(index, SVM_ASM_ERR_BAD_ALLOC);
+
+  svm_asm_error_t res = svm_opt_decode(opt, code->buffer, code->size, NULL, 0, NULL, index);
+
+  svm_free(index);
+
+  if (res != SVM_ASM_OK) {
+    svm_opt_free(opt);
+  }
+
+  return res;
+}
+
+svm_asm_error_t svm_opt_free(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, SVM_ASM_ERR_NULL);
+
+  if (opt->insns.buffer) {
+    svm_free(opt->insns.buffer);
+  }
+
+  if (opt->labels) {
+    svm_free(opt->labels);
+  }
+
+  memset(opt, 0, sizeof(*opt));
+
+  return SVM_ASM_OK;
+}
+
+svm_asm_error_t svm_opt_emit(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt && opt->ctx, SVM_ASM_ERR_NULL);
+
+  svm_asm_t * ctx = opt->ctx;
+  uint32_t * address = svm_malloc((opt->next_id + 1) * sizeof(uint32_t));
+  SVM_ASSERT_RETURN(address, SVM_ASM_ERR_BAD_ALLOC);
+
+  // Lay out live instructions, removed ones take address of the next live one
+  uint32_t size = 0, relocs = 0;
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (!insn->removed) {
+      address[insn->id] = size;
+      size += svm_opt_insn_size(insn);
+      relocs += (insn->target[0] != SVM_OPT_ID_NONE) + (insn->target[1] != SVM_OPT_ID_NONE);
+    }
+  }
+
+  for (uint32_t i = opt->insns.size, next = size; i > 0; --i) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i - 1];
+
+    if (insn->removed) {
+      address[insn->id] = next;
+    } else {
+      next = address[insn->id];
+    }
+  }
+
+  int32_t * code = svm_malloc((size + 1) * sizeof(int32_t));
+
+  if (relocs + 1 > ctx->relocs.capacity) {
+    ctx->relocs.capacity = relocs + 1;
+    SVM_REALLOC_CHECK(ctx->relocs.buffer, ctx->relocs.capacity * sizeof(ctx->relocs.buffer[0]));
+  }
+
+  if (!code) {
+    svm_free(address);
+    return SVM_ASM_ERR_BAD_ALLOC;
+  }
+
+  // Line table is rebuilt from scratch, file name is kept
+  ctx->lines.size = 0;
+  ctx->lines.last_pc = 0;
+  ctx->lines.last_line = 0;
+  ctx->relocs.size = 0;
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (insn->removed) {
+      continue;
+    }
+
+    uint32_t location = address[insn->id];
+
+    if (insn->line) {
+      svm_lines_add(&ctx->lines, location, insn->line);
+    }
+
+    code[location] = svm_instruction_to_int32(svm_pack_instruction(insn->op, insn->ext, insn->arg1, insn->arg2));
+
+    for (uint32_t arg = 0; arg < 2; ++arg) {
+      if (!svm_arg_has_value(arg ? insn->arg2 : insn->arg1)) {
+        continue;
+      }
+
+      uint32_t value_location = svm_opt_value_location(insn, location, arg);
+      int32_t value = insn->value[arg];
+
+      if (insn->target[arg] != SVM_OPT_ID_NONE) {
+        value = insn->target[arg] == SVM_OPT_ID_END ? size : address[insn->target[arg]];
+
+        if ((arg ? insn->arg2 : insn->arg1) == ARG_REL) {
+          value -= value_location;
+        }
+
+        ctx->relocs.buffer[ctx->relocs.size++] = value_location;
+      }
+
+      code[value_location] = value;
+    }
+  }
+
+  for (uint32_t i = 0; i < ctx->labels.size; ++i) {
+    ctx->labels.buffer[i].location = opt->labels[i] == SVM_OPT_ID_END ? size : address[opt->labels[i]];
+  }
+
+  svm_free(ctx->code.buffer);
+  ctx->code.buffer = code;
+  ctx->code.size = size;
+  ctx->code.capacity = size + 1;
+
+  svm_free(address);
+
+  return SVM_ASM_OK;
+}
+
+uint32_t svm_opt_peephole(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  // NZ/Z are the only flags set as a side effect of mov & arithmetic,
+  // if nothing reads them, such side effect can be dropped
+  bool nz_z_read = false;
+
+  for (uint32_t i = 0; i < opt->insns.size; ++i) {
+    svm_opt_insn_t * insn = &opt->insns.buffer[i];
+
+    if (!insn->removed && insn->op != OP_CLF && (insn->ext == EXT_NZ || insn->ext == EXT_Z)) {
+      nz_z_read = true;
+    }
+  }
+
+  uint32_t * map = svm_opt_index_map(opt);
+  bool * entries = map ? svm_opt_entries(opt, map) : NULL;
+
+  if (!entries) {
+    svm_free(map);
+    return 0;
+  }
+
+  uint32_t removed = 0;
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+
+    for (uint32_t i = svm_opt_next_live(opt, 0); i < opt->insns.size; i = svm_opt_next_live(opt, i + 1)) {
+      svm_opt_insn_t * insn = &opt->insns.buffer[i];
+      uint32_t next = svm_opt_next_live(opt, i + 1);
+
+      if (insn->op == OP_NOP || (!nz_z_read && svm_opt_is_identity(insn))) {
+        svm_opt_remove(opt, entries, i);
+        removed++;
+        changed = true;
+        continue;
+      }
+
+      // Condition doesn't matter, flags aren't changed by jump
+      if (insn->op == OP_JMP && insn->target[0] != SVM_OPT_ID_NONE && svm_opt_resolve(opt, map, insn->target[0]) == next) {
+        svm_opt_remove(opt, entries, i);
+        removed++;
+        changed = true;
+        continue;
+      }
+
+      if (insn->op == OP_PUSH && insn->ext == EXT_NONE && svm_opt_is_reg(insn->arg1) && next < opt->insns.size) {
+        svm_opt_insn_t * pop = &opt->insns.buffer[next];
+
+        if (pop->op == OP_POP && pop->ext == EXT_NONE && !entries[next]
+            && pop->arg1 == insn->arg1 && pop->arg2 == insn->arg2) {
+          svm_opt_remove(opt, entries, i);
+          svm_opt_remove(opt, entries, next);
+          removed += 2;
+          changed = true;
+          continue;
+        }
+      }
+    }
+  }
+
+  svm_free(entries);
+  svm_free(map);
+
+  return removed;
+}
+
+uint32_t svm_opt_constprop(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  uint32_t changes = 0;
+
+  // Every round may resolve conditions, that open up more constants
+  for (uint32_t round = 0; round < SVM_OPT_MAX_ROUNDS; ++round) {
+    uint32_t round_changes = svm_opt_constprop_round(opt);
+
+    if (!round_changes) {
+      break;
+    }
+
+    changes += round_changes;
+  }
+
+  return changes;
+}
+
+uint32_t svm_opt_inline(svm_opt_t * opt, uint32_t max_size, int32_t * words) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  int32_t local_words = 0;
+  words = words ? words : &local_words;
+  *words = 0;
+
+  uint32_t inlined = 0;
+
+  for (uint32_t round = 0; round < SVM_OPT_MAX_ROUNDS; ++round) {
+    uint32_t round_inlined = svm_opt_inline_round(opt, max_size, words);
+
+    if (!round_inlined) {
+      break;
+    }
+
+    inlined += round_inlined;
+  }
+
+  return inlined;
+}
+
+uint32_t svm_opt_call_depth(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, SVM_OPT_DEPTH_UNKNOWN);
+
+  svm_cfg_t cfg;
+
+  if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return SVM_OPT_DEPTH_UNKNOWN;
+  }
+
+  uint32_t result = 0;
+  uint32_t * depth = svm_malloc((cfg.blocks.size + 1) * sizeof(uint32_t));
+
+  // Targets of register calls are unknown
+  if (!depth || cfg.indirect) {
+    result = SVM_OPT_DEPTH_UNKNOWN;
+    goto exit;
+  }
+
+  for (uint32_t b = 0; b < cfg.blocks.size; ++b) {
+    depth[b] = SVM_OPT_DEPTH_NONE;
+  }
+
+  // Code can be started from the entry point or from any address taken block
+  for (uint32_t b = 0; b < cfg.blocks.size && result != SVM_OPT_DEPTH_UNKNOWN; ++b) {
+    if (b == 0 || cfg.blocks.buffer[b].entry) {
+      uint32_t d = svm_opt_function_depth(&cfg, b, depth);
+      result = d == SVM_OPT_DEPTH_UNKNOWN ? SVM_OPT_DEPTH_UNKNOWN : (d > result ? d : result);
+    }
+  }
+
+exit:
+  svm_free(depth);
+  svm_cfg_free(&cfg);
+
+  return result;
+}
+
+uint32_t svm_opt_shrink_saves(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  svm_cfg_t cfg;
+
+  if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  uint32_t blocks = cfg.blocks.size;
+  uint32_t changes = 0;
+
+  uint32_t * map = svm_opt_index_map(opt);
+  svm_opt_func_t * funcs = svm_malloc((blocks + 1) * sizeof(svm_opt_func_t));
+  svm_opt_regs_t * live_in = svm_malloc((blocks + 1) * sizeof(svm_opt_regs_t));
+  int32_t * depth = svm_malloc((blocks + 1) * sizeof(int32_t));
+  uint32_t * work = svm_malloc((blocks + 1) * sizeof(uint32_t));
+
+  // Callees of register calls are unknown
+  if (!map || !funcs || !live_in || !depth || !work || cfg.indirect) {
+    goto exit;
+  }
+
+  svm_opt_summarize(opt, &cfg, map, funcs, depth, work);
+  svm_opt_liveness(opt, &cfg, map, funcs, live_in);
+
+  for (uint32_t b = 0; b < blocks; ++b) {
+    changes += svm_opt_shrink_save(opt, &cfg, map, funcs, live_in, b);
+  }
+
+exit:
+  svm_free(map);
+  svm_free(funcs);
+  svm_free(live_in);
+  svm_free(depth);
+  svm_free(work);
+  svm_cfg_free(&cfg);
+
+  return changes;
+}
+
+uint32_t svm_opt_licm(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  uint32_t hoisted = 0;
+
+  // Invariants of inner loop become candidates of outer one, once hoisted
+  for (uint32_t round = 0; round < SVM_OPT_MAX_ROUNDS; ++round) {
+    uint32_t changed = svm_opt_licm_round(opt);
+
+    if (!changed) {
+      break;
+    }
+
+    hoisted += changed;
+  }
+
+  return hoisted;
+}
+
+uint32_t svm_opt_reduce(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  svm_cfg_t cfg;
+
+  if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  uint32_t changes = 0;
+  svm_opt_state_t * states = svm_opt_analyze(opt, &cfg);
+
+  for (uint32_t b = 0; states && b < cfg.blocks.size; ++b) {
+    const svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+    svm_opt_state_t state = states[b];
+
+    if (!state.reached) {
+      continue;
+    }
+
+    for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+      changes += svm_opt_reduce_insn(&opt->insns.buffer[i], &state);
+      svm_opt_state_transfer(&state, &opt->insns.buffer[i]);
+    }
+  }
+
+  svm_free(states);
+  svm_cfg_free(&cfg);
+
+  return changes;
+}
+
+uint32_t svm_opt_dce(svm_opt_t * opt, uint32_t * words, uint32_t * labels) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  uint32_t removed = 0;
+  uint32_t removed_words = 0;
+  uint32_t pruned = 0;
+
+  // Removed code may have been the only one to take address of other code
+  for (uint32_t round = 0; round < SVM_OPT_MAX_ROUNDS; ++round) {
+    svm_cfg_t cfg;
+
+    if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+      break;
+    }
+
+    uint32_t * map = svm_opt_index_map(opt);
+    bool * reachable = svm_malloc((cfg.blocks.size + 1) * sizeof(bool));
+    uint32_t * stack = svm_malloc((cfg.blocks.size + 1) * sizeof(uint32_t));
+    uint32_t round_removed = 0;
+
+    if (!map || !reachable || !stack) {
+      svm_free(map);
+      svm_free(reachable);
+      svm_free(stack);
+      svm_cfg_free(&cfg);
+      break;
+    }
+
+    memset(reachable, 0, (cfg.blocks.size + 1) * sizeof(bool));
+
+    // Roots are the entry point and every block, that may be entered indirectly
+    uint32_t sp = 0;
+
+    for (uint32_t b = 0; b < cfg.blocks.size; ++b) {
+      if (b == 0 || cfg.blocks.buffer[b].entry) {
+        reachable[b] = true;
+        stack[sp++] = b;
+      }
+    }
+
+    while (sp) {
+      svm_cfg_block_t * block = &cfg.blocks.buffer[stack[--sp]];
+
+      for (uint32_t s = 0; s < 2; ++s) {
+        if (block->succ[s] != SVM_CFG_NONE && !reachable[block->succ[s]]) {
+          reachable[block->succ[s]] = true;
+          stack[sp++] = block->succ[s];
+        }
+      }
+    }
+
+    // Labels, that point into unreachable code, are pruned
+    for (uint32_t i = 0; opt->ctx && i < opt->ctx->labels.size; ) {
+      uint32_t index = svm_opt_resolve(opt, map, opt->labels[i]);
+
+      if (index < opt->insns.size && !reachable[cfg.block[index]]) {
+        opt->ctx->labels.size--;
+        opt->ctx->labels.buffer[i] = opt->ctx->labels.buffer[opt->ctx->labels.size];
+        opt->labels[i] = opt->labels[opt->ctx->labels.size];
+        pruned++;
+      } else {
+        ++i;
+      }
+    }
+
+    for (uint32_t b = 0; b < cfg.blocks.size; ++b) {
+      if (reachable[b]) {
+        continue;
+      }
+
+      svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+
+      for (uint32_t i = block->first; i <= block->last; i = svm_opt_next_live(opt, i + 1)) {
+        opt->insns.buffer[i].removed = true;
+        removed_words += svm_opt_insn_size(&opt->insns.buffer[i]);
+        round_removed++;
+      }
+    }
+
+    svm_free(map);
+    svm_free(reachable);
+    svm_free(stack);
+    svm_cfg_free(&cfg);
+
+    if (!round_removed) {
+      break;
+    }
+
+    removed += round_removed;
+  }
+
+  if (words) {
+    *words = removed_words;
+  }
+
+  if (labels) {
+    *labels = pruned;
+  }
+
+  return removed;
+}
+
+uint32_t svm_opt_thread(svm_opt_t * opt) {
+  SVM_ASSERT_RETURN(opt, 0);
+
+  uint32_t changes = 0;
+
+  for (uint32_t round = 0; round < SVM_OPT_MAX_ROUNDS; ++round) {
+    uint32_t changed = svm_opt_thread_jumps(opt);
+    changed += svm_opt_merge_blocks(opt);
+
+    if (!changed) {
+      break;
+    }
+
+    changes += changed;
+  }
+
+  return changes;
+}
+
+uint32_t svm_opt_layout(svm_opt_t * opt, const svm_profile_t * profile) {
+  SVM_ASSERT_RETURN(opt && profile, 0);
+
+  if (svm_opt_compact(opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  svm_cfg_t cfg;
+
+  if (svm_cfg_build(&cfg, opt) != SVM_ASM_OK) {
+    return 0;
+  }
+
+  uint32_t blocks = cfg.blocks.size;
+  uint32_t changes = 0;
+
+  uint32_t * counts = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  uint32_t * order = svm_malloc((blocks + 1) * sizeof(uint32_t));
+  bool * placed = svm_malloc((blocks + 1) * sizeof(bool));
+  svm_opt_pairs_t * pairs = svm_malloc((blocks + 1) * sizeof(svm_opt_pairs_t));
+
+  if (!counts || !order || !placed || !pairs || !blocks) {
+    goto exit;
+  }
+
+  memset(placed, 0, (blocks + 1) * sizeof(bool));
+  svm_opt_pairs_analyze(opt, &cfg, pairs);
+
+  for (uint32_t b = 0; b < blocks; ++b) {
+    uint32_t address = opt->insns.buffer[cfg.blocks.buffer[b].first].address;
+    counts[b] = address != SVM_OPT_ADDRESS_NONE ? svm_profile_count(profile, address) : 0;
+  }
+
+  // If the last block falls through past the end of code, it must stay last
+  const svm_opt_insn_t * end = &opt->insns.buffer[cfg.blocks.buffer[blocks - 1].last];
+  uint32_t pinned = end->op == OP_RET || end->op == OP_END || (end->op == OP_JMP && end->ext == EXT_NONE)
+                  ? SVM_CFG_NONE : blocks - 1;
+
+  if (pinned == 0) {
+    goto exit;
+  }
+
+  // Build chains of blocks, so that the hottest successor falls through.
+  // Entry point stays first, chains start from the hottest unplaced block
+  uint32_t placed_count = 0;
+
+  for (uint32_t start = 0; start != SVM_CFG_NONE; ) {
+    for (uint32_t b = start; b != SVM_CFG_NONE; ) {
+      svm_cfg_block_t * block = &cfg.blocks.buffer[b];
+      const svm_opt_insn_t * last = &opt->insns.buffer[block->last];
+      uint32_t target = block->succ[SVM_CFG_SUCC_TARGET];
+      uint32_t next = block->succ[SVM_CFG_SUCC_NEXT];
+
+      // Before successors are checked, as block may jump to itself
+      placed[b] = true;
+      order[placed_count++] = b;
+
+      bool target_free = target != SVM_CFG_NONE && !placed[target] && target != pinned;
+      bool next_free = next != SVM_CFG_NONE && !placed[next] && next != pinned;
+
+      b = SVM_CFG_NONE;
+
+      if (last->op == OP_JMP && last->ext == EXT_NONE) {
+        b = target_free ? target : SVM_CFG_NONE;
+      } else if (last->op == OP_JMP && target != SVM_CFG_NONE) {
+        bool invertible = svm_opt_invertible(last, &pairs[block - cfg.blocks.buffer]);
+
+        if (target_free && invertible && (!next_free || counts[target] > counts[next])) {
+          b = target;
+        } else if (next_free && (!invertible || counts[next] || !counts[block - cfg.blocks.buffer])) {
+          // Cold fall through of hot block is moved to the end
+          b = next;
+        }
+      } else if (last->op != OP_RET && last->op != OP_END) {
+        b = next_free ? next : SVM_CFG_NONE;
+      }
+    }
+
+    start = SVM_CFG_NONE;
+
+    for (uint32_t b = 0; b < blocks; ++b) {
+      if (!placed[b] && b != pinned && (start == SVM_CFG_NONE || counts[b] > counts[start])) {
+        start = b;
+      }
+    }
+  }
+
+  if (pinned != SVM_CFG_NONE) {
+    order[placed_count++] = pinned;
+  }
+
+  changes = svm_opt_place(opt, &cfg, order, placed_count, pairs);
+
+exit:
+  svm_free(counts);
+  svm_free(order);
+  svm_free(placed);
+  svm_free(pairs);
+  svm_cfg_free(&cfg);
+
+  return changes;
+}
+
+svm_asm_error_t svm_opt_run(svm_asm_t * ctx, const svm_opt_config_t * config, svm_opt_stats_t * stats) {
+  SVM_ASSERT_RETURN(ctx && config, SVM_ASM_ERR_NULL);
+
+  svm_opt_stats_t local_stats;
+  stats = stats ? stats : &local_stats;
+  memset(stats, 0, sizeof(*stats));
+
+  // Data words can't be told apart from instructions
+  if (ctx->data) {
+    printf("Code contains data, optimization skipped\n");
+    stats->words_before = stats->words_after = ctx->code.size;
+    return SVM_ASM_OK;
+  }
+
+  svm_opt_t opt;
+  SVM_ASM_ERROR_CHECK_RETURN(svm_opt_init(&opt, ctx));
+
+  stats->instructions_before = opt.insns.size;
+  stats->words_before = ctx->code.size;
+
+  if (config->level >= 2) {
+    stats->inlined = svm_opt_inline(&opt, config->inline_size, &stats->inline_words);
+  }
+
+  if (config->level >= 1) {
+    stats->reduce = svm_opt_reduce(&opt);
+  }
+
+  if (config->level >= 2) {
+    stats->constprop = svm_opt_constprop(&opt);
+    stats->thread = svm_opt_thread(&opt);
+    stats->licm = svm_opt_licm(&opt);
+    stats->dce = svm_opt_dce(&opt, &stats->dce_words, &stats->labels_pruned);
+    stats->saves = svm_opt_shrink_saves(&opt);
+  }
+
+  if (config->level >= 1) {
+    stats->peephole = svm_opt_peephole(&opt);
+  }
+
+  svm_asm_error_t res = svm_opt_emit(&opt);
+
+  // Profile addresses refer to code, produced by the same passes
+  if (res == SVM_ASM_OK && config->profile) {
+    svm_opt_free(&opt);
+
+    if (!svm_profile_check(config->profile, ctx->code.buffer, ctx->code.size)) {
+      printf("Profile doesn't match code, layout skipped\n");
+      return SVM_ASM_ERR_BAD_PROFILE;
+    }
+
+    SVM_ASM_ERROR_CHECK_RETURN(svm_opt_init(&opt, ctx));
+
+    stats->layout = svm_opt_layout(&opt, config->profile);
+    res = svm_opt_emit(&opt);
+  }
+
+  // One more slot, as vm checks for overflow before pushing
+  uint32_t depth = svm_opt_call_depth(&opt);
+  ctx->meta.call_stack_size = depth != SVM_OPT_DEPTH_UNKNOWN ? depth + 1 : 0;
+
+  for (uint32_t i = 0; i < opt.insns.size; ++i) {
+    stats->instructions_after += !opt.insns.buffer[i].removed;
+  }
+  stats->words_after = ctx->code.size;
+
+  svm_opt_free(&opt);
+
+#if USE_SVM_ASM_PRINT_DISASM
+  printf("Optimized disassembly:\n");
+  svm_disassemble(ctx->code.buffer, ctx->code.size);
+#endif
+
+  return res;
+}
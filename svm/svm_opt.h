@@ -0,0 +1,378 @@
+/** ========================================================================= *
+ *
+ * @file svm_opt.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Optimizer over assembled code
+ *
+ * Code is decoded into a list of instructions, where every label reference
+ * points to an instruction id instead of an address. Passes remove, rewrite
+ * or insert instructions, and svm_opt_emit lays the code out again,
+ * updating labels, label references and line table.
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include "svm_asm.h"
+#include "svm_profile.h"
+
+/* Defines ================================================================== */
+/**
+ * Marks value, that doesn't refer to any instruction
+ */
+#define SVM_OPT_ID_NONE UINT32_MAX
+
+/**
+ * Marks reference to the end of code
+ */
+#define SVM_OPT_ID_END (UINT32_MAX - 1)
+
+/**
+ * Marks instruction, that wasn't present in original code
+ */
+#define SVM_OPT_ADDRESS_NONE UINT32_MAX
+
+/**
+ * Provides definition for max count of rounds, iterative passes make
+ */
+#ifndef SVM_OPT_MAX_ROUNDS
+#define SVM_OPT_MAX_ROUNDS 8
+#endif
+
+/**
+ * Provides definition for default max instruction count of inlined subroutine
+ */
+#ifndef SVM_OPT_INLINE_SIZE
+#define SVM_OPT_INLINE_SIZE 8
+#endif
+
+/**
+ * Marks call depth, that can't be known statically
+ */
+#define SVM_OPT_DEPTH_UNKNOWN UINT32_MAX
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/**
+ * Optimizer configuration
+ */
+typedef struct {
+  uint8_t level;                /** Optimization level, 0 disables the optimizer */
+  const svm_profile_t * profile;/** Profile for block layout (may be NULL) */
+  uint32_t inline_size;         /** Max instruction count of inlined subroutine (0 disables inlining) */
+} svm_opt_config_t;
+
+/**
+ * Optimizer statistics
+ */
+typedef struct {
+  uint32_t instructions_before; /** Instruction count before optimization */
+  uint32_t instructions_after;  /** Instruction count after optimization */
+  uint32_t words_before;        /** Code size before optimization */
+  uint32_t words_after;         /** Code size after optimization */
+  uint32_t constprop;           /** Instructions folded, resolved or removed by constant propagation */
+  uint32_t dce;                 /** Unreachable instructions removed */
+  uint32_t dce_words;           /** Code size of unreachable instructions */
+  uint32_t labels_pruned;       /** Labels, that pointed into unreachable code */
+  uint32_t inlined;             /** Call sites, replaced with subroutine body */
+  int32_t  inline_words;        /** Code size change caused by inlining */
+  uint32_t reduce;              /** Instructions rewritten by strength reduction */
+  uint32_t saves;               /** Push & pop pairs around calls, narrowed or removed */
+  uint32_t peephole;            /** Instructions removed by peephole pass */
+  uint32_t thread;              /** Jumps redirected, replaced or removed by jump threading */
+  uint32_t licm;                /** Instructions hoisted out of loops */
+  uint32_t layout;              /** Jumps removed or inverted by block layout */
+} svm_opt_stats_t;
+
+/**
+ * Decoded instruction
+ */
+typedef struct {
+  uint32_t id;                  /** Stable instruction identifier */
+  uint32_t address;             /** Address in original code (or SVM_OPT_ADDRESS_NONE) */
+  uint32_t line;                /** Source line (or 0) */
+
+  svm_opcode_t op;
+  svm_ext_t ext;
+  svm_arg_type_t arg1;
+  svm_arg_type_t arg2;
+
+  int32_t value[2];             /** Argument values, if argument has one */
+  uint32_t target[2];           /** Id of instruction, argument refers to (or SVM_OPT_ID_NONE) */
+
+  bool removed;                 /** Instruction was removed, won't be emitted */
+} svm_opt_insn_t;
+
+/**
+ * Optimizer context
+ */
+typedef struct {
+  svm_asm_t * ctx;              /** Assembler context, code is taken from */
+
+  struct {
+    svm_opt_insn_t * buffer;
+    uint32_t capacity;
+    uint32_t size;
+  } insns;
+
+  uint32_t * labels;            /** Instruction id of each ctx label */
+  uint32_t next_id;             /** Next free instruction id */
+} svm_opt_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Decodes code of assembler context into optimizer context
+ *
+ * @note All label references must already be patched
+ *
+ * @param opt Optimizer context
+ * @param ctx Assembler context
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_BAD_REFERENCE If some reference doesn't point to an instruction
+ */
+svm_asm_error_t svm_opt_init(svm_opt_t * opt, svm_asm_t * ctx);
+
+/**
+ * Decodes raw code into optimizer context
+ *
+ * Code has no labels nor relocations, so only targets of jmp & inv are
+ * treated as references. svm_opt_emit can't be used on such context
+ *
+ * @param opt Optimizer context
+ * @param code Code
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_BAD_REFERENCE If some reference doesn't point to an instruction
+ */
+svm_asm_error_t svm_opt_init_code(svm_opt_t * opt, const svm_code_t * code);
+
+/**
+ * Releases optimizer context
+ *
+ * @param opt Optimizer context
+ */
+svm_asm_error_t svm_opt_free(svm_opt_t * opt);
+
+/**
+ * Lays out instructions and writes them back into assembler context
+ *
+ * @note Updates code, labels, relocations and line table
+ *
+ * @param opt Optimizer context
+ */
+svm_asm_error_t svm_opt_emit(svm_opt_t * opt);
+
+/**
+ * Returns index of first instruction starting from index, that wasn't removed
+ *
+ * @param opt Optimizer context
+ * @param index Index to start from
+ *
+ * @returns Index of instruction, or instruction count if there is none
+ */
+uint32_t svm_opt_next_live(const svm_opt_t * opt, uint32_t index);
+
+/**
+ * Builds map from instruction id to instruction index
+ *
+ * @note Map is allocated with svm_malloc, and must be released with svm_free
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Map, or NULL if allocation failed
+ */
+uint32_t * svm_opt_index_map(const svm_opt_t * opt);
+
+/**
+ * Resolves reference to instruction, that will actually be executed
+ *
+ * @param opt Optimizer context
+ * @param map Map from svm_opt_index_map
+ * @param id Instruction id
+ *
+ * @returns Index of instruction, or instruction count if reference points to end of code
+ */
+uint32_t svm_opt_resolve(const svm_opt_t * opt, const uint32_t * map, uint32_t id);
+
+/**
+ * Returns size of instruction in words
+ *
+ * @param insn Instruction
+ */
+uint32_t svm_opt_insn_size(const svm_opt_insn_t * insn);
+
+/**
+ * Removes no-op patterns: nop, mov to itself, arithmetic identities,
+ * push immediately followed by pop of the same registers, jumps to the next
+ * instruction
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Count of removed instructions
+ */
+uint32_t svm_opt_peephole(svm_opt_t * opt);
+
+/**
+ * Propagates constant register values & flags across basic blocks
+ *
+ * Arithmetic on known values is folded into mov, instructions with known
+ * condition are made unconditional or removed, constant mov overwritten
+ * within the same block is removed
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Count of changed instructions
+ */
+uint32_t svm_opt_constprop(svm_opt_t * opt);
+
+/**
+ * Inlines small subroutines at unconditional call sites
+ *
+ * Subroutine is inlined if it's single entry, straight line code, that
+ * ends with ret and doesn't jump, call or end. Such subroutine can't be
+ * recursive. Each inlined call saves inv & ret dispatches and a call stack
+ * slot. Subroutine itself is left for svm_opt_dce to remove
+ *
+ * @param opt Optimizer context
+ * @param max_size Max instruction count of inlined subroutine (ret excluded)
+ * @param words Will contain code size change in words (may be NULL)
+ *
+ * @returns Count of inlined call sites
+ */
+uint32_t svm_opt_inline(svm_opt_t * opt, uint32_t max_size, int32_t * words);
+
+/**
+ * Computes max count of nested calls code can make
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Call depth, or SVM_OPT_DEPTH_UNKNOWN if code has recursion or calls to register
+ */
+uint32_t svm_opt_call_depth(svm_opt_t * opt);
+
+/**
+ * Narrows push & pop of register range around call to registers, that
+ * callee (or code between push & pop) may write and that are read after
+ * pop, removes them if there are no such registers
+ *
+ * Callees are summarized across the whole program (registers read and
+ * written, including by their callees, and whether stack is balanced).
+ * Push & pop must be in the call block and it's return site, and callee
+ * must leave stack balanced. Nothing is changed, if code calls or jumps
+ * to register
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Count of changed push & pop pairs
+ */
+uint32_t svm_opt_shrink_saves(svm_opt_t * opt);
+
+/**
+ * Replaces arithmetic with cheaper or constant equivalent
+ *
+ * mul by 2^k becomes shl, div by 2^k becomes shr when dividend is known
+ * to be non-negative, sub/xor of register with itself, mul/and by 0 and
+ * or by -1 become mov of the result. Every rewrite produces the same value,
+ * so NZ/Z flags are set the same way
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Count of rewritten instructions
+ */
+uint32_t svm_opt_reduce(svm_opt_t * opt);
+
+/**
+ * Removes code, that can't be reached from the entry point
+ *
+ * Code is followed through jmp, inv and fall through. Blocks, which
+ * address is taken, are assumed reachable, and when code contains jumps
+ * to register, so is every label. Labels pointing into removed code are
+ * removed from assembler context
+ *
+ * @param opt Optimizer context
+ * @param words Will contain size of removed code in words (may be NULL)
+ * @param labels Will contain count of removed labels (may be NULL)
+ *
+ * @returns Count of removed instructions
+ */
+uint32_t svm_opt_dce(svm_opt_t * opt, uint32_t * words, uint32_t * labels);
+
+/**
+ * Threads jumps & merges blocks
+ *
+ * Jump or invoke into unconditional jump (or jump with the same condition)
+ * is redirected to the final target, unconditional jump to ret or end is
+ * replaced with it. Block, that is entered only by unconditional jump and
+ * doesn't fall through, is moved right after the jump, which is removed.
+ * Jumps, left without references, are removed by svm_opt_dce
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Count of changed & removed jumps
+ */
+uint32_t svm_opt_thread(svm_opt_t * opt);
+
+/**
+ * Hoists loop invariant mov & arithmetic into loop preheaders
+ *
+ * Loop is found by back edge - jump into a block (header), that dominates
+ * the jump. Instruction is invariant, when it's sources aren't written in
+ * the loop (or were computed by invariant instructions right before it),
+ * all writes of it's destination in the loop are hoisted too, and
+ * destination isn't live at header.
+ * Only instructions from blocks, that run on every iteration, are hoisted
+ * into generated preheader, which is entered instead of header from
+ * outside the loop. As NZ/Z flags are sticky, if anything reads them,
+ * only header instructions of loops without calls, flag reads and clf
+ * are hoisted
+ *
+ * @param opt Optimizer context
+ *
+ * @returns Count of hoisted instructions
+ */
+uint32_t svm_opt_licm(svm_opt_t * opt);
+
+/**
+ * Reorders blocks by execution counts, so that hot successors fall through
+ * and cold blocks move to the end
+ *
+ * Unconditional jumps to the next block are removed. Conditional jump is
+ * inverted (EQ/NE, LT/GE, GT/LE, NZ/Z) to make it's target fall through
+ * only when flag pair is known to be exclusive at that point, since flags
+ * are sticky. Where fall through is broken, jump is inserted
+ *
+ * @param opt Optimizer context
+ * @param profile Profile, addresses of which match original code addresses
+ *
+ * @returns Count of removed and inverted jumps
+ */
+uint32_t svm_opt_layout(svm_opt_t * opt, const svm_profile_t * profile);
+
+/**
+ * Runs optimization passes, enabled by configuration, over assembled code
+ *
+ * Sets call stack size in ctx meta, if call depth is known. Code with
+ * data (.word, .data) is left as is
+ *
+ * @param ctx Assembler context with patched code
+ * @param config Optimizer configuration
+ * @param stats Statistics (may be NULL)
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_BAD_REFERENCE If code couldn't be decoded
+ * @retval SVM_ASM_ERR_BAD_PROFILE If profile was collected on different code
+ */
+svm_asm_error_t svm_opt_run(svm_asm_t * ctx, const svm_opt_config_t * config, svm_opt_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,175 @@
+/** ========================================================================= *
+ *
+ * @file svm_profile.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_profile.h"
+#include "svm_cfg.h"
+#include "svm_util.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static void svm_profile_add(svm_profile_t * profile, uint32_t address, uint32_t count) {
+  if (profile->entries.size + 1 >= profile->entries.capacity) {
+    profile->entries.capacity += 64;
+    SVM_REALLOC_CHECK(profile->entries.buffer, profile->entries.capacity * sizeof(profile->entries.buffer[0]));
+  }
+
+  profile->entries.buffer[profile->entries.size].address = address;
+  profile->entries.buffer[profile->entries.size].count = count;
+  profile->entries.size++;
+}
+
+/* Shared functions ========================================================= */
+uint32_t svm_profile_hash(const int32_t * buffer, uint32_t size) {
+  SVM_ASSERT_RETURN(buffer || !size, 0);
+
+  // FNV-1a over code words
+  uint32_t hash = 2166136261u;
+
+  for (uint32_t i = 0; i < size; ++i) {
+    hash = (hash ^ (uint32_t) buffer[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+svm_asm_error_t svm_profile_init(svm_profile_t * profile, const svm_code_t * code, const uint32_t * counts) {
+  SVM_ASSERT_RETURN(profile && code && counts, SVM_ASM_ERR_NULL);
+
+  memset(profile, 0, sizeof(*profile));
+
+  profile->code_size = code->size;
+  profile->code_hash = svm_profile_hash(code->buffer, code->size);
+
+  svm_opt_t opt;
+  svm_cfg_t cfg;
+
+  SVM_ASM_ERROR_CHECK_RETURN(svm_opt_init_code(&opt, code));
+
+  svm_asm_error_t res = svm_cfg_build(&cfg, &opt);
+
+  if (res != SVM_ASM_OK) {
+    svm_opt_free(&opt);
+    return res;
+  }
+
+  // Every instruction of a block runs as many times as the first one
+  for (uint32_t b = 0; b < cfg.blocks.size; ++b) {
+    uint32_t address = opt.insns.buffer[cfg.blocks.buffer[b].first].address;
+    svm_profile_add(profile, address, counts[address]);
+  }
+
+  svm_cfg_free(&cfg);
+  svm_opt_free(&opt);
+
+  return SVM_ASM_OK;
+}
+
+svm_asm_error_t svm_profile_free(svm_profile_t * profile) {
+  SVM_ASSERT_RETURN(profile, SVM_ASM_ERR_NULL);
+
+  if (profile->entries.buffer) {
+    svm_free(profile->entries.buffer);
+  }
+
+  memset(profile, 0, sizeof(*profile));
+
+  return SVM_ASM_OK;
+}
+
+bool svm_profile_check(const svm_profile_t * profile, const int32_t * buffer, uint32_t size) {
+  SVM_ASSERT_RETURN(profile, false);
+
+  return profile->code_size == size && profile->code_hash == svm_profile_hash(buffer, size);
+}
+
+uint32_t svm_profile_count(const svm_profile_t * profile, uint32_t address) {
+  SVM_ASSERT_RETURN(profile, 0);
+
+  // Find the last block, starting at or before address
+  uint32_t lo = 0, hi = profile->entries.size;
+
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (profile->entries.buffer[mid].address <= address) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo ? profile->entries.buffer[lo - 1].count : 0;
+}
+
+svm_asm_error_t svm_profile_save_file(const svm_profile_t * profile, const char * filename) {
+  SVM_ASSERT_RETURN(profile && filename, SVM_ASM_ERR_NULL);
+
+  FILE * file = fopen(filename, "w");
+
+  if (!file) {
+    printf("Failed to open %s\n", filename);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  fprintf(file, "svm-profile %d\n", SVM_PROFILE_VERSION);
+  fprintf(file, "size %u hash %08x\n", profile->code_size, profile->code_hash);
+
+  for (uint32_t i = 0; i < profile->entries.size; ++i) {
+    fprintf(file, "%04x %u\n", profile->entries.buffer[i].address, profile->entries.buffer[i].count);
+  }
+
+  fclose(file);
+
+  return SVM_ASM_OK;
+}
+
+svm_asm_error_t svm_profile_load_file(svm_profile_t * profile, const char * filename) {
+  SVM_ASSERT_RETURN(profile && filename, SVM_ASM_ERR_NULL);
+
+  memset(profile, 0, sizeof(*profile));
+
+  FILE * file = fopen(filename, "r");
+
+  if (!file) {
+    printf("Failed to open %s\n", filename);
+    return SVM_ASM_ERR_FILE_OPEN_FAILED;
+  }
+
+  int version = 0;
+  uint32_t address, count;
+
+  if (fscanf(file, "svm-profile %d size %u hash %x", &version, &profile->code_size, &profile->code_hash) != 3
+      || version != SVM_PROFILE_VERSION) {
+    fclose(file);
+    return SVM_ASM_ERR_BAD_PROFILE;
+  }
+
+  while (fscanf(file, "%x %u", &address, &count) == 2) {
+    // Entries must be sorted for lookup
+    if (profile->entries.size && profile->entries.buffer[profile->entries.size - 1].address >= address) {
+      fclose(file);
+      svm_profile_free(profile);
+      return SVM_ASM_ERR_BAD_PROFILE;
+    }
+
+    svm_profile_add(profile, address, count);
+  }
+
+  fclose(file);
+
+  return SVM_ASM_OK;
+}
@@ -0,0 +1,131 @@
+/** ========================================================================= *
+ *
+ * @file svm_profile.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Execution profile - per basic block execution counts, collected by VM
+ *
+ * Profile is bound to the exact code it was collected on (size & hash are
+ * stored alongside the counts), and is stored as text:
+ *
+ *   svm-profile 1
+ *   size <code size in words> hash <code hash>
+ *   <block address> <count>
+ *   ...
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include "svm_asm.h"
+
+/* Defines ================================================================== */
+/**
+ * Profile format version
+ */
+#define SVM_PROFILE_VERSION 1
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/**
+ * Execution count of a block
+ */
+typedef struct {
+  uint32_t address;   /** Address of the first instruction of block */
+  uint32_t count;     /** How many times block was entered */
+} svm_profile_entry_t;
+
+/**
+ * Execution profile
+ */
+typedef struct {
+  uint32_t code_size; /** Size of code, profile was collected on */
+  uint32_t code_hash; /** Hash of code, profile was collected on */
+
+  struct {
+    svm_profile_entry_t * buffer; /** Sorted by address */
+    uint32_t capacity;
+    uint32_t size;
+  } entries;
+} svm_profile_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Hashes code, to bind profile to it
+ *
+ * @param buffer Code
+ * @param size Code size in words
+ */
+uint32_t svm_profile_hash(const int32_t * buffer, uint32_t size);
+
+/**
+ * Builds profile from per instruction execution counts
+ *
+ * @param profile Profile to initialize
+ * @param code Code, counts were collected on
+ * @param counts Execution count of every instruction (see svm_t profile)
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_BAD_REFERENCE If code couldn't be decoded
+ */
+svm_asm_error_t svm_profile_init(svm_profile_t * profile, const svm_code_t * code, const uint32_t * counts);
+
+/**
+ * Releases profile
+ *
+ * @param profile Profile
+ */
+svm_asm_error_t svm_profile_free(svm_profile_t * profile);
+
+/**
+ * Checks if profile was collected on this code
+ *
+ * @param profile Profile
+ * @param buffer Code
+ * @param size Code size in words
+ */
+bool svm_profile_check(const svm_profile_t * profile, const int32_t * buffer, uint32_t size);
+
+/**
+ * Returns execution count of instruction at address
+ *
+ * @note Instructions in a block share the count of the block
+ *
+ * @param profile Profile
+ * @param address Instruction address
+ */
+uint32_t svm_profile_count(const svm_profile_t * profile, uint32_t address);
+
+/**
+ * Writes profile into a file
+ *
+ * @param profile Profile
+ * @param filename Path to profile file
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_FILE_OPEN_FAILED If couldn't open file
+ */
+svm_asm_error_t svm_profile_save_file(const svm_profile_t * profile, const char * filename);
+
+/**
+ * Reads profile from a file
+ *
+ * @param profile Profile to initialize
+ * @param filename Path to profile file
+ *
+ * @retval SVM_ASM_OK If operation completed successfully
+ * @retval SVM_ASM_ERR_FILE_OPEN_FAILED If couldn't open file
+ * @retval SVM_ASM_ERR_BAD_PROFILE If file isn't a valid profile
+ */
+svm_asm_error_t svm_profile_load_file(svm_profile_t * profile, const char * filename);
+
+#ifdef __cplusplus
+}
+#endif
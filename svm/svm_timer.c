@@ -0,0 +1,228 @@
+/** ========================================================================= *
+ *
+ * @file svm_timer.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm_timer.h"
+#include "svm.h"
+#include "svm_util.h"
+
+/* Defines ================================================================== */
+/**
+ * log2 of SVM_TIMER_SLOTS - bits of time, each level covers
+ */
+#define SVM_TIMER_SLOT_BITS 6
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+static void svm_timer_link(svm_task_t ** ring, svm_task_t * task) {
+  if (*ring) {
+    task->prev = (*ring)->prev;
+    task->next = *ring;
+    (*ring)->prev->next = task;
+    (*ring)->prev = task;
+  } else {
+    task->prev = task;
+    task->next = task;
+    *ring = task;
+  }
+
+  task->slot = ring;
+}
+
+/**
+ * @retval true If ring became empty
+ */
+static bool svm_timer_unlink(svm_task_t * task) {
+  svm_task_t ** ring = task->slot;
+  bool empty = task->next == task;
+
+  if (empty) {
+    *ring = NULL;
+  } else {
+    task->prev->next = task->next;
+    task->next->prev = task->prev;
+
+    if (*ring == task) {
+      *ring = task->next;
+    }
+  }
+
+  task->next = NULL;
+  task->prev = NULL;
+  task->slot = NULL;
+
+  return empty;
+}
+
+/**
+ * Puts task into slot of its wake time relative to wheel time
+ */
+static void svm_timer_file(svm_timer_t * timer, svm_task_t * task) {
+  if (task->wake <= timer->now) {
+    svm_timer_link(&timer->due, task);
+    return;
+  }
+
+  uint64_t delay = task->wake - timer->now;
+  uint32_t level = delay < SVM_TIMER_SLOTS ? 0 : (63 - __builtin_clzll(delay)) / SVM_TIMER_SLOT_BITS;
+
+  if (level >= SVM_TIMER_LEVELS) {
+    level = SVM_TIMER_LEVELS - 1;
+    task->wake = timer->now + (1ull << (SVM_TIMER_LEVELS * SVM_TIMER_SLOT_BITS)) - 1;
+  }
+
+  uint32_t slot = (task->wake >> (level * SVM_TIMER_SLOT_BITS)) % SVM_TIMER_SLOTS;
+
+  svm_timer_link(&timer->slots[level][slot], task);
+  timer->occupied[level] |= 1ull << slot;
+}
+
+/**
+ * Returns time, wheel reaches the next non-empty slot of level at
+ * (SVM_TIMER_NONE if level is empty)
+ */
+static uint64_t svm_timer_event(const svm_timer_t * timer, uint32_t level) {
+  uint64_t occupied = timer->occupied[level];
+
+  if (!occupied) {
+    return SVM_TIMER_NONE;
+  }
+
+  uint32_t shift = level * SVM_TIMER_SLOT_BITS;
+  uint32_t start = ((timer->now >> shift) + 1) % SVM_TIMER_SLOTS;
+
+  // Slots after the current one come first, current slot is a full turn away
+  uint64_t rotated = start ? (occupied >> start) | (occupied << (SVM_TIMER_SLOTS - start)) : occupied;
+  uint64_t distance = __builtin_ctzll(rotated) + 1;
+
+  return ((timer->now >> shift) + distance) << shift;
+}
+
+/* Shared functions ========================================================= */
+void svm_timer_add(svm_timer_t * timer, svm_task_t * task) {
+  SVM_ASSERT_RETURN(timer && task);
+
+  svm_timer_file(timer, task);
+  timer->count++;
+}
+
+void svm_timer_cancel(svm_timer_t * timer, svm_task_t * task) {
+  SVM_ASSERT_RETURN(timer && task && task->slot);
+
+  svm_task_t ** ring = task->slot;
+
+  if (svm_timer_unlink(task) && ring != &timer->due) {
+    uint32_t index = ring - &timer->slots[0][0];
+    timer->occupied[index / SVM_TIMER_SLOTS] &= ~(1ull << (index % SVM_TIMER_SLOTS));
+  }
+
+  timer->count--;
+}
+
+void svm_timer_advance(svm_timer_t * timer, uint64_t now) {
+  SVM_ASSERT_RETURN(timer);
+
+  for (;;) {
+    uint64_t events[SVM_TIMER_LEVELS];
+    uint64_t next = SVM_TIMER_NONE;
+
+    for (uint32_t level = 0; level < SVM_TIMER_LEVELS; ++level) {
+      events[level] = svm_timer_event(timer, level);
+
+      if (events[level] < next) {
+        next = events[level];
+      }
+    }
+
+    if (next == SVM_TIMER_NONE || next > now) {
+      break;
+    }
+
+    timer->now = next;
+
+    // Higher levels first, their tasks may land in lower slots, reached now
+    for (uint32_t level = SVM_TIMER_LEVELS; level-- > 0;) {
+      if (events[level] != next) {
+        continue;
+      }
+
+      uint32_t slot = (next >> (level * SVM_TIMER_SLOT_BITS)) % SVM_TIMER_SLOTS;
+
+      // Ring is detached, as tasks a full turn away are filed into the same slot again
+      svm_task_t * ring = timer->slots[level][slot];
+
+      timer->slots[level][slot] = NULL;
+      timer->occupied[level] &= ~(1ull << slot);
+
+      while (ring) {
+        svm_task_t * task = ring;
+
+        task->slot = &ring;
+        svm_timer_unlink(task);
+        svm_timer_file(timer, task);
+      }
+    }
+  }
+
+  if (now > timer->now) {
+    timer->now = now;
+  }
+}
+
+svm_task_t * svm_timer_pop(svm_timer_t * timer) {
+  SVM_ASSERT_RETURN(timer, NULL);
+
+  svm_task_t * task = timer->due;
+
+  if (task) {
+    svm_timer_unlink(task);
+    timer->count--;
+  }
+
+  return task;
+}
+
+svm_task_t * svm_timer_any(const svm_timer_t * timer) {
+  SVM_ASSERT_RETURN(timer, NULL);
+
+  if (timer->due) {
+    return timer->due;
+  }
+
+  for (uint32_t level = 0; level < SVM_TIMER_LEVELS; ++level) {
+    if (timer->occupied[level]) {
+      return timer->slots[level][__builtin_ctzll(timer->occupied[level])];
+    }
+  }
+
+  return NULL;
+}
+
+uint64_t svm_timer_next(const svm_timer_t * timer) {
+  SVM_ASSERT_RETURN(timer, SVM_TIMER_NONE);
+
+  if (timer->due) {
+    return timer->now;
+  }
+
+  uint64_t next = SVM_TIMER_NONE;
+
+  for (uint32_t level = 0; level < SVM_TIMER_LEVELS; ++level) {
+    uint64_t event = svm_timer_event(timer, level);
+
+    if (event < next) {
+      next = event;
+    }
+  }
+
+  return next;
+}
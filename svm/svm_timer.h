@@ -0,0 +1,133 @@
+/** ========================================================================= *
+ *
+ * @file svm_timer.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Hierarchical timer wheel of sleeping tasks
+ *
+ * Level l has 64 slots, each covering 64^l ms, so a task waking in delay
+ * ms is filed on the level, where delay < 64^(l+1). Once wheel time
+ * reaches the slot, its tasks are filed again on lower levels (or expire
+ * on level 0), so each task is touched at most once per level. Tasks of a
+ * slot form a ring, linked with next & prev (like run queues), so adding
+ * and cancelling is O(1). Occupied slots of every level are kept in a
+ * bitmask, so the next event is found in O(levels), and time can be
+ * advanced over empty slots without visiting them.
+ *
+ * Wheel doesn't read the clock itself - time (in ms) is passed by caller.
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Defines ================================================================== */
+/**
+ * Slots per wheel level (one bit of occupancy mask each)
+ */
+#define SVM_TIMER_SLOTS 64
+
+/**
+ * Provides definition for count of wheel levels, if not provided
+ *
+ * Longest delay is 64^levels - 1 ms, longer ones are shortened to it
+ */
+#ifndef SVM_TIMER_LEVELS
+#define SVM_TIMER_LEVELS 6
+#endif
+
+/**
+ * Marks absence of pending timers
+ */
+#define SVM_TIMER_NONE UINT64_MAX
+
+/* Macros =================================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+struct svm_task_t;
+
+/**
+ * Timer wheel, must be zero-initialized before first use
+ */
+typedef struct {
+  struct svm_task_t * slots[SVM_TIMER_LEVELS][SVM_TIMER_SLOTS]; /** Ring of tasks in each slot */
+  uint64_t occupied[SVM_TIMER_LEVELS]; /** Bit of each non-empty slot */
+  struct svm_task_t * due;  /** Ring of expired tasks, not popped yet */
+  uint64_t now;             /** Wheel time, timers up to it have expired */
+  uint32_t count;           /** Count of tasks in wheel (including expired ones) */
+} svm_timer_t;
+
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Adds task to the wheel
+ *
+ * Task expires at task->wake, right away, if it's not after wheel time
+ *
+ * @note Task must not be in the wheel or a run queue
+ *
+ * @param timer Timer wheel
+ * @param task Task instance
+ */
+void svm_timer_add(svm_timer_t * timer, struct svm_task_t * task);
+
+/**
+ * Removes task from the wheel, before it's popped
+ *
+ * @param timer Timer wheel
+ * @param task Task instance in the wheel
+ */
+void svm_timer_cancel(svm_timer_t * timer, struct svm_task_t * task);
+
+/**
+ * Advances wheel time, expiring tasks with wake up to it
+ *
+ * Cost depends on count of slots, that had tasks, not on elapsed time
+ *
+ * @param timer Timer wheel
+ * @param now Current time (wheel time never goes back)
+ */
+void svm_timer_advance(svm_timer_t * timer, uint64_t now);
+
+/**
+ * Pops expired task
+ *
+ * @param timer Timer wheel
+ *
+ * @returns Expired task (unlinked), or NULL if there are none
+ */
+struct svm_task_t * svm_timer_pop(svm_timer_t * timer);
+
+/**
+ * Returns any task of the wheel (to release tasks)
+ *
+ * @param timer Timer wheel
+ *
+ * @returns Task, or NULL if wheel is empty
+ */
+struct svm_task_t * svm_timer_any(const svm_timer_t * timer);
+
+/**
+ * Returns time of the next event of the wheel
+ *
+ * Event is expiry of a task or filing of slot on a lower level (happens at
+ * most once per level for each task, so idle host waking up on events,
+ * wakes up only a few times more, than there are expiries)
+ *
+ * @param timer Timer wheel
+ *
+ * @returns Time of the next event (wheel time if there are expired tasks),
+ *          or SVM_TIMER_NONE if wheel is empty
+ */
+uint64_t svm_timer_next(const svm_timer_t * timer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,13 +13,145 @@
 #include <stdio.h>
 
 /* Defines ================================================================== */
+/**
+ * Multiplier of opcode mnemonic hash, collision free for all opcodes
+ */
+#define SVM_OPCODE_HASH_MULT 0x5dfebfe1u
+
+/**
+ * Size of opcode mnemonic table in bits
+ */
+#define SVM_OPCODE_HASH_BITS 5
+
+/**
+ * Multiplier of condition mnemonic hash, collision free for all conditions
+ */
+#define SVM_EXT_HASH_MULT 0x547fd809u
+
+/**
+ * Size of condition mnemonic table in bits
+ */
+#define SVM_EXT_HASH_BITS 3
+
+/**
+ * Capacity, buffers grow to at least
+ */
+#define SVM_GROW_MIN_CAPACITY 16
+
 /* Macros =================================================================== */
+/**
+ * Packs up to 4 characters of mnemonic into a word
+ */
+#define SVM_MNEMONIC_KEY(a, b, c, d) \
+  ((uint32_t) (a) | (uint32_t) (b) << 8 | (uint32_t) (c) << 16 | (uint32_t) (d) << 24)
+
+/**
+ * Maps mnemonic key to slot of a table with 2^bits entries
+ */
+#define SVM_MNEMONIC_HASH(key, mult, bits) \
+  ((uint32_t) ((key) * (mult)) >> (32 - (bits)))
+
 /* Exposed macros =========================================================== */
 /* Enums ==================================================================== */
 /* Types ==================================================================== */
+/**
+ * Slot of mnemonic table
+ */
+typedef struct {
+  uint32_t key;
+  uint8_t value;
+} svm_mnemonic_t;
+
 /* Variables ================================================================ */
+/**
+ * Opcode mnemonics, placed by SVM_MNEMONIC_HASH with SVM_OPCODE_HASH_MULT
+ *
+ * Multiplier was found by trying odd constants, until every mnemonic got
+ * it's own slot. Adding an opcode requires finding a new one
+ */
+static const svm_mnemonic_t svm_opcode_table[1 << SVM_OPCODE_HASH_BITS] = {
+  [ 0] = {SVM_MNEMONIC_KEY('a', 'n', 'd', 0), OP_AND},
+  [ 2] = {SVM_MNEMONIC_KEY('a', 'd', 'd', 0), OP_ADD},
+  [ 3] = {SVM_MNEMONIC_KEY('s', 'u', 'b', 0), OP_SUB},
+  [ 4] = {SVM_MNEMONIC_KEY('p', 'u', 's', 'h'), OP_PUSH},
+  [ 5] = {SVM_MNEMONIC_KEY('s', 'h', 'r', 0), OP_SHR},
+  [ 6] = {SVM_MNEMONIC_KEY('o', 'r', 0, 0), OP_OR},
+  [ 8] = {SVM_MNEMONIC_KEY('c', 'l', 'f', 0), OP_CLF},
+  [ 9] = {SVM_MNEMONIC_KEY('r', 'e', 't', 0), OP_RET},
+  [10] = {SVM_MNEMONIC_KEY('j', 'm', 'p', 0), OP_JMP},
+  [12] = {SVM_MNEMONIC_KEY('m', 'u', 'l', 0), OP_MUL},
+  [14] = {SVM_MNEMONIC_KEY('i', 'n', 'v', 0), OP_INV},
+  [15] = {SVM_MNEMONIC_KEY('e', 'n', 'd', 0), OP_END},
+  [16] = {SVM_MNEMONIC_KEY('p', 'o', 'p', 0), OP_POP},
+  [20] = {SVM_MNEMONIC_KEY('d', 'i', 'v', 0), OP_DIV},
+  [21] = {SVM_MNEMONIC_KEY('s', 'h', 'l', 0), OP_SHL},
+  [24] = {SVM_MNEMONIC_KEY('c', 'm', 'p', 0), OP_CMP},
+  [25] = {SVM_MNEMONIC_KEY('n', 'o', 'p', 0), OP_NOP},
+  [26] = {SVM_MNEMONIC_KEY('s', 'y', 's', 0), OP_SYS},
+  [29] = {SVM_MNEMONIC_KEY('m', 'o', 'v', 0), OP_MOV},
+  [30] = {SVM_MNEMONIC_KEY('x', 'o', 'r', 0), OP_XOR},
+};
+
+/**
+ * Condition mnemonics, placed by SVM_MNEMONIC_HASH with SVM_EXT_HASH_MULT
+ */
+static const svm_mnemonic_t svm_ext_table[1 << SVM_EXT_HASH_BITS] = {
+  [ 0] = {SVM_MNEMONIC_KEY('l', 'e', 0, 0), EXT_LE},
+  [ 1] = {SVM_MNEMONIC_KEY('n', 'z', 0, 0), EXT_NZ},
+  [ 2] = {SVM_MNEMONIC_KEY('z', 0, 0, 0), EXT_Z},
+  [ 3] = {SVM_MNEMONIC_KEY('g', 'e', 0, 0), EXT_GE},
+  [ 4] = {SVM_MNEMONIC_KEY('l', 't', 0, 0), EXT_LT},
+  [ 5] = {SVM_MNEMONIC_KEY('n', 'e', 0, 0), EXT_NE},
+  [ 6] = {SVM_MNEMONIC_KEY('e', 'q', 0, 0), EXT_EQ},
+  [ 7] = {SVM_MNEMONIC_KEY('g', 't', 0, 0), EXT_GT},
+};
+
 /* Private functions ======================================================== */
+/**
+ * Packs mnemonic into a key
+ *
+ * @returns Key, or 0 if string is empty or longer than 4 characters
+ */
+static uint32_t svm_mnemonic_key(const char * str, uint32_t length) {
+  uint32_t key = 0;
+
+  if (length > 4) {
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < length; ++i) {
+    key |= (uint32_t) (uint8_t) str[i] << (8 * i);
+  }
+
+  return key;
+}
+
+/**
+ * Converts character to digit value (or -1 if it isn't a digit)
+ */
+static int32_t svm_digit_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  } else {
+    return -1;
+  }
+}
+
 /* Shared functions ========================================================= */
+uint32_t svm_grow_capacity(uint32_t capacity, uint32_t required) {
+  uint32_t grown = capacity + capacity / 2;
+
+  if (grown < SVM_GROW_MIN_CAPACITY) {
+    grown = SVM_GROW_MIN_CAPACITY;
+  }
+
+  return grown > required ? grown : required;
+}
+
 const char * svm_opcode2str(svm_opcode_t op) {
   switch (op) {
     case OP_NOP:  return "NOP";
@@ -109,6 +241,7 @@ const char * svm_arg2str(svm_arg_type_t type) {
     case ARG_R14:  return "R14";
     case ARG_R15:  return "R15";
     case ARG_IMM:  return "IMM";
+    case ARG_REL:  return "REL";
     case ARG_MAX:  return "<MAX>";
     default:
       return "<?>";
@@ -142,11 +275,19 @@ const char * svm_get_arg_str(int32_t * code, uint32_t index, svm_arg_type_t type
     case ARG_IMM:
       sprintf(buffer, "%d", code[index + (has_prev_arg ? 1 : 0)]);
       return buffer;
+    case ARG_REL:
+      index += has_prev_arg ? 1 : 0;
+      sprintf(buffer, "@%04x", index + code[index]);
+      return buffer;
     default:
       return "?";
   }
 }
 
+bool svm_arg_has_value(svm_arg_type_t type) {
+  return type == ARG_IMM || type == ARG_REL;
+}
+
 svm_register_t svm_arg_to_reg(svm_arg_type_t arg) {
   switch (arg) {
     case ARG_R0:  return R0;
@@ -173,152 +314,92 @@ svm_register_t svm_arg_to_reg(svm_arg_type_t arg) {
 svm_opcode_t svm_str2opcode(const char * str) {
   SVM_ASSERT_RETURN(str, OP_MAX);
 
-  if (!strcmp(str, "nop")) {
-    return OP_NOP;
-  } else if (!strcmp(str, "end")) {
-    return OP_END;
-  } else if (!strcmp(str, "mov")) {
-    return OP_MOV;
-  } else if (!strcmp(str, "push")) {
-    return OP_PUSH;
-  } else if (!strcmp(str, "pop")) {
-    return OP_POP;
-  } else if (!strcmp(str, "add")) {
-    return OP_ADD;
-  } else if (!strcmp(str, "sub")) {
-    return OP_SUB;
-  } else if (!strcmp(str, "mul")) {
-    return OP_MUL;
-  } else if (!strcmp(str, "div")) {
-    return OP_DIV;
-  } else if (!strcmp(str, "and")) {
-    return OP_AND;
-  } else if (!strcmp(str, "or")) {
-    return OP_OR;
-  } else if (!strcmp(str, "xor")) {
-    return OP_XOR;
-  } else if (!strcmp(str, "shl")) {
-    return OP_SHL;
-  } else if (!strcmp(str, "shr")) {
-    return OP_SHR;
-  } else if (!strcmp(str, "cmp")) {
-    return OP_CMP;
-  } else if (!strcmp(str, "clf")) {
-    return OP_CLF;
-  } else if (!strcmp(str, "jmp")) {
-    return OP_JMP;
-  } else if (!strcmp(str, "inv")) {
-    return OP_INV;
-  } else if (!strcmp(str, "ret")) {
-    return OP_RET;
-  } else if (!strcmp(str, "sys")) {
-    return OP_SYS;
-  } else {
-    return OP_MAX;
-  }
+  return svm_strn2opcode(str, strlen(str));
+}
+
+svm_opcode_t svm_strn2opcode(const char * str, uint32_t length) {
+  SVM_ASSERT_RETURN(str, OP_MAX);
+
+  uint32_t key = svm_mnemonic_key(str, length);
+  const svm_mnemonic_t * slot = &svm_opcode_table[SVM_MNEMONIC_HASH(key, SVM_OPCODE_HASH_MULT, SVM_OPCODE_HASH_BITS)];
+
+  // Empty slots have key 0, which no mnemonic has
+  return key && slot->key == key ? (svm_opcode_t) slot->value : OP_MAX;
 }
 
 svm_arg_type_t svm_str2arg(const char * str) {
   SVM_ASSERT_RETURN(str, ARG_MAX);
 
-  if (!strcmp(str, "r0")) {
-    return ARG_R0;
-  } else if (!strcmp(str, "r1")) {
-    return ARG_R1;
-  } else if (!strcmp(str, "r2")) {
-    return ARG_R2;
-  } else if (!strcmp(str, "r3")) {
-    return ARG_R3;
-  } else if (!strcmp(str, "r4")) {
-    return ARG_R4;
-  } else if (!strcmp(str, "r5")) {
-    return ARG_R5;
-  } else if (!strcmp(str, "r6")) {
-    return ARG_R6;
-  } else if (!strcmp(str, "r7")) {
-    return ARG_R7;
-  } else if (!strcmp(str, "r8")) {
-    return ARG_R8;
-  } else if (!strcmp(str, "r9")) {
-    return ARG_R9;
-  } else if (!strcmp(str, "r10")) {
-    return ARG_R10;
-  } else if (!strcmp(str, "r11")) {
-    return ARG_R11;
-  } else if (!strcmp(str, "r12")) {
-    return ARG_R12;
-  } else if (!strcmp(str, "r13")) {
-    return ARG_R13;
-  } else if (!strcmp(str, "r14")) {
-    return ARG_R14;
-  } else if (!strcmp(str, "r15")) {
-    return ARG_R15;
-  } else {
+  return svm_strn2arg(str, strlen(str));
+}
+
+svm_arg_type_t svm_strn2arg(const char * str, uint32_t length) {
+  SVM_ASSERT_RETURN(str, ARG_MAX);
+
+  // Only r0-r15 are registers, anything else (r01, r16) is a label or number
+  if (length < 2 || length > 3 || str[0] != 'r' || !isdigit((uint8_t) str[1])) {
     return ARG_IMM;
   }
+
+  if (length == 2) {
+    return (svm_arg_type_t) (ARG_R0 + str[1] - '0');
+  }
+
+  if (str[1] == '1' && str[2] >= '0' && str[2] <= '5') {
+    return (svm_arg_type_t) (ARG_R10 + str[2] - '0');
+  }
+
+  return ARG_IMM;
 }
 
 svm_ext_t svm_str2ext(const char * str) {
   SVM_ASSERT_RETURN(str, EXT_MAX);
 
-  if (!strcmp(str, "eq")) {
-    return EXT_EQ;
-  } else if (!strcmp(str, "ne")) {
-    return EXT_NE;
-  } else if (!strcmp(str, "lt")) {
-    return EXT_LT;
-  } else if (!strcmp(str, "le")) {
-    return EXT_LE;
-  } else if (!strcmp(str, "gt")) {
-    return EXT_GT;
-  } else if (!strcmp(str, "ge")) {
-    return EXT_GE;
-  } else if (!strcmp(str, "nz")) {
-    return EXT_NZ;
-  } else if (!strcmp(str, "z")) {
-    return EXT_Z;
-  } else {
-    return EXT_NONE;
-  }
+  return svm_strn2ext(str, strlen(str));
+}
+
+svm_ext_t svm_strn2ext(const char * str, uint32_t length) {
+  SVM_ASSERT_RETURN(str, EXT_MAX);
+
+  uint32_t key = svm_mnemonic_key(str, length);
+  const svm_mnemonic_t * slot = &svm_ext_table[SVM_MNEMONIC_HASH(key, SVM_EXT_HASH_MULT, SVM_EXT_HASH_BITS)];
+
+  return key && slot->key == key ? (svm_ext_t) slot->value : EXT_NONE;
 }
 
 bool svm_to_int32(const char * str, int32_t * value) {
   SVM_ASSERT_RETURN(str && value, false);
 
+  return svm_strn_to_int32(str, strlen(str), value);
+}
+
+bool svm_strn_to_int32(const char * str, uint32_t length, int32_t * value) {
+  SVM_ASSERT_RETURN(str && value, false);
+
   *value = 0;
 
-  uint32_t size = strlen(str);
   uint32_t index = 0;
   int32_t  base = 10;
 
-  if (size > 2) {
-    if (str[index] == '0') {
-      if (str[index+1] == 'x') {
-        index += 2;
-        base = 16;
-      } else if (str[index+1] == 'b') {
-        index += 2;
-        base = 2;
-      }
+  if (length > 2 && str[0] == '0') {
+    if (str[1] == 'x') {
+      index += 2;
+      base = 16;
+    } else if (str[1] == 'b') {
+      index += 2;
+      base = 2;
     }
   }
 
-  for (; index < size; ++index) {
-    int32_t digit = 0;
-
-    if (str[index] >= '0' && str[index] < '9') {
-      digit = str[index] - '0';
-    } else if (str[index] >= 'a' && str[index] <= 'f') {
-      digit = str[index] - 'a';
-    } else if (str[index] >= 'A' && str[index] <= 'F') {
-      if (isupper(str[index])) {
-        digit = str[index] - 'A';
-      }
-    } else {
+  for (; index < length; ++index) {
+    int32_t digit = svm_digit_value(str[index]);
+
+    // Anything else (like 'face' or 'B2') is a label
+    if (digit < 0 || digit >= base) {
       return false;
     }
 
-    *value = *value * base + digit;
+    *value = (int32_t) ((uint32_t) *value * base + digit);
   }
 
   return true;
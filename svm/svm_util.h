@@ -82,6 +82,17 @@ extern "C" {
 /* Types ==================================================================== */
 /* Variables ================================================================ */
 /* Shared functions ========================================================= */
+/**
+ * Returns grown capacity of a buffer, that fits at least required items
+ *
+ * Capacity grows geometrically, so appending n items one by one
+ * reallocates only O(log n) times
+ *
+ * @param capacity Current capacity
+ * @param required Count of items, buffer has to fit
+ */
+uint32_t svm_grow_capacity(uint32_t capacity, uint32_t required);
+
 /**
  * Converts opcode to string
  *
@@ -123,6 +134,13 @@ const char * svm_arg2str(svm_arg_type_t type);
  */
 const char * svm_get_arg_str(int32_t * code, uint32_t index, svm_arg_type_t type, bool has_prev_arg);
 
+/**
+ * Checks if argument has it's value stored in the next i32 of code
+ *
+ * @param type Argument type
+ */
+bool svm_arg_has_value(svm_arg_type_t type);
+
 /**
  * Argument to register conversion (if argument is register)
  *
@@ -137,6 +155,14 @@ svm_register_t svm_arg_to_reg(svm_arg_type_t arg);
  */
 svm_opcode_t svm_str2opcode(const char * str);
 
+/**
+ * Converts string of given length (not NULL-terminated) to opcode value
+ *
+ * @param str String containing opcode
+ * @param length Length of string
+ */
+svm_opcode_t svm_strn2opcode(const char * str, uint32_t length);
+
 /**
  * Converts string to argument type
  *
@@ -144,6 +170,14 @@ svm_opcode_t svm_str2opcode(const char * str);
  */
 svm_arg_type_t svm_str2arg(const char * str);
 
+/**
+ * Converts string of given length (not NULL-terminated) to argument type
+ *
+ * @param str String containing argument
+ * @param length Length of string
+ */
+svm_arg_type_t svm_strn2arg(const char * str, uint32_t length);
+
 /**
  * Converts string to extension type
  *
@@ -151,9 +185,19 @@ svm_arg_type_t svm_str2arg(const char * str);
  */
 svm_ext_t svm_str2ext(const char * str);
 
+/**
+ * Converts string of given length (not NULL-terminated) to extension type
+ *
+ * @param str String containing instruction extension
+ * @param length Length of string
+ */
+svm_ext_t svm_strn2ext(const char * str, uint32_t length);
+
 /**
  * Converts string to int32_t
  *
+ * @note Decimal, hex (0x) and binary (0b) literals are accepted
+ *
  * @param str String containing integer literal
  * @param value Value to put the result in
  *
@@ -161,6 +205,17 @@ svm_ext_t svm_str2ext(const char * str);
  */
 bool svm_to_int32(const char * str, int32_t * value);
 
+/**
+ * Converts string of given length (not NULL-terminated) to int32_t
+ *
+ * @param str String containing integer literal
+ * @param length Length of string
+ * @param value Value to put the result in
+ *
+ * @retval true if conversion was successful
+ */
+bool svm_strn_to_int32(const char * str, uint32_t length, int32_t * value);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
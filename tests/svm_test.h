@@ -0,0 +1,72 @@
+/** ========================================================================= *
+ *
+ * @file svm_test.h
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Minimal helpers, shared by test programs
+ *
+ * Each test is a standalone program, that returns 0 on success and prints
+ * the first failed check otherwise
+ *
+ *  ========================================================================= */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ================================================================= */
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Defines ================================================================== */
+/* Macros =================================================================== */
+/**
+ * Count of elements in array
+ */
+#define SVM_TEST_ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * Fails the test (returns 1 from the calling function), if expr is false
+ */
+#define SVM_TEST_CHECK(expr)                                              \
+  do {                                                                    \
+    if (!(expr)) {                                                        \
+      printf("FAIL: %s (%s:%d)\n", #expr, __FILE__, __LINE__);            \
+      return 1;                                                           \
+    }                                                                     \
+  } while (0)
+
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Shared functions ========================================================= */
+/**
+ * Returns monotonic time in milliseconds
+ */
+static inline double svm_test_time_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Returns the next pseudo-random number (xorshift64)
+ *
+ * @param state Generator state (must not be 0)
+ */
+static inline uint64_t svm_test_random(uint64_t * state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+#ifdef __cplusplus
+}
+#endif
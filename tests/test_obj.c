@@ -0,0 +1,76 @@
+/** ========================================================================= *
+ *
+ * @file test_obj.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Object round trip test
+ *
+ * Saves repetitive code & random (incompressible) code with LZ, checks,
+ * that the first one is compressed and the second one is stored as is,
+ * and that both load back unchanged
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm/svm_obj.h"
+#include "svm/svm_util.h"
+#include "svm_test.h"
+#include <string.h>
+
+/* Defines ================================================================== */
+#define SVM_TEST_OBJ_WORDS 4096
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+static int32_t svm_test_words[SVM_TEST_OBJ_WORDS];
+
+/* Private functions ======================================================== */
+/**
+ * Saves code with LZ, checks compression in header & loads it back
+ */
+static int svm_test_round_trip(svm_code_t * code, svm_obj_compression_t expected) {
+  uint8_t * data;
+  uint32_t size;
+  svm_code_t loaded;
+
+  SVM_TEST_CHECK(svm_obj_save(code, NULL, SVM_OBJ_COMPRESSION_LZ, &data, &size) == SVM_OK);
+
+  const svm_obj_header_t * header = (const svm_obj_header_t *) data;
+
+  SVM_TEST_CHECK(header->compression == expected);
+  SVM_TEST_CHECK(header->payload_size && header->payload_size <= code->size * sizeof(code->buffer[0]));
+  SVM_TEST_CHECK(size == sizeof(svm_obj_header_t) + header->payload_size);
+
+  SVM_TEST_CHECK(svm_obj_load(&loaded, data, size) == SVM_OK);
+  SVM_TEST_CHECK(loaded.size == code->size);
+  SVM_TEST_CHECK(!memcmp(loaded.buffer, code->buffer, code->size * sizeof(code->buffer[0])));
+
+  svm_obj_free(&loaded);
+  svm_free(data);
+
+  return 0;
+}
+
+/* Shared functions ========================================================= */
+int main(void) {
+  svm_code_t code = {.buffer = svm_test_words, .size = SVM_TEST_OBJ_WORDS};
+  uint64_t random = 0x9e3779b97f4a7c15ull;
+
+  for (uint32_t i = 0; i < SVM_TEST_OBJ_WORDS; ++i) {
+    svm_test_words[i] = i % 16;
+  }
+
+  SVM_TEST_CHECK(!svm_test_round_trip(&code, SVM_OBJ_COMPRESSION_LZ));
+
+  for (uint32_t i = 0; i < SVM_TEST_OBJ_WORDS; ++i) {
+    svm_test_words[i] = svm_test_random(&random);
+  }
+
+  SVM_TEST_CHECK(!svm_test_round_trip(&code, SVM_OBJ_COMPRESSION_NONE));
+
+  return 0;
+}
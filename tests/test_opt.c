@@ -0,0 +1,576 @@
+/** ========================================================================= *
+ *
+ * @file test_opt.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Differential test of the optimizer
+ *
+ * Generates SVM_TEST_OPT_PROGRAMS random programs (straight-line ALU code,
+ * conditional jumps, jump chains, out-of-line blocks, counted loops with
+ * nested loops, subroutine calls with push/pop around them & syscalls),
+ * runs each one unoptimized and at every configuration of
+ * svm_test_opt_configs, and compares sequence of syscalls with all
+ * registers at each of them, and the way execution ended. Every end is
+ * preceded with a syscall, so final registers are compared as well.
+ *
+ * Programs, that don't finish in SVM_TEST_OPT_MAX_CYCLES unoptimized, are
+ * skipped. Failing program is printed along with the seed.
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm/svm.h"
+#include "svm/svm_asm.h"
+#include "svm/svm_opt.h"
+#include "svm/svm_util.h"
+#include "svm_test.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines ================================================================== */
+#ifndef SVM_TEST_OPT_PROGRAMS
+#define SVM_TEST_OPT_PROGRAMS 500
+#endif
+
+#ifndef SVM_TEST_OPT_SEED
+#define SVM_TEST_OPT_SEED 1
+#endif
+
+#ifndef SVM_TEST_OPT_MAX_CYCLES
+#define SVM_TEST_OPT_MAX_CYCLES 100000
+#endif
+
+#define SVM_TEST_OPT_TEXT_SIZE     (64 * 1024)
+#define SVM_TEST_OPT_SYSCALLS      256
+#define SVM_TEST_OPT_PENDING       64
+#define SVM_TEST_OPT_SUBROUTINES   4
+#define SVM_TEST_OPT_LOOP_DEPTH    2
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/**
+ * The way execution ended
+ */
+typedef enum {
+  SVM_TEST_OPT_ENDED = 0,           /** Reached end */
+  SVM_TEST_OPT_FAILED,              /** svm_cycle returned an error */
+  SVM_TEST_OPT_TIMEOUT,             /** Ran out of cycles */
+} svm_test_opt_status_t;
+
+/* Types ==================================================================== */
+/**
+ * Growing text of generated program
+ */
+typedef struct {
+  char buffer[SVM_TEST_OPT_TEXT_SIZE];
+  size_t size;
+} svm_test_text_t;
+
+/**
+ * Generator state
+ */
+typedef struct {
+  svm_test_text_t body;             /** Main part, falls through to end */
+  svm_test_text_t tail;             /** Jump trampolines & out-of-line blocks, placed after end */
+  uint64_t random;
+  uint32_t labels;                  /** Count of labels used so far */
+  uint32_t subroutines;             /** Count of subroutines Q1..Qn */
+
+  struct {
+    uint32_t label;
+    uint32_t at;                    /** Index of statement, label is placed after */
+  } pending[SVM_TEST_OPT_PENDING];
+  uint32_t pending_count;
+} svm_test_gen_t;
+
+/**
+ * Syscall, made by program, with registers at that point
+ */
+typedef struct {
+  int32_t num;
+  int32_t registers[R_MAX];
+} svm_test_syscall_t;
+
+/**
+ * Observable result of execution
+ */
+typedef struct {
+  svm_test_syscall_t syscalls[SVM_TEST_OPT_SYSCALLS];
+  uint32_t count;                   /** Count of syscalls made (may exceed logged ones) */
+  svm_test_opt_status_t status;
+  svm_error_t error;
+} svm_test_run_t;
+
+/* Variables ================================================================ */
+static const char * svm_test_exts[] = {"", ".eq", ".ne", ".lt", ".le", ".gt", ".ge", ".nz", ".z"};
+static const char * svm_test_alu[] = {"add", "sub", "mul", "and", "or", "xor", "shl", "shr", "div"};
+static const int32_t svm_test_numbers[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 16, 20, 100};
+
+static const svm_opt_config_t svm_test_opt_configs[] = {
+  {.level = 1, .inline_size = SVM_OPT_INLINE_SIZE},
+  {.level = 2, .inline_size = SVM_OPT_INLINE_SIZE},
+  {.level = 2, .inline_size = 0},
+};
+
+static svm_test_gen_t svm_test_gen;
+static svm_test_run_t svm_test_expected;
+static svm_test_run_t svm_test_actual;
+
+/* Private functions ======================================================== */
+static void svm_test_emit(svm_test_text_t * text, const char * fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+  int size = vsnprintf(text->buffer + text->size, sizeof(text->buffer) - text->size, fmt, args);
+  va_end(args);
+
+  if (size > 0 && text->size + size + 1 < sizeof(text->buffer)) {
+    text->size += size;
+    text->buffer[text->size++] = '\n';
+    text->buffer[text->size] = '\0';
+  }
+}
+
+static uint32_t svm_test_gen_int(svm_test_gen_t * gen, uint32_t bound) {
+  return svm_test_random(&gen->random) % bound;
+}
+
+/**
+ * @retval true With probability of percent %
+ */
+static bool svm_test_gen_chance(svm_test_gen_t * gen, uint32_t percent) {
+  return svm_test_gen_int(gen, 100) < percent;
+}
+
+static const char * svm_test_gen_ext(svm_test_gen_t * gen) {
+  return svm_test_exts[svm_test_gen_int(gen, SVM_TEST_ARRAY_SIZE(svm_test_exts))];
+}
+
+/**
+ * Returns extension for 30% of instructions
+ */
+static const char * svm_test_gen_maybe_ext(svm_test_gen_t * gen) {
+  return svm_test_gen_chance(gen, 30) ? svm_test_gen_ext(gen) : "";
+}
+
+static int32_t svm_test_gen_number(svm_test_gen_t * gen) {
+  uint32_t index = svm_test_gen_int(gen, SVM_TEST_ARRAY_SIZE(svm_test_numbers) + 1);
+
+  return index < SVM_TEST_ARRAY_SIZE(svm_test_numbers) ? svm_test_numbers[index] : (int32_t) svm_test_gen_int(gen, 5000);
+}
+
+/**
+ * Returns one of general purpose registers (r6..r8 are loop counters)
+ */
+static uint32_t svm_test_gen_reg(svm_test_gen_t * gen) {
+  return svm_test_gen_int(gen, 6);
+}
+
+/**
+ * Returns register or immediate argument
+ */
+static const char * svm_test_gen_arg(svm_test_gen_t * gen) {
+  static char arg[16];
+
+  if (svm_test_gen_chance(gen, 50)) {
+    snprintf(arg, sizeof(arg), "r%u", svm_test_gen_reg(gen));
+  } else {
+    snprintf(arg, sizeof(arg), "%d", svm_test_gen_number(gen));
+  }
+
+  return arg;
+}
+
+/**
+ * Emits ALU instruction with arguments, that can't fault
+ */
+static void svm_test_gen_alu(svm_test_gen_t * gen, svm_test_text_t * text, const char * ext, uint32_t ops) {
+  const char * op = svm_test_alu[svm_test_gen_int(gen, ops)];
+  uint32_t reg = svm_test_gen_reg(gen);
+
+  if (!strcmp(op, "shl") || !strcmp(op, "shr")) {
+    svm_test_emit(text, "%s%s r%u %u", op, ext, reg, svm_test_gen_int(gen, 5));
+  } else if (!strcmp(op, "div")) {
+    svm_test_emit(text, "%s%s r%u %u", op, ext, reg, svm_test_gen_int(gen, 5) + 1);
+  } else {
+    svm_test_emit(text, "%s%s r%u %s", op, ext, reg, svm_test_gen_arg(gen));
+  }
+}
+
+/**
+ * Emits call of random subroutine
+ */
+static void svm_test_gen_call(svm_test_gen_t * gen, svm_test_text_t * text, const char * ext) {
+  svm_test_emit(text, "inv%s Q%u", ext, svm_test_gen_int(gen, gen->subroutines) + 1);
+}
+
+/**
+ * Emits counted loop, using register r<counter>, that may contain nested loops
+ */
+static void svm_test_gen_loop(svm_test_gen_t * gen, uint32_t counter, uint32_t depth) {
+  svm_test_text_t * text = &gen->body;
+  uint32_t label = ++gen->labels;
+  uint32_t count = svm_test_gen_int(gen, 6) + 1;
+
+  svm_test_emit(text, "mov r%u 0", counter);
+  svm_test_emit(text, "W%u", label);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t kind = svm_test_gen_int(gen, 100);
+
+    if (kind < 30) {
+      static const char * ops[] = {"and", "add", "mul", "shl"};
+      uint32_t reg = svm_test_gen_reg(gen);
+
+      svm_test_emit(text, "mov r%u r%u", reg, svm_test_gen_reg(gen));
+      svm_test_emit(text, "%s r%u %u", ops[svm_test_gen_int(gen, SVM_TEST_ARRAY_SIZE(ops))], reg, svm_test_gen_int(gen, 7) + 1);
+    } else if (kind < 40 && depth < SVM_TEST_OPT_LOOP_DEPTH) {
+      svm_test_gen_loop(gen, counter + 1, depth + 1);
+    } else if (kind < 45) {
+      if (gen->subroutines && svm_test_gen_chance(gen, 60)) {
+        svm_test_gen_call(gen, text, "");
+      } else {
+        svm_test_emit(text, "sys 1");
+      }
+    } else if (kind < 50) {
+      svm_test_emit(text, "div r%u %u", svm_test_gen_reg(gen), svm_test_gen_int(gen, 3) + 1);
+    } else if (kind < 55) {
+      svm_test_emit(text, "clf%s", svm_test_gen_ext(gen));
+    } else if (svm_test_gen_chance(gen, 25)) {
+      svm_test_emit(text, "mov%s r%u %s", svm_test_gen_maybe_ext(gen), svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+    } else {
+      svm_test_gen_alu(gen, text, svm_test_gen_chance(gen, 20) ? svm_test_gen_ext(gen) : "", 8);
+    }
+  }
+
+  // Flags are sticky, so they are cleared before the loop condition
+  svm_test_emit(text, "add r%u 1", counter);
+  svm_test_emit(text, "clf");
+  svm_test_emit(text, "cmp r%u %u", counter, svm_test_gen_int(gen, 5) + 1);
+  svm_test_emit(text, "jmp lt W%u", label);
+}
+
+/**
+ * Emits forward jump to label, placed a few statements later, directly or
+ * through the tail
+ */
+static void svm_test_gen_jump(svm_test_gen_t * gen, uint32_t at, const char * ext) {
+  uint32_t label = ++gen->labels;
+  uint32_t kind = svm_test_gen_int(gen, 100);
+
+  if (gen->pending_count < SVM_TEST_OPT_PENDING) {
+    gen->pending[gen->pending_count].label = label;
+    gen->pending[gen->pending_count].at = at + svm_test_gen_int(gen, 5) + 1;
+    gen->pending_count++;
+  }
+
+  if (kind < 30) {
+    // Chain of one or two trampolines
+    uint32_t trampoline = ++gen->labels;
+
+    svm_test_emit(&gen->body, "jmp%s T%u", ext, trampoline);
+    svm_test_emit(&gen->tail, "T%u", trampoline);
+
+    if (svm_test_gen_chance(gen, 50)) {
+      uint32_t next = ++gen->labels;
+
+      svm_test_emit(&gen->tail, "jmp%s T%u", svm_test_gen_chance(gen, 33) ? ext : "", next);
+      svm_test_emit(&gen->tail, "T%u", next);
+    }
+
+    svm_test_emit(&gen->tail, "jmp%s L%u", svm_test_gen_chance(gen, 33) ? ext : "", label);
+  } else if (kind < 50) {
+    // Out of line block, that returns or ends execution
+    uint32_t block = ++gen->labels;
+    uint32_t count = svm_test_gen_int(gen, 3) + 1;
+
+    svm_test_emit(&gen->body, "jmp%s O%u", ext, block);
+    svm_test_emit(&gen->tail, "O%u", block);
+
+    for (uint32_t i = 0; i < count; ++i) {
+      svm_test_emit(&gen->tail, "add r%u %s", svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+    }
+
+    if (svm_test_gen_chance(gen, 30)) {
+      svm_test_emit(&gen->tail, "sys 2");
+      svm_test_emit(&gen->tail, "end");
+    } else {
+      svm_test_emit(&gen->tail, "jmp L%u", label);
+    }
+  } else {
+    svm_test_emit(&gen->body, "jmp%s L%u", svm_test_gen_ext(gen), label);
+  }
+}
+
+/**
+ * Places labels, pending at statement at (or all remaining ones)
+ */
+static void svm_test_gen_labels(svm_test_gen_t * gen, uint32_t at, bool all) {
+  for (uint32_t i = 0; i < gen->pending_count;) {
+    if (all || gen->pending[i].at == at) {
+      svm_test_emit(&gen->body, "L%u", gen->pending[i].label);
+      gen->pending[i] = gen->pending[--gen->pending_count];
+    } else {
+      i++;
+    }
+  }
+}
+
+/**
+ * Emits subroutines, Qn may only call Qm with m > n, so there is no recursion
+ */
+static void svm_test_gen_subroutines(svm_test_gen_t * gen) {
+  static const char * ops[] = {"add", "sub", "xor", "mov", "cmp"};
+
+  for (uint32_t sub = 1; sub <= gen->subroutines; ++sub) {
+    uint32_t count = svm_test_gen_int(gen, 5) + 1;
+
+    svm_test_emit(&gen->tail, "Q%u", sub);
+
+    for (uint32_t i = 0; i < count; ++i) {
+      if (sub < gen->subroutines && svm_test_gen_chance(gen, 20)) {
+        svm_test_emit(&gen->tail, "inv Q%u", sub + 1 + svm_test_gen_int(gen, gen->subroutines - sub));
+      } else {
+        const char * op = ops[svm_test_gen_int(gen, SVM_TEST_ARRAY_SIZE(ops))];
+        svm_test_emit(&gen->tail, "%s r%u %s", op, svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+      }
+    }
+
+    svm_test_emit(&gen->tail, "ret");
+  }
+}
+
+/**
+ * Generates program from seed into gen->body
+ */
+static void svm_test_generate(svm_test_gen_t * gen, uint64_t seed) {
+  memset(gen, 0, sizeof(*gen));
+
+  gen->random = seed * 0x9e3779b97f4a7c15ull + 1;
+  gen->subroutines = svm_test_gen_int(gen, SVM_TEST_OPT_SUBROUTINES);
+
+  uint32_t statements = svm_test_gen_int(gen, 36) + 5;
+
+  for (uint32_t i = 0; i < statements; ++i) {
+    uint32_t kind = svm_test_gen_int(gen, 100);
+    const char * ext = svm_test_gen_maybe_ext(gen);
+    svm_test_text_t * text = &gen->body;
+
+    if (kind < 25) {
+      svm_test_emit(text, "mov%s r%u %s", ext, svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+    } else if (kind < 50) {
+      svm_test_gen_alu(gen, text, ext, SVM_TEST_ARRAY_SIZE(svm_test_alu));
+    } else if (kind < 60) {
+      svm_test_emit(text, "cmp r%u %s", svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+    } else if (kind < 65) {
+      svm_test_emit(text, "clf%s", svm_test_gen_ext(gen));
+    } else if (kind < 72) {
+      svm_test_gen_jump(gen, i, ext);
+    } else if (kind < 77 && gen->subroutines) {
+      if (svm_test_gen_chance(gen, 50)) {
+        // Call with registers saved around it
+        uint32_t first = svm_test_gen_int(gen, 4);
+        uint32_t last = first + svm_test_gen_int(gen, 5);
+
+        if (last > first) {
+          svm_test_emit(text, "push r%u r%u", first, last);
+        } else {
+          svm_test_emit(text, "push r%u", first);
+        }
+
+        if (svm_test_gen_chance(gen, 30)) {
+          svm_test_emit(text, "mov r%u %s", svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+        }
+
+        svm_test_gen_call(gen, text, "");
+
+        if (svm_test_gen_chance(gen, 30)) {
+          svm_test_emit(text, "add r%u %s", svm_test_gen_reg(gen), svm_test_gen_arg(gen));
+        }
+
+        if (last > first) {
+          svm_test_emit(text, "pop r%u r%u", first, last);
+        } else {
+          svm_test_emit(text, "pop r%u", first);
+        }
+      } else {
+        svm_test_gen_call(gen, text, svm_test_gen_ext(gen));
+      }
+    } else if (kind < 82) {
+      uint32_t first = svm_test_gen_int(gen, 5);
+      bool pair = svm_test_gen_chance(gen, 50);
+
+      svm_test_emit(text, pair ? "push r%u r%u" : "push r%u", first, first + 1);
+
+      if (svm_test_gen_chance(gen, 50)) {
+        svm_test_emit(text, "mov r%u %d", first, svm_test_gen_number(gen));
+      }
+
+      svm_test_emit(text, pair ? "pop r%u r%u" : "pop r%u", first, first + 1);
+    } else if (kind < 83) {
+      svm_test_emit(text, "nop");
+    } else if (kind < 88) {
+      svm_test_gen_loop(gen, 6, 0);
+    } else {
+      svm_test_emit(text, "sys 1");
+    }
+
+    svm_test_gen_labels(gen, i, false);
+  }
+
+  svm_test_gen_labels(gen, 0, true);
+
+  svm_test_emit(&gen->body, "sys 2");
+  svm_test_emit(&gen->body, "end");
+
+  svm_test_gen_subroutines(gen);
+
+  SVM_ASSERT_RETURN(gen->body.size + gen->tail.size < sizeof(gen->body.buffer));
+
+  memcpy(gen->body.buffer + gen->body.size, gen->tail.buffer, gen->tail.size + 1);
+  gen->body.size += gen->tail.size;
+}
+
+/**
+ * Assembles program, optimizes it with config (if not NULL) & runs it
+ */
+static svm_asm_error_t svm_test_run(const char * source, size_t size, const svm_opt_config_t * config, svm_test_run_t * run) {
+  svm_asm_t ctx;
+
+  memset(run, 0, sizeof(*run));
+
+  SVM_ASM_ERROR_CHECK_RETURN(svm_asm_init(&ctx));
+
+  svm_asm_error_t res = svm_asm_feed(&ctx, source, size);
+
+  if (res == SVM_ASM_OK) {
+    res = svm_asm_finish(&ctx);
+  }
+
+  if (res == SVM_ASM_OK && config) {
+    res = svm_opt_run(&ctx, config, NULL);
+  }
+
+  if (res != SVM_ASM_OK) {
+    svm_asm_free(&ctx);
+    return res;
+  }
+
+  svm_code_t code = {
+    .buffer = ctx.code.buffer,
+    .size = ctx.code.size,
+    .meta.call_stack_size = ctx.meta.call_stack_size,
+    .meta.stack_size = ctx.meta.stack_size,
+  };
+
+  svm_t vm;
+  uint32_t cycles = 0;
+
+  svm_init(&vm, run);
+  run->error = svm_load(&vm, &code);
+  run->status = run->error == SVM_OK ? SVM_TEST_OPT_ENDED : SVM_TEST_OPT_FAILED;
+
+  while (run->status == SVM_TEST_OPT_ENDED && vm.flags.running) {
+    if (cycles++ >= SVM_TEST_OPT_MAX_CYCLES) {
+      run->status = SVM_TEST_OPT_TIMEOUT;
+    } else if ((run->error = svm_cycle(&vm)) != SVM_OK) {
+      run->status = SVM_TEST_OPT_FAILED;
+    }
+  }
+
+  svm_deinit(&vm);
+  svm_asm_free(&ctx);
+
+  return SVM_ASM_OK;
+}
+
+/**
+ * Compares observable results of two runs
+ */
+static bool svm_test_run_equal(const svm_test_run_t * a, const svm_test_run_t * b) {
+  uint32_t logged = a->count < SVM_TEST_OPT_SYSCALLS ? a->count : SVM_TEST_OPT_SYSCALLS;
+
+  return a->status == b->status && a->error == b->error && a->count == b->count
+      && !memcmp(a->syscalls, b->syscalls, logged * sizeof(a->syscalls[0]));
+}
+
+static void svm_test_run_print(const char * name, const svm_test_run_t * run) {
+  printf("%s: status %d, error %d, %u syscalls\n", name, run->status, run->error, run->count);
+
+  if (run->count && run->count <= SVM_TEST_OPT_SYSCALLS) {
+    const svm_test_syscall_t * last = &run->syscalls[run->count - 1];
+
+    printf("  last sys %d:", last->num);
+
+    for (uint32_t i = 0; i < R_MAX; ++i) {
+      printf(" %d", last->registers[i]);
+    }
+
+    printf("\n");
+  }
+}
+
+/* Shared functions ========================================================= */
+void svm_sys_handler(void * ctx, int32_t (*registers)[R_MAX], int32_t syscall_num) {
+  svm_test_run_t * run = ctx;
+
+  if (run->count < SVM_TEST_OPT_SYSCALLS) {
+    run->syscalls[run->count].num = syscall_num;
+    memcpy(run->syscalls[run->count].registers, *registers, sizeof(run->syscalls[0].registers));
+  }
+
+  run->count++;
+}
+
+int main(void) {
+  uint32_t checked = 0, skipped = 0;
+  double start = svm_test_time_ms();
+
+  for (uint64_t seed = SVM_TEST_OPT_SEED; seed < SVM_TEST_OPT_SEED + SVM_TEST_OPT_PROGRAMS; ++seed) {
+    svm_test_gen_t * gen = &svm_test_gen;
+
+    svm_test_generate(gen, seed);
+
+    svm_asm_error_t res = svm_test_run(gen->body.buffer, gen->body.size, NULL, &svm_test_expected);
+
+    if (res != SVM_ASM_OK) {
+      printf("Seed %lu: failed to assemble (%d)\n%s", (unsigned long) seed, res, gen->body.buffer);
+      return 1;
+    }
+
+    if (svm_test_expected.status == SVM_TEST_OPT_TIMEOUT) {
+      skipped++;
+      continue;
+    }
+
+    for (uint32_t i = 0; i < SVM_TEST_ARRAY_SIZE(svm_test_opt_configs); ++i) {
+      const svm_opt_config_t * config = &svm_test_opt_configs[i];
+
+      res = svm_test_run(gen->body.buffer, gen->body.size, config, &svm_test_actual);
+
+      if (res != SVM_ASM_OK || !svm_test_run_equal(&svm_test_expected, &svm_test_actual)) {
+        printf(
+            "Seed %lu: -O%u (inline %u) differs from -O0 (%d)\n%s",
+            (unsigned long) seed, config->level, config->inline_size, res, gen->body.buffer
+        );
+        svm_test_run_print("-O0", &svm_test_expected);
+        svm_test_run_print("optimized", &svm_test_actual);
+        return 1;
+      }
+    }
+
+    checked++;
+  }
+
+  printf(
+      "%u programs checked at %zu configurations, %u skipped (%.1f ms)\n",
+      checked, SVM_TEST_ARRAY_SIZE(svm_test_opt_configs), skipped, svm_test_time_ms() - start
+  );
+
+  SVM_TEST_CHECK(checked > SVM_TEST_OPT_PROGRAMS / 2);
+
+  return 0;
+}
@@ -0,0 +1,169 @@
+/** ========================================================================= *
+ *
+ * @file test_task.c
+ * @date 16-10-2026
+ * @author Maksym Tkachuk <max.r.tkachuk@gmail.com>
+ *
+ * Run queue stress test
+ *
+ * Creates SVM_TEST_TASKS tasks, then removes them in random order while
+ * switching between them. After every operation head, tail and links
+ * around the affected task are checked, the whole ring is walked every
+ * SVM_TEST_TASK_WALK operations. Create & remove must take O(1), so both
+ * phases have to fit into SVM_TEST_TASK_TIME_LIMIT_MS.
+ *
+ *  ========================================================================= */
+
+/* Includes ================================================================= */
+#include "svm/svm.h"
+#include "svm_test.h"
+#include <stdlib.h>
+
+/* Defines ================================================================== */
+#ifndef SVM_TEST_TASKS
+#define SVM_TEST_TASKS 1000000
+#endif
+
+#ifndef SVM_TEST_TASK_WALK
+#define SVM_TEST_TASK_WALK 65536
+#endif
+
+#ifndef SVM_TEST_TASK_TIME_LIMIT_MS
+#define SVM_TEST_TASK_TIME_LIMIT_MS 30000
+#endif
+
+/* Macros =================================================================== */
+/* Exposed macros =========================================================== */
+/* Enums ==================================================================== */
+/* Types ==================================================================== */
+/* Variables ================================================================ */
+/* Private functions ======================================================== */
+/**
+ * Checks head & tail of run queue, that tasks are created in
+ */
+static int svm_test_ends(const svm_t * vm, uint32_t count) {
+  const svm_task_queue_t * queue = &vm->task.queue[SVM_TASK_PRIORITY_DEFAULT];
+
+  SVM_TEST_CHECK(vm->task.count == count);
+  SVM_TEST_CHECK(queue->count == count);
+
+  if (!count) {
+    SVM_TEST_CHECK(!queue->head && !queue->tail);
+    SVM_TEST_CHECK(!vm->task.ready);
+    SVM_TEST_CHECK(!vm->task.current);
+    return 0;
+  }
+
+  SVM_TEST_CHECK(queue->head && queue->tail);
+  SVM_TEST_CHECK(queue->head->prev == queue->tail);
+  SVM_TEST_CHECK(queue->tail->next == queue->head);
+  SVM_TEST_CHECK(vm->task.ready == 1u << SVM_TASK_PRIORITY_DEFAULT);
+
+  return 0;
+}
+
+/**
+ * Walks the whole ring both ways
+ */
+static int svm_test_walk(const svm_t * vm) {
+  const svm_task_queue_t * queue = &vm->task.queue[SVM_TASK_PRIORITY_DEFAULT];
+  const svm_task_t * task = queue->head;
+  uint32_t forward = 0, backward = 0;
+
+  if (!task) {
+    return 0;
+  }
+
+  do {
+    SVM_TEST_CHECK(task->next->prev == task);
+    SVM_TEST_CHECK(++forward <= queue->count);
+    task = task->next;
+  } while (task != queue->head);
+
+  do {
+    SVM_TEST_CHECK(task->prev->next == task);
+    SVM_TEST_CHECK(++backward <= queue->count);
+    task = task->prev;
+  } while (task != queue->head);
+
+  SVM_TEST_CHECK(forward == queue->count && backward == queue->count);
+
+  return 0;
+}
+
+/* Shared functions ========================================================= */
+int main(void) {
+  int32_t word = 0;
+  svm_code_t code = {.buffer = &word, .size = 1, .meta.call_stack_size = 1, .meta.stack_size = 1};
+  int32_t registers[R_MAX] = {0};
+  uint64_t random = 0x9e3779b97f4a7c15ull;
+  svm_t vm;
+
+  svm_task_t ** tasks = malloc(SVM_TEST_TASKS * sizeof(*tasks));
+  SVM_TEST_CHECK(tasks);
+
+  svm_init(&vm, NULL);
+  vm.code = &code;
+
+  double start = svm_test_time_ms();
+
+  for (uint32_t i = 0; i < SVM_TEST_TASKS; ++i) {
+    SVM_TEST_CHECK(svm_task_create(&vm, i, &registers, &tasks[i]) == SVM_OK);
+    SVM_TEST_CHECK(vm.task.queue[SVM_TASK_PRIORITY_DEFAULT].tail == tasks[i]);
+    SVM_TEST_CHECK(tasks[i]->prev->next == tasks[i]);
+    SVM_TEST_CHECK(!svm_test_ends(&vm, i + 1));
+
+    if (i % SVM_TEST_TASK_WALK == 0) {
+      SVM_TEST_CHECK(!svm_test_walk(&vm));
+    }
+  }
+
+  double created = svm_test_time_ms() - start;
+
+  SVM_TEST_CHECK(!svm_test_walk(&vm));
+
+  for (uint32_t i = SVM_TEST_TASKS - 1; i > 0; --i) {
+    uint32_t j = svm_test_random(&random) % (i + 1);
+    svm_task_t * tmp = tasks[i];
+    tasks[i] = tasks[j];
+    tasks[j] = tmp;
+  }
+
+  SVM_TEST_CHECK(svm_task_switch(&vm) == SVM_OK);
+
+  start = svm_test_time_ms();
+
+  for (uint32_t i = 0; i < SVM_TEST_TASKS; ++i) {
+    svm_task_t * task = tasks[i];
+    svm_task_t * prev = task->prev;
+    svm_task_t * next = task->next;
+
+    SVM_TEST_CHECK(svm_task_remove(&vm, task) == SVM_OK);
+    SVM_TEST_CHECK(!svm_test_ends(&vm, SVM_TEST_TASKS - i - 1));
+
+    if (prev != task) {
+      SVM_TEST_CHECK(prev->next == next && next->prev == prev);
+    }
+
+    if (vm.task.current) {
+      SVM_TEST_CHECK(vm.task.current->next->prev == vm.task.current);
+      SVM_TEST_CHECK(svm_task_switch(&vm) == SVM_OK);
+    }
+
+    if (i % SVM_TEST_TASK_WALK == 0) {
+      SVM_TEST_CHECK(!svm_test_walk(&vm));
+    }
+  }
+
+  double removed = svm_test_time_ms() - start;
+
+  printf("%u tasks: create %.1f ms, remove %.1f ms\n", SVM_TEST_TASKS, created, removed);
+
+  SVM_TEST_CHECK(created < SVM_TEST_TASK_TIME_LIMIT_MS);
+  SVM_TEST_CHECK(removed < SVM_TEST_TASK_TIME_LIMIT_MS);
+
+  free(tasks);
+  svm_deinit(&vm);
+
+  return 0;
+}